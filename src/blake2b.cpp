@@ -25,7 +25,6 @@
 #include <cstring>
 
 #include "blake2b.h"
-#include "utility/rotate_util.h"
 
 #if !defined(htole64)
 #define htole64(x)          (x)
@@ -33,7 +32,6 @@
 #if !defined(le64toh)
 #define le64toh(x)          (x)
 #endif
-#define pgm_read_byte(x)    (*(x))
 
 void clean(void *dest, size_t size);
 
@@ -108,10 +106,20 @@ void clean(void *dest, size_t size)
  * \brief Constructs a BLAKE2b hash object.
  */
 BLAKE2b::BLAKE2b()
+    : compress_(phylum::blake2b_compress_function(phylum::blake2b_selected()))
 {
     reset();
 }
 
+/**
+ * \brief Switches to another implementation of the compression
+ * function, which has to be supported.
+ */
+void BLAKE2b::backend(phylum::blake2b_backend backend)
+{
+    compress_ = phylum::blake2b_compress_function(backend);
+}
+
 /**
  * \brief Destroys this BLAKE2b hash object after clearing
  * sensitive information.
@@ -290,78 +298,15 @@ void BLAKE2b::finalizeHMAC(const void *key, size_t keyLen, void *hash, size_t ha
     clean(temp);
 }
 
-// Permutation on the message input state for BLAKE2b.
-static const uint8_t sigma[12][16] = {
-    { 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15},
-    {14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3},
-    {11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4},
-    { 7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8},
-    { 9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13},
-    { 2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9},
-    {12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11},
-    {13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10},
-    { 6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5},
-    {10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13 , 0},
-    { 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15},
-    {14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3},
-};
-
-// Perform a BLAKE2b quarter round operation.
-#define quarterRound(a, b, c, d, i)    \
-    do { \
-        uint64_t _b = (b); \
-        uint64_t _a = (a) + _b + state.m[pgm_read_byte(&(sigma[index][2 * (i)]))]; \
-        uint64_t _d = rightRotate32_64((d) ^ _a); \
-        uint64_t _c = (c) + _d; \
-        _b = rightRotate24_64(_b ^ _c); \
-        _a += _b + state.m[pgm_read_byte(&(sigma[index][2 * (i) + 1]))]; \
-        (d) = _d = rightRotate16_64(_d ^ _a); \
-        _c += _d; \
-        (a) = _a; \
-        (b) = rightRotate63_64(_b ^ _c); \
-        (c) = _c; \
-    } while (0)
-
 void BLAKE2b::processChunk(uint64_t f0)
 {
-    uint8_t index;
-    uint64_t v[16];
-
     // Byte-swap the message buffer into little-endian if necessary.
 #if !defined(CRYPTO_LITTLE_ENDIAN)
-    for (index = 0; index < 16; ++index)
+    for (uint8_t index = 0; index < 16; ++index)
         state.m[index] = le64toh(state.m[index]);
 #endif
 
-    // Format the block to be hashed.
-    memcpy(v, state.h, sizeof(state.h));
-    v[8]  = BLAKE2b_IV0;
-    v[9]  = BLAKE2b_IV1;
-    v[10] = BLAKE2b_IV2;
-    v[11] = BLAKE2b_IV3;
-    v[12] = BLAKE2b_IV4 ^ state.lengthLow;
-    v[13] = BLAKE2b_IV5 ^ state.lengthHigh;
-    v[14] = BLAKE2b_IV6 ^ f0;
-    v[15] = BLAKE2b_IV7;
-
-    // Perform the 12 BLAKE2b rounds.
-    for (index = 0; index < 12; ++index) {
-        // Column round.
-        quarterRound(v[0], v[4], v[8],  v[12], 0);
-        quarterRound(v[1], v[5], v[9],  v[13], 1);
-        quarterRound(v[2], v[6], v[10], v[14], 2);
-        quarterRound(v[3], v[7], v[11], v[15], 3);
-
-        // Diagonal round.
-        quarterRound(v[0], v[5], v[10], v[15], 4);
-        quarterRound(v[1], v[6], v[11], v[12], 5);
-        quarterRound(v[2], v[7], v[8],  v[13], 6);
-        quarterRound(v[3], v[4], v[9],  v[14], 7);
-    }
-
-    // Combine the new and old hash values.
-    for (index = 0; index < 8; ++index)
-        state.h[index] ^= (v[index] ^ v[index + 8]);
+    compress_(state.h, state.m, state.lengthLow, state.lengthHigh, f0);
 }
 
 /**
@@ -24,6 +24,7 @@
 #define CRYPTO_BLAKE2B_H
 
 // #include "Hash.h"
+#include "blake2b_compress.h"
 
 class BLAKE2b // : public Hash
 {
@@ -46,6 +47,8 @@ public:
     void resetHMAC(const void *key, size_t keyLen);
     void finalizeHMAC(const void *key, size_t keyLen, void *hash, size_t hashLen);
 
+    void backend(phylum::blake2b_backend backend);
+
 private:
     struct {
         uint64_t h[8];
@@ -54,6 +57,7 @@ private:
         uint64_t lengthHigh;
         uint8_t chunkSize;
     } state;
+    phylum::blake2b_compress_fn_t compress_;
 
     void processChunk(uint64_t f0);
     void formatHMACKey(void *block, const void *key, size_t len, uint8_t pad);
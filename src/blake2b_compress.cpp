@@ -0,0 +1,406 @@
+#include <cstring>
+
+#include "blake2b_compress.h"
+#include "utility/rotate_util.h"
+
+#if defined(__AVR__) || defined(__ARM_ARCH_6M__) || defined(PHYLUM_BLAKE2B_SMALL)
+#define PHYLUM_BLAKE2B_PORTABLE_ONLY
+#endif
+
+#if !defined(PHYLUM_BLAKE2B_PORTABLE_ONLY) && defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define PHYLUM_BLAKE2B_X86
+#endif
+
+#if !defined(PHYLUM_BLAKE2B_PORTABLE_ONLY) && defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PHYLUM_BLAKE2B_NEON
+#endif
+
+#define pgm_read_byte(x) (*(x))
+
+namespace phylum {
+
+static const uint64_t blake2b_iv[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+    0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL,
+};
+
+// Permutation on the message input state for BLAKE2b.
+static const uint8_t sigma[12][16] = {
+    { 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15},
+    {14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3},
+    {11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4},
+    { 7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8},
+    { 9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13},
+    { 2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9},
+    {12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11},
+    {13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10},
+    { 6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5},
+    {10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13 , 0},
+    { 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15},
+    {14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3},
+};
+
+// Perform a BLAKE2b quarter round operation.
+#define quarterRound(a, b, c, d, i)    \
+    do { \
+        uint64_t _b = (b); \
+        uint64_t _a = (a) + _b + m[pgm_read_byte(&(sigma[index][2 * (i)]))]; \
+        uint64_t _d = rightRotate32_64((d) ^ _a); \
+        uint64_t _c = (c) + _d; \
+        _b = rightRotate24_64(_b ^ _c); \
+        _a += _b + m[pgm_read_byte(&(sigma[index][2 * (i) + 1]))]; \
+        (d) = _d = rightRotate16_64(_d ^ _a); \
+        _c += _d; \
+        (a) = _a; \
+        (b) = rightRotate63_64(_b ^ _c); \
+        (c) = _c; \
+    } while (0)
+
+void blake2b_compress_portable(uint64_t h[8], uint64_t const m[16], uint64_t t0, uint64_t t1, uint64_t f0) {
+    uint8_t index;
+    uint64_t v[16];
+
+    // Format the block to be hashed.
+    memcpy(v, h, sizeof(uint64_t) * 8);
+    v[8]  = blake2b_iv[0];
+    v[9]  = blake2b_iv[1];
+    v[10] = blake2b_iv[2];
+    v[11] = blake2b_iv[3];
+    v[12] = blake2b_iv[4] ^ t0;
+    v[13] = blake2b_iv[5] ^ t1;
+    v[14] = blake2b_iv[6] ^ f0;
+    v[15] = blake2b_iv[7];
+
+    // Perform the 12 BLAKE2b rounds.
+    for (index = 0; index < 12; ++index) {
+        // Column round.
+        quarterRound(v[0], v[4], v[8],  v[12], 0);
+        quarterRound(v[1], v[5], v[9],  v[13], 1);
+        quarterRound(v[2], v[6], v[10], v[14], 2);
+        quarterRound(v[3], v[7], v[11], v[15], 3);
+
+        // Diagonal round.
+        quarterRound(v[0], v[5], v[10], v[15], 4);
+        quarterRound(v[1], v[6], v[11], v[12], 5);
+        quarterRound(v[2], v[7], v[8],  v[13], 6);
+        quarterRound(v[3], v[4], v[9],  v[14], 7);
+    }
+
+    // Combine the new and old hash values.
+    for (index = 0; index < 8; ++index)
+        h[index] ^= (v[index] ^ v[index + 8]);
+}
+
+/**
+ * The SIMD backends keep the 4x4 working state as rows, so each G
+ * step does all four columns (or diagonals) at once. Diagonalizing
+ * rotates rows two, three and four by one, two and three lanes.
+ */
+
+#if defined(PHYLUM_BLAKE2B_X86)
+
+__attribute__((target("sse4.1"), always_inline))
+static inline __m128i b2b_sse_rotr63(__m128i x) {
+    return _mm_xor_si128(_mm_srli_epi64(x, 63), _mm_add_epi64(x, x));
+}
+
+__attribute__((target("sse4.1"), always_inline))
+static inline void b2b_sse_g(__m128i &row1l, __m128i &row1h, __m128i &row2l, __m128i &row2h, __m128i &row3l,
+                             __m128i &row3h, __m128i &row4l, __m128i &row4h, __m128i b0l, __m128i b0h, __m128i b1l,
+                             __m128i b1h, __m128i r16, __m128i r24) {
+    row1l = _mm_add_epi64(_mm_add_epi64(row1l, b0l), row2l);
+    row1h = _mm_add_epi64(_mm_add_epi64(row1h, b0h), row2h);
+    row4l = _mm_shuffle_epi32(_mm_xor_si128(row4l, row1l), _MM_SHUFFLE(2, 3, 0, 1));
+    row4h = _mm_shuffle_epi32(_mm_xor_si128(row4h, row1h), _MM_SHUFFLE(2, 3, 0, 1));
+    row3l = _mm_add_epi64(row3l, row4l);
+    row3h = _mm_add_epi64(row3h, row4h);
+    row2l = _mm_shuffle_epi8(_mm_xor_si128(row2l, row3l), r24);
+    row2h = _mm_shuffle_epi8(_mm_xor_si128(row2h, row3h), r24);
+
+    row1l = _mm_add_epi64(_mm_add_epi64(row1l, b1l), row2l);
+    row1h = _mm_add_epi64(_mm_add_epi64(row1h, b1h), row2h);
+    row4l = _mm_shuffle_epi8(_mm_xor_si128(row4l, row1l), r16);
+    row4h = _mm_shuffle_epi8(_mm_xor_si128(row4h, row1h), r16);
+    row3l = _mm_add_epi64(row3l, row4l);
+    row3h = _mm_add_epi64(row3h, row4h);
+    row2l = b2b_sse_rotr63(_mm_xor_si128(row2l, row3l));
+    row2h = b2b_sse_rotr63(_mm_xor_si128(row2h, row3h));
+}
+
+__attribute__((target("sse4.1"), always_inline))
+static inline void b2b_sse_diagonalize(__m128i &row2l, __m128i &row2h, __m128i &row3l, __m128i &row3h, __m128i &row4l,
+                                       __m128i &row4h) {
+    auto t0 = _mm_alignr_epi8(row2h, row2l, 8);
+    auto t1 = _mm_alignr_epi8(row2l, row2h, 8);
+    row2l = t0;
+    row2h = t1;
+
+    t0 = row3l;
+    row3l = row3h;
+    row3h = t0;
+
+    t0 = _mm_alignr_epi8(row4l, row4h, 8);
+    t1 = _mm_alignr_epi8(row4h, row4l, 8);
+    row4l = t0;
+    row4h = t1;
+}
+
+__attribute__((target("sse4.1"), always_inline))
+static inline void b2b_sse_undiagonalize(__m128i &row2l, __m128i &row2h, __m128i &row3l, __m128i &row3h,
+                                         __m128i &row4l, __m128i &row4h) {
+    auto t0 = _mm_alignr_epi8(row2l, row2h, 8);
+    auto t1 = _mm_alignr_epi8(row2h, row2l, 8);
+    row2l = t0;
+    row2h = t1;
+
+    t0 = row3l;
+    row3l = row3h;
+    row3h = t0;
+
+    t0 = _mm_alignr_epi8(row4h, row4l, 8);
+    t1 = _mm_alignr_epi8(row4l, row4h, 8);
+    row4l = t0;
+    row4h = t1;
+}
+
+__attribute__((target("sse4.1")))
+static void blake2b_compress_sse41(uint64_t h[8], uint64_t const m[16], uint64_t t0, uint64_t t1, uint64_t f0) {
+    auto r16 = _mm_setr_epi8(2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9);
+    auto r24 = _mm_setr_epi8(3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10);
+
+    auto row1l = _mm_loadu_si128((__m128i const *)&h[0]);
+    auto row1h = _mm_loadu_si128((__m128i const *)&h[2]);
+    auto row2l = _mm_loadu_si128((__m128i const *)&h[4]);
+    auto row2h = _mm_loadu_si128((__m128i const *)&h[6]);
+    auto row3l = _mm_loadu_si128((__m128i const *)&blake2b_iv[0]);
+    auto row3h = _mm_loadu_si128((__m128i const *)&blake2b_iv[2]);
+    auto row4l = _mm_xor_si128(_mm_loadu_si128((__m128i const *)&blake2b_iv[4]), _mm_set_epi64x(t1, t0));
+    auto row4h = _mm_xor_si128(_mm_loadu_si128((__m128i const *)&blake2b_iv[6]), _mm_set_epi64x(0, f0));
+
+    for (auto r = 0; r < 12; ++r) {
+        auto s = sigma[r];
+
+        b2b_sse_g(row1l, row1h, row2l, row2h, row3l, row3h, row4l, row4h, _mm_set_epi64x(m[s[2]], m[s[0]]),
+                  _mm_set_epi64x(m[s[6]], m[s[4]]), _mm_set_epi64x(m[s[3]], m[s[1]]), _mm_set_epi64x(m[s[7]], m[s[5]]),
+                  r16, r24);
+        b2b_sse_diagonalize(row2l, row2h, row3l, row3h, row4l, row4h);
+        b2b_sse_g(row1l, row1h, row2l, row2h, row3l, row3h, row4l, row4h, _mm_set_epi64x(m[s[10]], m[s[8]]),
+                  _mm_set_epi64x(m[s[14]], m[s[12]]), _mm_set_epi64x(m[s[11]], m[s[9]]),
+                  _mm_set_epi64x(m[s[15]], m[s[13]]), r16, r24);
+        b2b_sse_undiagonalize(row2l, row2h, row3l, row3h, row4l, row4h);
+    }
+
+    row1l = _mm_xor_si128(row1l, row3l);
+    row1h = _mm_xor_si128(row1h, row3h);
+    row2l = _mm_xor_si128(row2l, row4l);
+    row2h = _mm_xor_si128(row2h, row4h);
+
+    _mm_storeu_si128((__m128i *)&h[0], _mm_xor_si128(_mm_loadu_si128((__m128i const *)&h[0]), row1l));
+    _mm_storeu_si128((__m128i *)&h[2], _mm_xor_si128(_mm_loadu_si128((__m128i const *)&h[2]), row1h));
+    _mm_storeu_si128((__m128i *)&h[4], _mm_xor_si128(_mm_loadu_si128((__m128i const *)&h[4]), row2l));
+    _mm_storeu_si128((__m128i *)&h[6], _mm_xor_si128(_mm_loadu_si128((__m128i const *)&h[6]), row2h));
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline void b2b_avx2_g(__m256i &row1, __m256i &row2, __m256i &row3, __m256i &row4, __m256i b0, __m256i b1,
+                              __m256i r16, __m256i r24) {
+    row1 = _mm256_add_epi64(_mm256_add_epi64(row1, b0), row2);
+    row4 = _mm256_shuffle_epi32(_mm256_xor_si256(row4, row1), _MM_SHUFFLE(2, 3, 0, 1));
+    row3 = _mm256_add_epi64(row3, row4);
+    row2 = _mm256_shuffle_epi8(_mm256_xor_si256(row2, row3), r24);
+
+    row1 = _mm256_add_epi64(_mm256_add_epi64(row1, b1), row2);
+    row4 = _mm256_shuffle_epi8(_mm256_xor_si256(row4, row1), r16);
+    row3 = _mm256_add_epi64(row3, row4);
+    row2 = _mm256_xor_si256(row2, row3);
+    row2 = _mm256_xor_si256(_mm256_srli_epi64(row2, 63), _mm256_add_epi64(row2, row2));
+}
+
+__attribute__((target("avx2")))
+static void blake2b_compress_avx2(uint64_t h[8], uint64_t const m[16], uint64_t t0, uint64_t t1, uint64_t f0) {
+    auto r16 = _mm256_setr_epi8(2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9, 2, 3, 4, 5, 6, 7, 0, 1, 10, 11,
+                                12, 13, 14, 15, 8, 9);
+    auto r24 = _mm256_setr_epi8(3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10, 3, 4, 5, 6, 7, 0, 1, 2, 11, 12,
+                                13, 14, 15, 8, 9, 10);
+
+    auto row1 = _mm256_loadu_si256((__m256i const *)&h[0]);
+    auto row2 = _mm256_loadu_si256((__m256i const *)&h[4]);
+    auto row3 = _mm256_loadu_si256((__m256i const *)&blake2b_iv[0]);
+    auto row4 = _mm256_xor_si256(_mm256_loadu_si256((__m256i const *)&blake2b_iv[4]), _mm256_set_epi64x(0, f0, t1, t0));
+
+    for (auto r = 0; r < 12; ++r) {
+        auto s = sigma[r];
+
+        b2b_avx2_g(row1, row2, row3, row4, _mm256_set_epi64x(m[s[6]], m[s[4]], m[s[2]], m[s[0]]),
+                   _mm256_set_epi64x(m[s[7]], m[s[5]], m[s[3]], m[s[1]]), r16, r24);
+
+        row2 = _mm256_permute4x64_epi64(row2, _MM_SHUFFLE(0, 3, 2, 1));
+        row3 = _mm256_permute4x64_epi64(row3, _MM_SHUFFLE(1, 0, 3, 2));
+        row4 = _mm256_permute4x64_epi64(row4, _MM_SHUFFLE(2, 1, 0, 3));
+
+        b2b_avx2_g(row1, row2, row3, row4, _mm256_set_epi64x(m[s[14]], m[s[12]], m[s[10]], m[s[8]]),
+                   _mm256_set_epi64x(m[s[15]], m[s[13]], m[s[11]], m[s[9]]), r16, r24);
+
+        row2 = _mm256_permute4x64_epi64(row2, _MM_SHUFFLE(2, 1, 0, 3));
+        row3 = _mm256_permute4x64_epi64(row3, _MM_SHUFFLE(1, 0, 3, 2));
+        row4 = _mm256_permute4x64_epi64(row4, _MM_SHUFFLE(0, 3, 2, 1));
+    }
+
+    row1 = _mm256_xor_si256(row1, row3);
+    row2 = _mm256_xor_si256(row2, row4);
+
+    _mm256_storeu_si256((__m256i *)&h[0], _mm256_xor_si256(_mm256_loadu_si256((__m256i const *)&h[0]), row1));
+    _mm256_storeu_si256((__m256i *)&h[4], _mm256_xor_si256(_mm256_loadu_si256((__m256i const *)&h[4]), row2));
+}
+
+static bool blake2b_has(blake2b_backend backend) {
+    __builtin_cpu_init();
+    switch (backend) {
+    case blake2b_backend::Sse41:
+        return __builtin_cpu_supports("sse4.1");
+    case blake2b_backend::Avx2:
+        return __builtin_cpu_supports("avx2");
+    default:
+        return false;
+    }
+}
+
+#endif
+
+#if defined(PHYLUM_BLAKE2B_NEON)
+
+static inline uint64x2_t b2b_neon_pair(uint64_t lo, uint64_t hi) {
+    return vcombine_u64(vcreate_u64(lo), vcreate_u64(hi));
+}
+
+template <int N>
+static inline uint64x2_t b2b_neon_rotr(uint64x2_t x) {
+    return vorrq_u64(vshrq_n_u64(x, N), vshlq_n_u64(x, 64 - N));
+}
+
+static inline void b2b_neon_g(uint64x2_t &row1l, uint64x2_t &row1h, uint64x2_t &row2l, uint64x2_t &row2h,
+                              uint64x2_t &row3l, uint64x2_t &row3h, uint64x2_t &row4l, uint64x2_t &row4h,
+                              uint64x2_t b0l, uint64x2_t b0h, uint64x2_t b1l, uint64x2_t b1h) {
+    row1l = vaddq_u64(vaddq_u64(row1l, b0l), row2l);
+    row1h = vaddq_u64(vaddq_u64(row1h, b0h), row2h);
+    row4l = vreinterpretq_u64_u32(vrev64q_u32(vreinterpretq_u32_u64(veorq_u64(row4l, row1l))));
+    row4h = vreinterpretq_u64_u32(vrev64q_u32(vreinterpretq_u32_u64(veorq_u64(row4h, row1h))));
+    row3l = vaddq_u64(row3l, row4l);
+    row3h = vaddq_u64(row3h, row4h);
+    row2l = b2b_neon_rotr<24>(veorq_u64(row2l, row3l));
+    row2h = b2b_neon_rotr<24>(veorq_u64(row2h, row3h));
+
+    row1l = vaddq_u64(vaddq_u64(row1l, b1l), row2l);
+    row1h = vaddq_u64(vaddq_u64(row1h, b1h), row2h);
+    row4l = b2b_neon_rotr<16>(veorq_u64(row4l, row1l));
+    row4h = b2b_neon_rotr<16>(veorq_u64(row4h, row1h));
+    row3l = vaddq_u64(row3l, row4l);
+    row3h = vaddq_u64(row3h, row4h);
+    row2l = b2b_neon_rotr<63>(veorq_u64(row2l, row3l));
+    row2h = b2b_neon_rotr<63>(veorq_u64(row2h, row3h));
+}
+
+static void blake2b_compress_neon(uint64_t h[8], uint64_t const m[16], uint64_t t0, uint64_t t1, uint64_t f0) {
+    auto row1l = vld1q_u64(&h[0]);
+    auto row1h = vld1q_u64(&h[2]);
+    auto row2l = vld1q_u64(&h[4]);
+    auto row2h = vld1q_u64(&h[6]);
+    auto row3l = vld1q_u64(&blake2b_iv[0]);
+    auto row3h = vld1q_u64(&blake2b_iv[2]);
+    auto row4l = veorq_u64(vld1q_u64(&blake2b_iv[4]), b2b_neon_pair(t0, t1));
+    auto row4h = veorq_u64(vld1q_u64(&blake2b_iv[6]), b2b_neon_pair(f0, 0));
+
+    for (auto r = 0; r < 12; ++r) {
+        auto s = sigma[r];
+
+        b2b_neon_g(row1l, row1h, row2l, row2h, row3l, row3h, row4l, row4h, b2b_neon_pair(m[s[0]], m[s[2]]),
+                   b2b_neon_pair(m[s[4]], m[s[6]]), b2b_neon_pair(m[s[1]], m[s[3]]), b2b_neon_pair(m[s[5]], m[s[7]]));
+
+        auto t2 = vextq_u64(row2l, row2h, 1);
+        auto t3 = vextq_u64(row2h, row2l, 1);
+        row2l = t2;
+        row2h = t3;
+        t2 = row3l;
+        row3l = row3h;
+        row3h = t2;
+        t2 = vextq_u64(row4h, row4l, 1);
+        t3 = vextq_u64(row4l, row4h, 1);
+        row4l = t2;
+        row4h = t3;
+
+        b2b_neon_g(row1l, row1h, row2l, row2h, row3l, row3h, row4l, row4h, b2b_neon_pair(m[s[8]], m[s[10]]),
+                   b2b_neon_pair(m[s[12]], m[s[14]]), b2b_neon_pair(m[s[9]], m[s[11]]),
+                   b2b_neon_pair(m[s[13]], m[s[15]]));
+
+        t2 = vextq_u64(row2h, row2l, 1);
+        t3 = vextq_u64(row2l, row2h, 1);
+        row2l = t2;
+        row2h = t3;
+        t2 = row3l;
+        row3l = row3h;
+        row3h = t2;
+        t2 = vextq_u64(row4l, row4h, 1);
+        t3 = vextq_u64(row4h, row4l, 1);
+        row4l = t2;
+        row4h = t3;
+    }
+
+    vst1q_u64(&h[0], veorq_u64(vld1q_u64(&h[0]), veorq_u64(row1l, row3l)));
+    vst1q_u64(&h[2], veorq_u64(vld1q_u64(&h[2]), veorq_u64(row1h, row3h)));
+    vst1q_u64(&h[4], veorq_u64(vld1q_u64(&h[4]), veorq_u64(row2l, row4l)));
+    vst1q_u64(&h[6], veorq_u64(vld1q_u64(&h[6]), veorq_u64(row2h, row4h)));
+}
+
+#endif
+
+bool blake2b_supported(blake2b_backend backend) {
+    switch (backend) {
+    case blake2b_backend::Portable:
+        return true;
+#if defined(PHYLUM_BLAKE2B_X86)
+    case blake2b_backend::Sse41:
+    case blake2b_backend::Avx2:
+        return blake2b_has(backend);
+#endif
+#if defined(PHYLUM_BLAKE2B_NEON)
+    case blake2b_backend::Neon:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+blake2b_backend blake2b_selected() {
+#if defined(PHYLUM_BLAKE2B_X86)
+    static auto selected = blake2b_has(blake2b_backend::Avx2)    ? blake2b_backend::Avx2
+                           : blake2b_has(blake2b_backend::Sse41) ? blake2b_backend::Sse41
+                                                                 : blake2b_backend::Portable;
+    return selected;
+#elif defined(PHYLUM_BLAKE2B_NEON)
+    return blake2b_backend::Neon;
+#else
+    return blake2b_backend::Portable;
+#endif
+}
+
+blake2b_compress_fn_t blake2b_compress_function(blake2b_backend backend) {
+    switch (backend) {
+#if defined(PHYLUM_BLAKE2B_X86)
+    case blake2b_backend::Sse41:
+        return blake2b_compress_sse41;
+    case blake2b_backend::Avx2:
+        return blake2b_compress_avx2;
+#endif
+#if defined(PHYLUM_BLAKE2B_NEON)
+    case blake2b_backend::Neon:
+        return blake2b_compress_neon;
+#endif
+    default:
+        return blake2b_compress_portable;
+    }
+}
+
+} // namespace phylum
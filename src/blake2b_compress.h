@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cinttypes>
+#include <cstdlib>
+
+namespace phylum {
+
+/**
+ * Implementations of the BLAKE2b compression function. Small targets
+ * only get the portable one, others also get whichever SIMD backends
+ * the compiler and CPU support, picked on first use.
+ */
+enum class blake2b_backend : uint8_t {
+    Portable,
+    Sse41,
+    Avx2,
+    Neon,
+};
+
+/**
+ * Compresses one 128 byte block, m, into the chain value h. The block
+ * counter is t0/t1 and f0 is all ones for the final block.
+ */
+typedef void (*blake2b_compress_fn_t)(uint64_t h[8], uint64_t const m[16], uint64_t t0, uint64_t t1, uint64_t f0);
+
+bool blake2b_supported(blake2b_backend backend);
+
+blake2b_backend blake2b_selected();
+
+/**
+ * Returns the compression function for the given backend, which has to
+ * be supported.
+ */
+blake2b_compress_fn_t blake2b_compress_function(blake2b_backend backend);
+
+void blake2b_compress_portable(uint64_t h[8], uint64_t const m[16], uint64_t t0, uint64_t t1, uint64_t f0);
+
+} // namespace phylum
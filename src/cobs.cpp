@@ -2,6 +2,9 @@
 
 namespace phylum {
 
+// Longest run of non-zero bytes in one block, which gets the code 0xff.
+static constexpr size_t CobsMaximumRun = 0xfe;
+
 cobs_writer::cobs_writer(io_writer *target, write_buffer &buffer) : target_(target), buffer_(buffer) {
     assert(buffer_.size() >= 256);
 }
@@ -9,70 +12,51 @@ cobs_writer::cobs_writer(io_writer *target, write_buffer &buffer) : target_(targ
 cobs_writer::~cobs_writer() {
 }
 
+/**
+ * Each block is its code followed by a run of non-zero bytes, so runs
+ * are found with memchr and sent to the target in one write, with the
+ * terminator tacked on to the final block.
+ */
 int32_t cobs_writer::write(uint8_t const *data, size_t size) {
     assert(data != nullptr);
     assert(size > 0);
 
+    auto block = buffer_.ptr();
     auto source_ptr = data;
+    auto end_of_data = data + size;
     auto wrote = 0;
 
     while (true) {
-        auto end_of_data = source_ptr == data + size;
-        auto buffer_full = buffer_.position() == 0xfe;
-        auto zero_byte = !end_of_data && *source_ptr == 0;
-
-        if (end_of_data || buffer_full || zero_byte) {
-            int32_t buffered = buffer_.position();
-            auto bytes_wrote = buffered + 1;
-
-            uint8_t code = buffered + 1;
-            if (target_->write(&code, 1) != 1) {
-                phyerrorf("cobs: writing code");
-                return -1;
-            }
-
-            if (buffered > 0) {
-                if (target_->write(buffer_.ptr(), buffered) != buffered) {
-                    phyerrorf("cobs: writing buffer (%d)", buffered);
-                    return -1;
-                }
-
-                buffer_.clear();
-            }
+        auto limit = std::min<size_t>(end_of_data - source_ptr, CobsMaximumRun);
+        auto zero = (uint8_t const *)memchr(source_ptr, 0, limit);
+        auto run = zero != nullptr ? (size_t)(zero - source_ptr) : limit;
+
+        block[0] = (uint8_t)(run + 1);
+        memcpy(block + 1, source_ptr, run);
+        source_ptr += run;
+
+        auto length = (int32_t)run + 1;
+        auto finished = false;
+        if (zero != nullptr) {
+            // Implied by any code under 0xff.
+            source_ptr++;
+        } else if (source_ptr == end_of_data) {
+            block[length++] = 0;
+            finished = true;
+        }
 
-            wrote += bytes_wrote;
+        if (target_->write(block, length) != length) {
+            phyerrorf("cobs: writing block (%d)", length);
+            return -1;
+        }
 
-            // phydebugf("end=%d full=%d zero=%d flag=%d buffered=%d wrote=%d", end_of_data, buffer_full, zero_byte, buffered, wrote);
+        wrote += length;
 
-            if (end_of_data) {
-                break;
-            }
-
-            if (zero_byte) {
-                if (buffer_full) {
-                    uint8_t code = 1;
-                    if (target_->write(&code, 1) != 1) {
-                        phyerrorf("cobs: writing code");
-                        return -1;
-                    }
-                    wrote++;
-                }
-                source_ptr++;
-            }
-        }
-        else {
-            buffer_.write(*source_ptr++);
+        if (finished) {
+            break;
         }
     }
 
-    uint8_t end = 0;
-    if (target_->write(&end, 1) != 1) {
-        phyerrorf("cobs: writing end");
-        return -1;
-    }
-
-    wrote++;
-
     if (!return_bytes_wrote_) {
         return size;
     }
@@ -83,34 +67,44 @@ int32_t cobs_writer::write(uint8_t const *data, size_t size) {
 cobs_reader::cobs_reader(io_reader *target) : target_(target) {
 }
 
+/**
+ * Reads the code and then the whole block it describes, never reading
+ * past the terminator so the following frame is left in the target.
+ */
 int32_t cobs_reader::read(uint8_t *data, size_t size) {
     assert(data != nullptr);
     assert(size > 0);
 
-	auto decode = data;
+    auto decode = data;
+    auto end_of_data = data + size;
 
-	for (uint8_t code = 0xff, block = 0; ; --block) {
-        uint8_t byte = 0;
-        if (target_->read(&byte, 1) != 1) {
+    for (uint8_t code = 0xff;;) {
+        auto terminated = code != 0xff;
+        if (target_->read(&code, 1) != 1 || code == 0x00) {
             break;
         }
 
-        if (block) {
-            *decode++ = byte;
+        auto run = (size_t)code - 1;
+        if ((size_t)(end_of_data - decode) < run + (terminated ? 1 : 0)) {
+            phyerrorf("cobs: frame too large (%zu)", size);
+            return -1;
         }
-        else {
-            auto terminated = code != 0xff;
-            block = code = byte;
-            if (code == 0x00) {
-                break;
-            }
-            if (terminated) {
-                *decode++ = 0;
+
+        if (terminated) {
+            *decode++ = 0;
+        }
+
+        while (run > 0) {
+            auto nread = target_->read(decode, run);
+            if (nread <= 0) {
+                return decode - data;
             }
+            decode += nread;
+            run -= nread;
         }
     }
 
-	return decode - data;
+    return decode - data;
 }
 
 } // namespace phylum
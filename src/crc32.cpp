@@ -1,7 +1,28 @@
 #include "phylum.h"
+#include "crc32.h"
+
+#if defined(__AVR__) || defined(__ARM_ARCH_6M__) || defined(PHYLUM_CRC32_SMALL)
+#define PHYLUM_CRC32_NIBBLE_ONLY
+#endif
+
+#if !defined(PHYLUM_CRC32_NIBBLE_ONLY) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define PHYLUM_CRC32_ARMV8
+#endif
+
+#if !defined(PHYLUM_CRC32_NIBBLE_ONLY) && defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define PHYLUM_CRC32_PCLMUL
+#endif
 
 namespace phylum {
 
+/**
+ * Every backend works on the inverted CRC, crc32_checksum does the
+ * inverting on the way in and out so calls can be chained.
+ */
+typedef uint32_t (*crc32_fn_t)(uint32_t crc, uint8_t const *data, size_t size);
+
 static uint32_t crc_table[16] = { 0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4,
                                   0x4db26158, 0x5005713c, 0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
                                   0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c };
@@ -17,12 +38,260 @@ uint32_t crc32_update(uint32_t crc, uint8_t data) {
     return crc;
 }
 
-uint32_t crc32_checksum(uint32_t previous, uint8_t const *data, size_t size) {
-    uint32_t crc = ~previous;
+static uint32_t crc32_nibble(uint32_t crc, uint8_t const *data, size_t size) {
     while (size-- > 0) {
         crc = crc32_update(crc, *(data++));
     }
-    return ~crc;
+    return crc;
+}
+
+#if !defined(PHYLUM_CRC32_NIBBLE_ONLY)
+
+// Table n gives the CRC of a byte followed by n zero bytes, so eight
+// bytes are folded in with eight independent lookups.
+struct crc32_tables_t {
+    uint32_t entries[8][256];
+
+    constexpr crc32_tables_t() : entries() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (auto j = 0; j < 8; ++j) {
+                crc = (crc >> 1) ^ (0xedb88320 & (0u - (crc & 1)));
+            }
+            entries[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (auto k = 1; k < 8; ++k) {
+                entries[k][i] = (entries[k - 1][i] >> 8) ^ entries[0][entries[k - 1][i] & 0xff];
+            }
+        }
+    }
+};
+
+static constexpr crc32_tables_t crc32_tables;
+
+static uint32_t crc32_slicing8(uint32_t crc, uint8_t const *data, size_t size) {
+    auto &t = crc32_tables.entries;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (size >= 8) {
+        uint32_t one;
+        uint32_t two;
+        memcpy(&one, data, sizeof(one));
+        memcpy(&two, data + 4, sizeof(two));
+        one ^= crc;
+        crc = t[7][one & 0xff] ^ t[6][(one >> 8) & 0xff] ^ t[5][(one >> 16) & 0xff] ^ t[4][one >> 24] ^
+              t[3][two & 0xff] ^ t[2][(two >> 8) & 0xff] ^ t[1][(two >> 16) & 0xff] ^ t[0][two >> 24];
+        data += 8;
+        size -= 8;
+    }
+#endif
+
+    while (size-- > 0) {
+        crc = t[0][(crc ^ *(data++)) & 0xff] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+#endif
+
+#if defined(PHYLUM_CRC32_ARMV8)
+
+static uint32_t crc32_armv8(uint32_t crc, uint8_t const *data, size_t size) {
+    while (size >= 8) {
+        uint64_t value;
+        memcpy(&value, data, sizeof(value));
+        crc = __crc32d(crc, value);
+        data += 8;
+        size -= 8;
+    }
+
+    while (size-- > 0) {
+        crc = __crc32b(crc, *(data++));
+    }
+
+    return crc;
+}
+
+#endif
+
+#if defined(PHYLUM_CRC32_PCLMUL)
+
+// Folding constants for the reflected CRC32 polynomial, see Intel's
+// "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ".
+alignas(16) static const uint64_t crc32_k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+alignas(16) static const uint64_t crc32_k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+alignas(16) static const uint64_t crc32_k5k0[] = { 0x0163cd6124, 0x0000000000 };
+alignas(16) static const uint64_t crc32_poly[] = { 0x01db710641, 0x01f7011641 };
+
+static constexpr size_t Crc32PclmulMinimum = 64;
+
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_pclmul(uint32_t crc, uint8_t const *data, size_t size) {
+    if (size < Crc32PclmulMinimum) {
+        return crc32_slicing8(crc, data, size);
+    }
+
+    auto x1 = _mm_loadu_si128((__m128i const *)(data + 0x00));
+    auto x2 = _mm_loadu_si128((__m128i const *)(data + 0x10));
+    auto x3 = _mm_loadu_si128((__m128i const *)(data + 0x20));
+    auto x4 = _mm_loadu_si128((__m128i const *)(data + 0x30));
+
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+
+    auto x0 = _mm_load_si128((__m128i const *)crc32_k1k2);
+
+    data += 64;
+    size -= 64;
+
+    // Fold 64 bytes at a time into four accumulators.
+    while (size >= 64) {
+        auto x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        auto x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        auto x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        auto x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+        auto y5 = _mm_loadu_si128((__m128i const *)(data + 0x00));
+        auto y6 = _mm_loadu_si128((__m128i const *)(data + 0x10));
+        auto y7 = _mm_loadu_si128((__m128i const *)(data + 0x20));
+        auto y8 = _mm_loadu_si128((__m128i const *)(data + 0x30));
+
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+        data += 64;
+        size -= 64;
+    }
+
+    // Fold the accumulators into one.
+    x0 = _mm_load_si128((__m128i const *)crc32_k3k4);
+
+    auto x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    while (size >= 16) {
+        x2 = _mm_loadu_si128((__m128i const *)data);
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+        data += 16;
+        size -= 16;
+    }
+
+    // Fold 128 bits down to 64.
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+
+    x0 = _mm_loadl_epi64((__m128i const *)crc32_k5k0);
+
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits.
+    x0 = _mm_load_si128((__m128i const *)crc32_poly);
+
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    crc = (uint32_t)_mm_extract_epi32(x1, 1);
+
+    return crc32_slicing8(crc, data, size);
+}
+
+static bool crc32_has_pclmul() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+}
+
+#endif
+
+bool crc32_supported(crc32_backend backend) {
+    switch (backend) {
+    case crc32_backend::Nibble:
+        return true;
+#if !defined(PHYLUM_CRC32_NIBBLE_ONLY)
+    case crc32_backend::Slicing8:
+        return true;
+#endif
+#if defined(PHYLUM_CRC32_ARMV8)
+    case crc32_backend::Armv8:
+        return true;
+#endif
+#if defined(PHYLUM_CRC32_PCLMUL)
+    case crc32_backend::Pclmul:
+        return crc32_has_pclmul();
+#endif
+    default:
+        return false;
+    }
+}
+
+crc32_backend crc32_selected() {
+#if defined(PHYLUM_CRC32_NIBBLE_ONLY)
+    return crc32_backend::Nibble;
+#elif defined(PHYLUM_CRC32_ARMV8)
+    return crc32_backend::Armv8;
+#elif defined(PHYLUM_CRC32_PCLMUL)
+    static auto selected = crc32_has_pclmul() ? crc32_backend::Pclmul : crc32_backend::Slicing8;
+    return selected;
+#else
+    return crc32_backend::Slicing8;
+#endif
+}
+
+static crc32_fn_t crc32_function(crc32_backend backend) {
+    switch (backend) {
+#if !defined(PHYLUM_CRC32_NIBBLE_ONLY)
+    case crc32_backend::Slicing8:
+        return crc32_slicing8;
+#endif
+#if defined(PHYLUM_CRC32_ARMV8)
+    case crc32_backend::Armv8:
+        return crc32_armv8;
+#endif
+#if defined(PHYLUM_CRC32_PCLMUL)
+    case crc32_backend::Pclmul:
+        return crc32_pclmul;
+#endif
+    default:
+        return crc32_nibble;
+    }
+}
+
+uint32_t crc32_checksum(crc32_backend backend, uint32_t previous, uint8_t const *data, size_t size) {
+    assert(crc32_supported(backend));
+    return ~crc32_function(backend)(~previous, data, size);
+}
+
+uint32_t crc32_checksum(uint32_t previous, uint8_t const *data, size_t size) {
+    static auto fn = crc32_function(crc32_selected());
+    return ~fn(~previous, data, size);
 }
 
 uint32_t crc32_checksum(uint8_t const *data, size_t size) {
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "phylum.h"
+
+namespace phylum {
+
+/**
+ * Ways of calculating the same CRC32. Small targets only get the
+ * nibble table, others get slicing-by-8 and whichever of the hardware
+ * backends the compiler and CPU support, picked on first use.
+ */
+enum class crc32_backend : uint8_t {
+    Nibble,
+    Slicing8,
+    Armv8,
+    Pclmul,
+};
+
+bool crc32_supported(crc32_backend backend);
+
+crc32_backend crc32_selected();
+
+/**
+ * Checksums with the given backend, which has to be supported. Meant
+ * for testing and benchmarking, crc32_checksum picks the fastest.
+ */
+uint32_t crc32_checksum(crc32_backend backend, uint32_t previous, uint8_t const *data, size_t size);
+
+} // namespace phylum
@@ -1,17 +1,58 @@
 #include "data_chain.h"
+#include "lz_block.h"
 #include "phylum.h"
 
 namespace phylum {
 
+/**
+ * Compressed sectors hold a series of blocks, each is the uncompressed
+ * size, the stored size and the stored bytes. Blocks stored as is have
+ * both sizes equal. New blocks aren't started with less room than this,
+ * the sector is grown instead.
+ */
+static constexpr size_t CompressedBlockMinimum = 32;
+
+static int32_t block_header(uint8_t const *ptr, size_t size, uint32_t &uncompressed, uint32_t &stored) {
+    auto first = varint_decode32(ptr, size, &uncompressed);
+    if (first < 0) {
+        return -1;
+    }
+
+    auto second = varint_decode32(ptr + first, size - first, &stored);
+    if (second < 0) {
+        return -1;
+    }
+
+    if (stored > uncompressed || stored > size - first - second) {
+        return -1;
+    }
+
+    return first + second;
+}
+
 int32_t data_chain::write_header(page_lock &lock) {
     assert_valid();
 
     db().clear();
 
-    db().emplace<data_chain_header_t>();
+    auto flags = (int32_t)sector_flags::None;
+    if (compress_) {
+        flags |= (int32_t)sector_flags::Compressed;
+    }
+
+    if (checksum_) {
+        flags |= (int32_t)sector_flags::Checksummed;
+        db().emplace<data_chain_checksummed_header_t>((sector_flags)flags);
+    } else {
+        db().emplace<data_chain_header_t>((uint16_t)0, InvalidSector, InvalidSector, (sector_flags)flags);
+    }
 
     db().terminate();
 
+    verified_ = InvalidSector;
+    block_size_ = 0;
+    block_position_ = 0;
+
     lock.dirty();
     appendable(true);
 
@@ -26,6 +67,18 @@ int32_t data_chain::seek_sector(dhara_sector_t new_sector, file_size_t position_
 
     sector(new_sector);
 
+    // Paging in the sector leaves the previous sector's position.
+    if (new_sector != InvalidSector) {
+        auto lock = db().reading(new_sector);
+        auto err = load(lock);
+        if (err < 0) {
+            return err;
+        }
+    }
+
+    block_size_ = 0;
+    block_position_ = 0;
+
     position_ = position_at_start_of_sector;
     position_at_start_of_sector_ = position_at_start_of_sector;
     auto skipping = desired_position == UINT32_MAX ? desired_position : desired_position - position_;
@@ -209,7 +262,33 @@ file_size_t data_chain::total_bytes() {
 
     auto bytes = 0u;
     do {
-        bytes += db().header<data_chain_header_t>()->bytes;
+        if (!compressed()) {
+            bytes += db().header<data_chain_header_t>()->bytes;
+            continue;
+        }
+
+        auto err = constrain();
+        if (err < 0) {
+            return err;
+        }
+
+        auto hdr = db().header<data_chain_header_t>();
+        auto buffer = db().to_read_buffer();
+        auto ptr = buffer.ptr() + buffer.size() - hdr->bytes;
+        auto remaining = (size_t)hdr->bytes;
+        while (remaining > 0) {
+            uint32_t uncompressed = 0;
+            uint32_t stored = 0;
+            auto header = block_header(ptr, remaining, uncompressed, stored);
+            if (header < 0) {
+                phyerrorf("total-bytes: bad block sector=%d", sector());
+                return header;
+            }
+
+            bytes += uncompressed;
+            ptr += header + stored;
+            remaining -= header + stored;
+        }
     } while (forward(lock) > 0);
 
     phyverbosef("done (%d)", bytes);
@@ -263,29 +342,51 @@ int32_t data_chain::write_chain(page_lock &lock, io_reader &reader) {
         phyverbosef("write: position=%zu available=%zu size=%zu", db().position(), db().available(), db().size());
 
         auto grow = false;
+        auto compressing = compressed();
+        auto checksumming = checksummed();
         auto err = db().write_view([&](write_buffer wb) {
-            auto bytes_read = reader.read(wb.cursor(), wb.available());
-            if (bytes_read < 0) {
-                return bytes_read;
+            auto bytes_read = 0;
+            auto bytes_committed = 0;
+            auto bytes_stored = 0;
+            if (compressing) {
+                bytes_stored = write_block(wb, reader, bytes_read, bytes_committed);
+                if (bytes_stored < 0) {
+                    return bytes_stored;
+                }
+            } else {
+                bytes_read = reader.read(wb.cursor(), wb.available());
+                if (bytes_read < 0) {
+                    return bytes_read;
+                }
+                bytes_committed = bytes_read;
+                bytes_stored = bytes_read;
             }
 
             // Do this before we grow so the details are saved.
             auto err = db().write_header<data_chain_header_t>([&](data_chain_header_t *header) {
-                assert(header->bytes + bytes_read <= (int32_t)sector_size());
-                header->bytes += bytes_read;
+                assert(header->bytes + bytes_stored <= (int32_t)sector_size());
+                header->bytes += bytes_stored;
+                if (checksumming) {
+                    auto checksummed = (data_chain_checksummed_header_t *)header;
+                    checksummed->crc = crc32_checksum(checksummed->crc, wb.cursor(), bytes_stored);
+                }
                 return 0;
             });
             assert(err == 0);
 
             written += bytes_read;
-            position_ += bytes_read;
+            position_ += bytes_committed;
 
-            db().skip(bytes_read); // TODO Remove
+            db().skip(bytes_stored); // TODO Remove
 
-            if ((int32_t)wb.available() == bytes_read) {
+            if (compressing) {
+                if (wb.available() - bytes_stored < CompressedBlockMinimum) {
+                    grow = true;
+                }
+            } else if ((int32_t)wb.available() == bytes_read) {
                 grow = true;
             }
-            return bytes_read;
+            return bytes_stored;
         });
         if (err < 0) {
             return err;
@@ -319,13 +420,134 @@ int32_t data_chain::write_chain(page_lock &lock, io_reader &reader) {
     return written;
 }
 
+bool data_chain::compressed() {
+    auto hdr = db().header<data_chain_header_t>();
+    return ((int32_t)hdr->flags & (int32_t)sector_flags::Compressed) > 0;
+}
+
+bool data_chain::checksummed() {
+    auto hdr = db().header<data_chain_header_t>();
+    return ((int32_t)hdr->flags & (int32_t)sector_flags::Checksummed) > 0;
+}
+
+simple_buffer &data_chain::scratch() {
+    if (!scratch_.valid()) {
+        scratch_ = buffers().allocate(sectors()->sector_size());
+    }
+    return scratch_;
+}
+
+int32_t data_chain::write_block(write_buffer &wb, io_reader &reader, int32_t &consumed, int32_t &committed) {
+    consumed = 0;
+    committed = 0;
+
+    auto available = wb.available();
+    if (available < CompressedBlockMinimum) {
+        return 0;
+    }
+
+    // Any decompressed block is lost, we're reusing the buffer.
+    block_size_ = 0;
+    block_position_ = 0;
+
+    auto &raw = scratch();
+    if (pending_ < raw.size()) {
+        consumed = reader.read(raw.ptr() + pending_, raw.size() - pending_);
+        if (consumed < 0) {
+            return consumed;
+        }
+        pending_ += consumed;
+    }
+
+    if (pending_ == 0) {
+        return 0;
+    }
+
+    // Compress as much as will fit, the rest waits for the next
+    // block. Small enough blocks always fit stored as is.
+    auto taking = pending_;
+    auto reserved = 0u;
+    auto stored = -1;
+    while (true) {
+        reserved = 2 * varint_encoding_length32(taking);
+        auto room = available - reserved;
+        stored = lz_compress(raw.ptr(), taking, wb.cursor() + reserved, std::min<size_t>(room, taking - 1));
+        if (stored >= 0 || taking <= room) {
+            break;
+        }
+        taking /= 2;
+    }
+
+    auto block = wb.cursor() + reserved;
+    if (stored < 0) {
+        memcpy(block, raw.ptr(), taking);
+        stored = taking;
+    }
+
+    auto first = varint_encoding_length32(taking);
+    auto second = varint_encoding_length32(stored);
+    varint_encode(taking, wb.cursor(), first);
+    varint_encode(stored, wb.cursor() + first, second);
+    if (first + second < reserved) {
+        memmove(wb.cursor() + first + second, block, stored);
+    }
+
+    pending_ -= taking;
+    if (pending_ > 0) {
+        memmove(raw.ptr(), raw.ptr() + taking, pending_);
+    }
+
+    committed = taking;
+
+    phyverbosef("write-block: bytes=%d stored=%d pending=%zu", taking, stored, pending_);
+
+    return first + second + stored;
+}
+
+int32_t data_chain::read_block() {
+    auto buffer = db().to_read_buffer();
+
+    uint32_t uncompressed = 0;
+    uint32_t stored = 0;
+    auto header = block_header(buffer.cursor(), buffer.available(), uncompressed, stored);
+    if (header < 0 || uncompressed == 0) {
+        phyerrorf("read-block: bad block sector=%d position=%zu", sector(), db().position());
+        return -1;
+    }
+
+    auto &raw = scratch();
+    if (uncompressed > raw.size()) {
+        phyerrorf("read-block: too large sector=%d bytes=%d", sector(), uncompressed);
+        return -1;
+    }
+
+    auto block = buffer.cursor() + header;
+    if (stored == uncompressed) {
+        memcpy(raw.ptr(), block, stored);
+    } else if (lz_decompress(block, stored, raw.ptr(), uncompressed) != (int32_t)uncompressed) {
+        phyerrorf("read-block: decompress failed sector=%d bytes=%d stored=%d", sector(), uncompressed, stored);
+        return -1;
+    }
+
+    db().skip(header + stored);
+
+    block_size_ = uncompressed;
+    block_position_ = 0;
+
+    return uncompressed;
+}
+
 int32_t data_chain::constrain() {
     auto iter = db().begin();
     auto hdr = db().header<data_chain_header_t>();
     auto total = hdr->bytes + iter.position() + iter.size_of_record() + 1 /* Null terminator */;
     phyverbosef("constrain hdr-bytes=%d + hdr-pos=%d + hdr->size=%d + 1 <null> = total=%d", hdr->bytes, iter.position(),
                 iter.size_of_record(), total);
-    assert(db().constrain(total) >= 0);
+    auto err = db().constrain(total);
+    if (err < 0) {
+        phyerrorf("constrain: bad sector bytes=%d total=%d", hdr->bytes, total);
+        return err;
+    }
 
     /**
      * Due to a bug somewhere, if the sector is empty, then the
@@ -334,7 +556,7 @@ int32_t data_chain::constrain() {
      * position should never be before the minimum position and will
      * hold us over until I can find the real off by one issue.
      */
-    auto minimum = 2 + sizeof(data_chain_header_t) + 1;
+    auto minimum = 2 + (checksummed() ? sizeof(data_chain_checksummed_header_t) : sizeof(data_chain_header_t)) + 1;
     if (db().position() < minimum) {
         phyverbosef("constraining to minimum position=%d", minimum);
         db().position(minimum);
@@ -342,6 +564,25 @@ int32_t data_chain::constrain() {
     return 0;
 }
 
+int32_t data_chain::verify() {
+    if (!verify_ || verified_ == sector() || !checksummed()) {
+        return 0;
+    }
+
+    // Buffer is constrained to the end of the payload.
+    auto hdr = db().header<data_chain_checksummed_header_t>();
+    auto buffer = db().to_read_buffer();
+    auto crc = crc32_checksum((uint32_t)0, buffer.ptr() + buffer.size() - hdr->bytes, hdr->bytes);
+    if (crc != hdr->crc) {
+        phyerrorf("verify: sector=%d bytes=%d crc=0x%x expected=0x%x", sector(), hdr->bytes, crc, hdr->crc);
+        return -1;
+    }
+
+    verified_ = sector();
+
+    return 0;
+}
+
 int32_t data_chain::read_chain(io_writer &writer) {
     assert_valid();
 
@@ -353,7 +594,15 @@ int32_t data_chain::read_chain(io_writer &writer) {
         return err;
     }
 
-    assert(constrain() >= 0);
+    err = constrain();
+    if (err < 0) {
+        return err;
+    }
+
+    err = verify();
+    if (err < 0) {
+        return err;
+    }
 
     auto nread_this_call = 0u;
 
@@ -368,11 +617,43 @@ int32_t data_chain::read_chain(io_writer &writer) {
                 return err;
             }
 
-            assert(constrain() >= 0);
+            err = constrain();
+            if (err < 0) {
+                return err;
+            }
+
+            err = verify();
+            if (err < 0) {
+                return err;
+            }
+
+            block_size_ = 0;
+            block_position_ = 0;
 
             phyverbosef("read resuming position=%d available=%d", db().position(), db().available());
         }
 
+        // Hand out what's left of the last decompressed block.
+        if (block_position_ < block_size_) {
+            auto err = writer.write(scratch_.ptr() + block_position_, block_size_ - block_position_);
+            if (err < 0) {
+                phyerrorf("read-chain: write fail (%d bytes-read-this-call) (%d)", nread_this_call, err);
+                return err;
+            }
+
+            block_position_ += err;
+            position_ += err;
+            return err;
+        }
+
+        if (db().available() > 0 && compressed()) {
+            auto err = read_block();
+            if (err < 0) {
+                return err;
+            }
+            continue;
+        }
+
         // If we have data available.
         if (db().available() > 0) {
             auto read_buffer = db().to_read_buffer();
@@ -34,6 +34,14 @@ private:
     head_tail_t chain_{ };
     file_size_t position_{ 0 };
     file_size_t position_at_start_of_sector_{ 0 };
+    bool checksum_{ false };
+    bool verify_{ true };
+    dhara_sector_t verified_{ InvalidSector };
+    bool compress_{ false };
+    simple_buffer scratch_;
+    size_t block_size_{ 0 };
+    size_t block_position_{ 0 };
+    size_t pending_{ 0 };
 
 public:
     data_chain(phyctx pc, head_tail_t chain, const char *prefix = "dc")
@@ -55,6 +63,30 @@ public:
 
     using sector_chain::truncate;
 
+    /**
+     * Whether new sectors carry a CRC32 of their payload, which costs
+     * four bytes of each sector's header.
+     */
+    void checksum(bool enabled) {
+        checksum_ = enabled;
+    }
+
+    /**
+     * Whether checksummed sectors are checked against their CRC when
+     * first read from. Sectors without one are never checked.
+     */
+    void verify_checksums(bool enabled) {
+        verify_ = enabled;
+    }
+
+    /**
+     * Whether new sectors are written compressed. Readers check each
+     * sector's flags, so chains can mix both kinds.
+     */
+    void compress(bool enabled) {
+        compress_ = enabled;
+    }
+
 public:
     data_chain_cursor cursor() const {
         if (sector() == InvalidSector) {
@@ -76,6 +108,18 @@ protected:
 
     int32_t constrain();
 
+    int32_t verify();
+
+    bool compressed();
+
+    bool checksummed();
+
+    int32_t write_block(write_buffer &wb, io_reader &reader, int32_t &consumed, int32_t &committed);
+
+    int32_t read_block();
+
+    simple_buffer &scratch();
+
 };
 
 } // namespace phylum
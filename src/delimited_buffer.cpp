@@ -8,7 +8,7 @@ void *delimited_buffer::reserve(size_t length, sector_offset_t &start_position)
     // If this is our first record, write the offset value first.
     if (buffer_.position() == 0) {
         auto offset = 0u;
-        auto needed = varint_encoding_length(offset);
+        auto needed = varint_encoding_length32(offset);
         auto p = buffer_.take(needed);
         if (*p != 0xff) {
             phydebug_dump_memory("overwrite ", p, needed);
@@ -18,7 +18,7 @@ void *delimited_buffer::reserve(size_t length, sector_offset_t &start_position)
     }
 
     // Verify enough room for the record and its prefix.
-    auto delimiter_overhead = varint_encoding_length(length);
+    auto delimiter_overhead = varint_encoding_length32(length);
 
     // Encode the length before the record.
     auto position_before = buffer_.position();
@@ -11,6 +11,7 @@ struct record_ptr {
 private:
     read_buffer buffer_;
     size_t size_of_record_{ 0 };
+    size_t size_overhead_{ 0 };
 
 public:
     size_t position() const {
@@ -26,30 +27,28 @@ public:
     }
 
     size_t start_of_record() const {
-        auto size_overhead = varint_encoding_length(size_of_record_);
-        return buffer_.position() + size_overhead;
+        return buffer_.position() + size_overhead_;
     }
 
 public:
     record_ptr() {
     }
 
-    record_ptr(read_buffer buffer, size_t size_of_record) : buffer_(std::move(buffer)), size_of_record_(size_of_record) {
+    record_ptr(read_buffer buffer, size_t size_of_record, size_t size_overhead)
+        : buffer_(std::move(buffer)), size_of_record_(size_of_record), size_overhead_(size_overhead) {
     }
 
 public:
     template <typename DataType, typename T>
     int32_t read_data(T fn) const {
-        auto size_overhead = varint_encoding_length(size_of_record_);
-        read_buffer data_buffer{ buffer_.cursor() + sizeof(DataType) + size_overhead,
-                                 size_of_record() - sizeof(DataType) - size_overhead };
+        read_buffer data_buffer{ buffer_.cursor() + sizeof(DataType) + size_overhead_,
+                                 size_of_record() - sizeof(DataType) - size_overhead_ };
         return fn(std::move(data_buffer));
     }
 
     template <typename TRecord>
     TRecord const *as() {
-        auto size_overhead = varint_encoding_length(size_of_record_);
-        return reinterpret_cast<TRecord const *>(buffer_.cursor() + size_overhead);
+        return reinterpret_cast<TRecord const *>(buffer_.cursor() + size_overhead_);
     }
 
 };
@@ -131,6 +130,19 @@ public:
         return appended_record<T>{ start_position, ptr };
     }
 
+    /**
+     * Reserves only the leading size bytes of a T, zeroed and left
+     * unconstructed, for records whose tail is never used.
+     */
+    template <typename T>
+    appended_record<T> reserve(size_t size) {
+        assert(size <= sizeof(T));
+        sector_offset_t start_position{ 0 };
+        auto alloc = reserve(size, start_position);
+        bzero(alloc, size);
+        return appended_record<T>{ start_position, reinterpret_cast<T *>(alloc) };
+    }
+
     /**
      * This reserves 0 bytes, which ends up inserting a 0 byte length
      * and that acts a NULL terminator.
@@ -148,7 +160,7 @@ public:
     }
 
     bool room_for(size_t length) {
-        return buffer_.room_for(varint_encoding_length(length) + length);
+        return buffer_.room_for(varint_encoding_length32(length) + length);
     }
 
     template <typename T>
@@ -300,6 +312,7 @@ public:
     private:
         read_buffer buffer_;
         int32_t record_size_{ -1 };
+        uint8_t delimiter_size_{ 0 };
 
     public:
         size_t position() {
@@ -328,6 +341,7 @@ public:
         bool read() {
             assert(buffer_.valid());
 
+            auto position_before_delimiter = buffer_.position();
             uint32_t maybe_record_length = 0u;
             if (!buffer_.try_read(maybe_record_length)) {
                 record_size_ = -1;
@@ -335,6 +349,7 @@ public:
             }
 
             record_size_ = maybe_record_length;
+            delimiter_size_ = buffer_.position() - position_before_delimiter;
             return true;
         }
 
@@ -368,12 +383,12 @@ public:
         }
 
         record_ptr operator*() {
-            auto delimiter_overhead = varint_encoding_length(record_size_);
+            auto delimiter_overhead = delimiter_size_;
             auto position_after_delimiter = buffer_.position();
             auto position_before_delimiter = position_after_delimiter - delimiter_overhead;
             auto position_end_of_record = position_after_delimiter + record_size_;
             read_buffer record_buffer( buffer_.ptr(), position_end_of_record, position_before_delimiter);
-            return record_ptr{ std::move(record_buffer), (size_t)record_size_ };
+            return record_ptr{ std::move(record_buffer), (size_t)record_size_, delimiter_overhead };
         }
     };
 
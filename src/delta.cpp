@@ -0,0 +1,277 @@
+#include "delta.h"
+#include "varint.h"
+
+namespace phylum {
+
+enum delta_kind : uint8_t {
+    DeltaKeyframe = 0,
+    DeltaRecord = 1,
+};
+
+// Unchanged runs shorter than this are cheaper to carry along in the
+// changed run than to give their own pair of sizes.
+static constexpr size_t DeltaMinimumRun = 3;
+
+delta_writer::delta_writer(io_writer *target, write_buffer &previous, write_buffer &encoded)
+    : target_(target), previous_(previous), encoded_(encoded) {
+}
+
+/**
+ * Records beyond the end of the previous one are XOR'd against zeros.
+ * Returns -1 if the delta wouldn't be smaller than a keyframe.
+ */
+int32_t delta_writer::encode_delta(uint8_t const *data, size_t size) {
+    auto prior = previous_.ptr();
+    auto prior_size = previous_.position();
+    auto byte_at = [&](size_t i) -> uint8_t { return i < prior_size ? prior[i] : 0; };
+
+    auto encoded = encoded_.ptr();
+    auto limit = std::min<size_t>(encoded_.size(), size + 1);
+    auto p = (size_t)0;
+
+    encoded[p++] = DeltaRecord;
+    auto size_length = varint_encoding_length32(size);
+    if (p + size_length >= limit) {
+        return -1;
+    }
+    varint_encode(size, encoded + p, size_length);
+    p += size_length;
+
+    auto i = (size_t)0;
+    while (i < size) {
+        auto unchanged_start = i;
+        while (i < size && data[i] == byte_at(i)) {
+            i++;
+        }
+        auto unchanged = i - unchanged_start;
+
+        // Unchanged tails are left out, readers keep the previous bytes.
+        if (i == size) {
+            break;
+        }
+
+        auto changed_start = i;
+        while (i < size) {
+            if (data[i] != byte_at(i)) {
+                i++;
+                continue;
+            }
+            auto j = i;
+            while (j < size && data[j] == byte_at(j) && j - i < DeltaMinimumRun) {
+                j++;
+            }
+            if (j == size || j - i >= DeltaMinimumRun) {
+                break;
+            }
+            i = j;
+        }
+        auto changed = i - changed_start;
+
+        auto unchanged_length = varint_encoding_length32(unchanged);
+        auto changed_length = varint_encoding_length32(changed);
+        if (p + unchanged_length + changed_length + changed >= limit) {
+            return -1;
+        }
+
+        varint_encode(unchanged, encoded + p, unchanged_length);
+        p += unchanged_length;
+        varint_encode(changed, encoded + p, changed_length);
+        p += changed_length;
+
+        for (auto k = changed_start; k < i; ++k) {
+            encoded[p++] = data[k] ^ byte_at(k);
+        }
+    }
+
+    return p;
+}
+
+int32_t delta_writer::write(uint8_t const *data, size_t size) {
+    assert(data != nullptr);
+
+    if (size > previous_.size() || size + 1 > encoded_.size()) {
+        phyerrorf("delta: record too large (%zu)", size);
+        return -1;
+    }
+
+    auto length = keyframe_ ? -1 : encode_delta(data, size);
+    if (length < 0) {
+        encoded_.ptr()[0] = DeltaKeyframe;
+        memcpy(encoded_.ptr() + 1, data, size);
+        length = size + 1;
+    }
+
+    uint8_t delimiter[5];
+    auto delimiter_length = (int32_t)varint_encoding_length32(length);
+    varint_encode(length, delimiter, sizeof(delimiter));
+
+    auto err = target_->write(delimiter, delimiter_length);
+    if (err != delimiter_length) {
+        phyerrorf("delta: writing delimiter");
+        return -1;
+    }
+
+    err = target_->write(encoded_.ptr(), length);
+    if (err != length) {
+        phyerrorf("delta: writing record (%d)", length);
+        return -1;
+    }
+
+    memcpy(previous_.ptr(), data, size);
+    previous_.position(size);
+    keyframe_ = false;
+
+    return delimiter_length + length;
+}
+
+delta_reader::delta_reader(io_reader *target, write_buffer &previous, write_buffer &encoded)
+    : target_(target), previous_(previous), encoded_(encoded) {
+}
+
+/**
+ * Decodes the next record into the previous buffer, returning its size
+ * or 0 at the end.
+ */
+int32_t delta_reader::read_record() {
+    // Byte at a time so we never read past the delimiter.
+    varint_decoder decoder;
+    while (!decoder.done()) {
+        uint8_t byte;
+        auto err = target_->read(&byte, 1);
+        if (err < 0) {
+            return err;
+        }
+        if (err == 0) {
+            if (decoder.bytes_read() > 0) {
+                phyerrorf("delta: truncated delimiter");
+                return -1;
+            }
+            return 0;
+        }
+        if (decoder.write(&byte, 1) < 0) {
+            phyerrorf("delta: bad delimiter");
+            return -1;
+        }
+    }
+
+    auto length = (size_t)decoder.value();
+    if (length == 0 || length > encoded_.size()) {
+        phyerrorf("delta: bad record length (%zu)", length);
+        return -1;
+    }
+
+    auto encoded = encoded_.ptr();
+    for (auto nread = (size_t)0; nread < length;) {
+        auto err = target_->read(encoded + nread, length - nread);
+        if (err < 0) {
+            return err;
+        }
+        if (err == 0) {
+            phyerrorf("delta: truncated record");
+            return -1;
+        }
+        nread += err;
+    }
+
+    auto prior = previous_.ptr();
+
+    if (encoded[0] == DeltaKeyframe) {
+        auto size = length - 1;
+        if (size > previous_.size()) {
+            phyerrorf("delta: record too large (%zu)", size);
+            return -1;
+        }
+
+        memcpy(prior, encoded + 1, size);
+        previous_.position(size);
+        valid_ = true;
+
+        return size;
+    }
+
+    if (encoded[0] != DeltaRecord) {
+        phyerrorf("delta: unknown kind (%d)", encoded[0]);
+        return -1;
+    }
+
+    if (!valid_) {
+        phyerrorf("delta: record before keyframe");
+        return -1;
+    }
+
+    uint32_t size = 0;
+    auto p = (size_t)1;
+    auto nread = varint_decode32(encoded + p, length - p, &size);
+    if (nread < 0 || size > previous_.size()) {
+        phyerrorf("delta: bad record size");
+        return -1;
+    }
+    p += nread;
+
+    if (size > previous_.position()) {
+        memset(prior + previous_.position(), 0, size - previous_.position());
+    }
+
+    auto i = (size_t)0;
+    while (p < length) {
+        uint32_t unchanged = 0;
+        uint32_t changed = 0;
+        auto first = varint_decode32(encoded + p, length - p, &unchanged);
+        if (first < 0) {
+            phyerrorf("delta: bad run");
+            return -1;
+        }
+        p += first;
+
+        auto second = varint_decode32(encoded + p, length - p, &changed);
+        if (second < 0 || i + unchanged + changed > size || p + second + changed > length) {
+            phyerrorf("delta: bad run");
+            return -1;
+        }
+        p += second;
+
+        i += unchanged;
+        for (auto k = 0u; k < changed; ++k) {
+            prior[i++] ^= encoded[p++];
+        }
+    }
+
+    previous_.position(size);
+
+    return size;
+}
+
+int32_t delta_reader::read(uint8_t *data, size_t size) {
+    auto err = read_record();
+    if (err <= 0) {
+        return err;
+    }
+
+    if ((size_t)err > size) {
+        phyerrorf("delta: record larger than buffer (%d > %zu)", err, size);
+        return -1;
+    }
+
+    if (data != nullptr) {
+        memcpy(data, previous_.ptr(), err);
+    }
+
+    return err;
+}
+
+int32_t delta_reader::skip(uint32_t records) {
+    auto skipped = 0u;
+    while (skipped < records) {
+        auto err = read_record();
+        if (err < 0) {
+            return err;
+        }
+        if (err == 0) {
+            break;
+        }
+        skipped++;
+    }
+    return skipped;
+}
+
+} // namespace phylum
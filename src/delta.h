@@ -0,0 +1,70 @@
+#pragma once
+
+#include "writer.h"
+#include "reader.h"
+#include "simple_buffer.h"
+
+namespace phylum {
+
+/**
+ * Writes each record as a delimited frame holding either the record (a
+ * keyframe) or the runs of bytes that changed since the previous record,
+ * XOR'd against it. Call keyframe() whenever the appender indexes so
+ * every indexed record decodes on its own, which is what seeking needs.
+ * The previous buffer has to fit the largest record, encoded one byte
+ * more than that.
+ */
+class delta_writer : public io_writer {
+private:
+    io_writer *target_{ nullptr };
+    write_buffer &previous_;
+    write_buffer &encoded_;
+    bool keyframe_{ true };
+
+public:
+    delta_writer(io_writer *target, write_buffer &previous, write_buffer &encoded);
+
+public:
+    void keyframe() {
+        keyframe_ = true;
+    }
+
+    /**
+     * Writes one record, returning the number of bytes given to the
+     * target, delimiter included.
+     */
+    int32_t write(uint8_t const *data, size_t size) override;
+
+private:
+    int32_t encode_delta(uint8_t const *data, size_t size);
+
+};
+
+class delta_reader : public io_reader {
+private:
+    io_reader *target_{ nullptr };
+    write_buffer &previous_;
+    write_buffer &encoded_;
+    bool valid_{ false };
+
+public:
+    delta_reader(io_reader *target, write_buffer &previous, write_buffer &encoded);
+
+public:
+    /**
+     * Reads one record, returning its size or 0 at the end.
+     */
+    int32_t read(uint8_t *data, size_t size) override;
+
+    /**
+     * Decodes and drops records, for catching up after seeking to the
+     * keyframe before the desired record.
+     */
+    int32_t skip(uint32_t records);
+
+private:
+    int32_t read_record();
+
+};
+
+} // namespace phylum
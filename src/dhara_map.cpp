@@ -1,5 +1,6 @@
 #include "dhara_map.h"
 #include "working_buffers.h"
+#include "trace.h"
 
 namespace phylum {
 
@@ -107,6 +108,8 @@ dhara_sector_t dhara_sector_map::size() {
 int32_t dhara_sector_map::write(dhara_sector_t sector, uint8_t const *data, size_t size) {
     phydebugf("dhara-write sector=%" PRIu32 " size=%" PRIu32, sector, size);
 
+    trace_event(trace_kind::SectorWrite, sector);
+
     assert(page_size_ > 0);
     assert(size == page_size_);
 
@@ -149,6 +152,8 @@ int32_t dhara_sector_map::find(dhara_sector_t sector, dhara_page_t *page) {
 int32_t dhara_sector_map::trim(dhara_sector_t sector) {
     phydebugf("dhara-trim sector=%" PRIu32 "", sector);
 
+    trace_event(trace_kind::SectorTrim, sector);
+
     assert(page_size_ > 0);
 
     dhara_error_t derr;
@@ -169,7 +174,11 @@ int32_t dhara_sector_map::read(dhara_sector_t sector, uint8_t *data, size_t size
 
     dhara_error_t derr;
     dhara_page_t page = 0;
-    if (!page_cache_->get(sector, &page)) {
+    auto cached = page_cache_->get(sector, &page);
+
+    trace_event(trace_kind::SectorRead, sector, (uint8_t)(cached ? trace_flags::Hit : trace_flags::None));
+
+    if (!cached) {
         auto err = dhara_map_find(&dmap_, sector, &page, &derr);
         if (err < 0) {
             phywarnf("cache-find");
@@ -232,6 +241,11 @@ int dhara_sector_map::dhara_erase(const struct dhara_nand */*n*/, dhara_block_t
         return -1;
     }
 
+    // Garbage collection moves live sectors out of the block before
+    // erasing it, so any pages we remember there are stale.
+    auto pages_per_block = block_size_ / page_size_;
+    page_cache_->invalidate(b * pages_per_block, pages_per_block);
+
     if (err != nullptr) {
         *err = DHARA_E_NONE;
     }
@@ -18,9 +18,21 @@ struct open_file_attribute {
     }
 };
 
+/**
+ * Opening a file with an attribute of this type, sized for a
+ * file_hash_t, makes file_appender checksum everything written.
+ */
+constexpr uint8_t FileHashAttribute = 0xfe;
+
 enum class open_file_flags {
     None = 0,
     Truncate = 1,
+    // New data sectors are compressed, readers need nothing special.
+    Compressed = 2,
+    // New data sectors carry a CRC32 of their payload, see data_chain.
+    Checksummed = 4,
+    // Readers don't check checksummed sectors against their CRC.
+    Unverified = 8,
 };
 
 struct open_file_config {
@@ -33,6 +45,8 @@ struct open_file_config {
 };
 
 struct found_file {
+    // Handle for the file that's open, derived from its name without the
+    // directories above it, so two directories may hold files sharing it.
     file_id_t id{ UINT32_MAX };
     file_size_t directory_size{ UINT32_MAX };
     file_size_t directory_capacity{ UINT32_MAX };
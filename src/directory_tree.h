@@ -8,34 +8,155 @@
 #include "data_chain.h"
 #include "tree_attribute_storage.h"
 #include "flat_attribute_storage.h"
+#include "trace.h"
 
 namespace phylum {
 
-class directory_tree : public directory {
+/**
+ * One entry of a directory listing, taken straight from the directory
+ * tree so the file's attributes themselves are never loaded.
+ */
+struct directory_entry {
+    // Derived from the name alone, so only unique within a directory.
+    file_id_t id{ UINT32_MAX };
+    entry_type type{ entry_type::None };
+    char name[MaximumNameLength];
+    file_size_t directory_size{ 0 };
+    head_tail_t chain;
+    tree_ptr_t attributes;
+    tree_ptr_t position_index;
+    tree_ptr_t record_index;
+};
+
+/**
+ * Directory kept in a tree_sector, keyed by a hash of each file's name.
+ * Paths separated by '/' name files in subdirectories, each of which
+ * is a tree_sector of its own rooted in its parent's dirtree_dir_t, so
+ * working in one directory never touches the others. Leading slashes
+ * are ignored, so "/data.bin" is "data.bin" in the root, and names can
+ * no longer contain a '/' as they could before directories, which is
+ * why SuperBlockVersion was bumped.
+ * InlineCapacity is how many bytes of a file are kept in its directory
+ * node before it's given a data chain, and is fixed when formatting,
+ * the super block records it so file_ops::mount refuses other values.
+ * Smaller capacities fit more entries in each directory sector, zero
+ * always gives files their own data chain. AttributeStorage is either
+ * flat_attribute_storage, a log of attributes in a data chain, or
+ * tree_attribute_storage, keyed by attribute type so reading one is a
+ * single lookup.
+ */
+template<size_t InlineCapacity, typename AttributeStorage = flat_attribute_storage>
+class basic_directory_tree : public directory {
 public:
-    static constexpr size_t DataCapacity = 128;
+    static constexpr size_t DataCapacity = InlineCapacity;
     using dir_node_type = dirtree_tree_value_t<DataCapacity>;
-    using dir_tree_type = tree_sector<uint32_t, dir_node_type, 4>;
-    using attribute_storage_type = flat_attribute_storage;
+    // Wide keys so colliding file ids don't alias, see file_key. Volumes
+    // keyed by 32-bit ids are refused by SuperBlockVersion.
+    using dir_key_type = uint64_t;
+    using dir_key = file_key<dir_key_type>;
+    using dir_tree_type = tree_sector<dir_key_type, dir_node_type, 4>;
+    using attribute_storage_type = AttributeStorage;
+    using cursor_type = typename dir_tree_type::cursor_t;
+
+    /**
+     * Entries touched while batching, held in RAM until the batch is
+     * committed so the directory tree is written once for all of them.
+     */
+    struct batch_type {
+        static constexpr size_t MaximumEntries = 8;
+        dir_key_type keys[MaximumEntries];
+        dir_node_type nodes[MaximumEntries];
+        size_t size{ 0 };
+    };
+
+    /**
+     * Position in the listing of one directory, see opendir.
+     */
+    struct directory_cursor {
+        tree_ptr_t tree;
+        cursor_type position;
+    };
+
+    static constexpr size_t MaximumDirectoryDepth = 4;
+
+    // Committing a batch copies a path for every entry and then one for
+    // each directory above them, all before the tree is published.
+    static_assert(batch_type::MaximumEntries + MaximumDirectoryDepth <= tree_journal::MaximumPaths,
+                  "journal too small for a batch");
 
 private:
+    /**
+     * Directories from the root to the one files are being found in,
+     * trees[0] is the root and is always tree_. Keeping the keys lets a
+     * subtree whose tree_ptr_t moved be saved back up the path.
+     */
+    struct directory_path_t {
+        tree_ptr_t trees[MaximumDirectoryDepth + 1];
+        dir_key_type keys[MaximumDirectoryDepth];
+        size_t depth{ 0 };
+    };
+
     working_buffers *buffers_{ nullptr };
     sector_map *sectors_{ nullptr };
     sector_allocator *allocator_{ nullptr };
     dir_tree_type tree_;
+    dir_tree_type dir_;
+    directory_path_t path_;
     tree_value_ptr_t file_node_ptr_;
+    dir_key_type key_{ 0 };
     found_file file_;
+    batch_type *batch_{ nullptr };
+    tree_journal journal_;
+
+    /**
+     * Sectors owned by an entry unlinked while copying on write, which
+     * the saved tree refers to until it's replaced.
+     */
+    struct unlinked_t {
+        head_tail_t chain;
+        tree_ptr_t attributes;
+        tree_ptr_t position_index;
+        tree_ptr_t record_index;
+        tree_ptr_t children;
+    };
+
+    static constexpr size_t MaximumUnlinked = 4;
+    unlinked_t unlinked_[MaximumUnlinked];
+    size_t nunlinked_{ 0 };
+
+    /**
+     * Recently found files, so reopening them skips the tree. Changes
+     * to a file refresh its entry, adding or removing nodes can move any
+     * of them and so clear the cache.
+     */
+    struct cached_entry_t {
+        dhara_sector_t tree{ InvalidSector };
+        dir_key_type key{ 0 };
+        uint32_t used{ 0 };
+        tree_value_ptr_t node_ptr;
+        file_size_t directory_size{ 0 };
+        head_tail_t chain;
+        tree_ptr_t attributes;
+        tree_ptr_t position_index;
+        tree_ptr_t record_index;
+    };
+
+    static constexpr size_t CacheSize = 8;
+    cached_entry_t cache_[CacheSize];
+    uint32_t cache_counter_{ 0 };
 
 public:
-    directory_tree(phyctx pc, tree_ptr_t tree)
-        : buffers_(&pc.buffers_), sectors_(&pc.sectors_), allocator_(&pc.allocator_), tree_(pc, tree, "dir-tree") {
+    basic_directory_tree(phyctx pc, tree_ptr_t tree)
+        : buffers_(&pc.buffers_), sectors_(&pc.sectors_), allocator_(&pc.allocator_), tree_(pc, tree, "dir-tree"),
+          dir_(pc, tree_ptr_t{}, "dir-tree") {
     }
 
-    directory_tree(phyctx pc, dhara_sector_t root)
-        : buffers_(&pc.buffers_), sectors_(&pc.sectors_), allocator_(&pc.allocator_), tree_(pc, tree_ptr_t{ root, root }, "dir-tree") {
+    basic_directory_tree(phyctx pc, dhara_sector_t root)
+        : buffers_(&pc.buffers_), sectors_(&pc.sectors_), allocator_(&pc.allocator_), tree_(pc, tree_ptr_t{ root, root }, "dir-tree"),
+          dir_(pc, tree_ptr_t{}, "dir-tree") {
     }
 
-    virtual ~directory_tree() {
+    virtual ~basic_directory_tree() {
     }
 
 public:
@@ -51,76 +172,139 @@ public:
         return tree_.log();
     }
 
-    int32_t touch(const char *name) override;
+    /**
+     * Writes changes to the directory as new tree nodes, leaving the
+     * tree the super block refers to untouched until it's updated.
+     */
+    void copy_on_write(bool enabled) {
+        tree_.copy_on_write(enabled ? &journal_ : nullptr);
+        dir_.copy_on_write(tree_.journal());
+    }
 
-    template<typename TreeType>
-    int32_t touch_indexed(const char *name, open_file_config file_cfg) {
-        auto id = make_file_id(name);
+    /**
+     * True when copying on write replaced nodes or unlinked entries
+     * whose sectors are waiting for release.
+     */
+    bool releasable() const {
+        return !journal_.empty() || nunlinked_ > 0;
+    }
 
-        dir_node_type node = {};
-        node.u.file = dirtree_file_t(name);
+    /**
+     * True when enough was copied on write that the tree should be
+     * published soon, even in the middle of a batch.
+     */
+    bool publishing_due() const {
+        return journal_.filling();
+    }
 
-        data_chain data_chain{ pc(), head_tail_t{} };
-        auto err = data_chain.create_if_necessary();
-        if (err < 0) {
-            return err;
-        }
+    /**
+     * Frees what copying on write replaced since the last release, call
+     * once the super block refers to the new tree. Emptied sectors and
+     * those owned by unlinked entries go to reclaimed, when given.
+     */
+    int32_t release(free_sectors_chain *reclaimed);
+
+    int32_t touch(const char *name) override;
 
-        node.u.file.directory_size = 0;
-        node.u.file.chain = data_chain.chain();
+    template<typename TreeType>
+    int32_t touch_indexed(const char *path, open_file_config file_cfg) {
+        trace_scope ts{ trace_operation::Touch };
 
-        auto position_index_sector = allocator_->allocate();
-        auto position_index_tree = tree_ptr_t{ position_index_sector };
-        TreeType position_index{ pc(), position_index_tree, "pos-idx" };
-        err = position_index.create();
+        char name[MaximumNameLength];
+        auto err = enter(path, name);
         if (err < 0) {
             return err;
         }
+        if (err == 0) {
+            phyerrorf("touch '%s' no directory", path);
+            return -1;
+        }
 
-        node.u.file.position_index = position_index_tree;
+        auto key = dir_key::make(name);
+        auto id = dir_key::id(key);
 
-        auto record_index_sector = allocator_->allocate();
-        auto record_index_tree = tree_ptr_t{ record_index_sector };
-        TreeType record_index{ pc(), record_index_tree, "rec-idx" };
-        err = record_index.create();
-        if (err < 0) {
-            return err;
-        }
+        // The data chain and index trees are left invalid until the file
+        // outgrows DataCapacity and is first indexed, small files never
+        // need either of them.
+        dir_node_type node = {};
+        node.u.file = dirtree_file_t(name);
 
-        node.u.file.record_index = record_index_tree;
+        if (file_cfg.nattrs > 0) {
+            attribute_storage_type attributes_storage{ pc() };
+            auto err = attributes_storage.update(node.u.file.attributes, id, file_cfg.attributes, file_cfg.nattrs);
+            if (err < 0) {
+                return err;
+            }
+        }
 
+        key_ = key;
         file_ = {};
         file_.id = id;
-        file_.chain = node.u.file.chain;
-        file_.position_index = node.u.file.position_index;
-        file_.record_index = node.u.file.record_index;
 
-        err = tree_.add(id, &node, &file_node_ptr_);
+        err = add_entry(key, node);
         if (err < 0) {
             return err;
         }
 
-        if (file_cfg.nattrs > 0) {
-            auto err = file_attributes(id, file_cfg.attributes, file_cfg.nattrs);
-            if (err < 0) {
-                return err;
-            }
-        }
-
-        alogf(LogLevels::INFO, "phylum",
-              "touch-indexed '%s' data-chain=%" PRIu32 " pos-idx=%" PRIu32 " rec-idx=%" PRIu32, name, data_chain.head(),
-              position_index_sector, record_index_sector);
+        alogf(LogLevels::INFO, "phylum", "touch-indexed '%s'", path);
 
         return 0;
     }
 
+    /**
+     * Queues touched files in the given batch rather than adding them to
+     * the tree one at a time. Batched files can't be found or opened
+     * until they're committed.
+     */
+    void begin_batch(batch_type &batch) {
+        batch.size = 0;
+        batch_ = &batch;
+    }
+
+    /**
+     * Adds the batched entries to the tree in key order and ends the
+     * batch.
+     */
+    int32_t commit();
+
+    /**
+     * Creates the directory at path, whose parent has to exist already.
+     * Returns 0 if it was created or is already there.
+     */
+    int32_t mkdir(const char *path);
 
     int32_t unlink(const char *name) override;
 
+    /**
+     * Removes the file's node from the tree. When given a free sectors
+     * chain, tree sectors left empty and the sectors the entry owned
+     * (data chain, attributes, indices or children) are moved to it.
+     * Directories are only removed once they're empty.
+     */
+    int32_t unlink(const char *name, free_sectors_chain *reclaimed);
+
     int32_t find(const char *name, open_file_config file_cfg) override;
 
     found_file open() override;
 
+    /**
+     * Reads the entry after the cursor, skipping deleted ones. Returns 1
+     * while there are entries and 0 at the end of the directory.
+     */
+    int32_t readdir(cursor_type &cursor, directory_entry &entry);
+
+    /**
+     * Starts listing the directory at path, returns 0 if there's no
+     * such directory. Files found or opened since don't affect cursor.
+     */
+    int32_t opendir(const char *path, directory_cursor &cursor);
+
+    /**
+     * Reads the entry after the cursor in the directory it was opened
+     * on, like readdir for the root.
+     */
+    int32_t readdir(directory_cursor &cursor, directory_entry &entry);
+
     tree_ptr_t to_tree_ptr() const {
         return tree_.to_tree_ptr();
     }
@@ -137,6 +321,50 @@ protected:
     int32_t read(file_id_t id, io_writer &writer) override;
 
 private:
+    dir_tree_type &current() {
+        return path_.depth == 0 ? tree_ : dir_;
+    }
+
+    /**
+     * Walks the directories in path, leaving their trees in resolved and
+     * the last component in name. Returns 0 if one of them is missing.
+     */
+    int32_t resolve(const char *path, directory_path_t &resolved, char (&name)[MaximumNameLength]);
+
+    /**
+     * Resolves path and makes its directory the current one, committing
+     * any batched entries for the previous one.
+     */
+    int32_t enter(const char *path, char (&name)[MaximumNameLength]);
+
+    /**
+     * Finds the directory called name in the last directory of path,
+     * returns 0 if there isn't one.
+     */
+    int32_t find_directory(directory_path_t const &path, const char *name, tree_ptr_t &children);
+
+    /**
+     * Saves the current directory's tree_ptr_t in its parent's entry,
+     * and so on up to the root, after adding nodes or copying on write
+     * moved it.
+     */
+    int32_t update_parents();
+
+    int32_t readdir(dir_tree_type &tree, cursor_type &cursor, directory_entry &entry);
+
+    int32_t add_entry(dir_key_type key, dir_node_type &node);
+
+    int32_t flush_batch();
+
+    int32_t reclaim(free_sectors_chain &reclaimed, head_tail_t chain, tree_ptr_t attributes, tree_ptr_t position_index,
+                    tree_ptr_t record_index, tree_ptr_t children);
+
+    cached_entry_t *cache_find(dir_key_type key);
+
+    cached_entry_t *cache_put(dir_key_type key, tree_value_ptr_t node_ptr, dirtree_file_t const &file);
+
+    void cache_clear();
+
     phyctx pc() {
         return phyctx{ *buffers_, *sectors_, *allocator_ };
     }
@@ -145,14 +373,876 @@ private:
     int32_t flush(FlushFunction fn) {
         assert(file_node_ptr_.node.sector != InvalidSector);
 
-        auto err = tree_.modify_in_place(file_node_ptr_, fn);
+        auto err = current().modify_in_place(file_node_ptr_, [&](dir_node_type *node) -> int32_t {
+            auto err = fn(node);
+            if (err >= 0) {
+                cache_put(key_, file_node_ptr_, node->u.file);
+            }
+            return err;
+        });
         if (err < 0) {
             return err;
         }
 
-        return 0;
+        // Copying the path to a node moves its neighbours too.
+        if (tree_.copy_on_write()) {
+            cache_clear();
+        }
+
+        return update_parents();
     }
 
 };
 
+template<size_t InlineCapacity, typename AttributeStorage>
+int32_t basic_directory_tree<InlineCapacity, AttributeStorage>::mount() {
+    logged_task lt{ "dir-tree-mount" };
+
+    if (!tree_.exists()) {
+        return -1;
+    }
+
+    return 0;
+}
+
+template<size_t InlineCapacity, typename AttributeStorage>
+int32_t basic_directory_tree<InlineCapacity, AttributeStorage>::format() {
+    logged_task lt{ "dir-tree-format" };
+
+    return tree_.create();
+}
+
+template<size_t InlineCapacity, typename AttributeStorage>
+int32_t basic_directory_tree<InlineCapacity, AttributeStorage>::touch(const char *path) {
+    logged_task lt{ "dir-tree-touch" };
+    trace_scope ts{ trace_operation::Touch };
+
+    phydebugf("touch '%s'", path);
+
+    char name[MaximumNameLength];
+    auto err = enter(path, name);
+    if (err < 0) {
+        return err;
+    }
+    if (err == 0) {
+        phyerrorf("touch '%s' no directory", path);
+        return -1;
+    }
+
+    auto key = dir_key::make(name);
+
+    key_ = key;
+    file_ = {};
+    file_.id = dir_key::id(key);
+
+    dir_node_type node = {};
+    node.u.file = dirtree_file_t(name);
+
+    err = add_entry(key, node);
+    if (err < 0) {
+        return err;
+    }
+
+    return 0;
+}
+
+template<size_t InlineCapacity, typename AttributeStorage>
+int32_t basic_directory_tree<InlineCapacity, AttributeStorage>::mkdir(const char *path) {
+    logged_task lt{ "dir-tree-mkdir" };
+    trace_scope ts{ trace_operation::Mkdir };
+
+    phydebugf("mkdir '%s'", path);
+
+    char name[MaximumNameLength];
+    auto err = enter(path, name);
+    if (err < 0) {
+        return err;
+    }
+    if (err == 0 || name[0] == 0) {
+        phyerrorf("mkdir '%s' no directory", path);
+        return -1;
+    }
+
+    tree_ptr_t children;
+    err = find_directory(path_, name, children);
+    if (err != 0) {
+        return err < 0 ? err : 0;
+    }
+
+    dir_tree_type child{ pc(), tree_ptr_t{}, "dir-tree" };
+    err = child.create();
+    if (err < 0) {
+        return err;
+    }
+
+    dir_node_type node = {};
+    node.u.dir = dirtree_dir_t(name);
+    node.u.dir.children = child.to_tree_ptr();
+
+    file_ = {};
+    file_node_ptr_ = {};
+
+    cache_clear();
+
+    err = current().add(dir_key::make(name), &node, nullptr);
+    if (err < 0) {
+        return err;
+    }
+
+    return update_parents();
+}
+
+template<size_t InlineCapacity, typename AttributeStorage>
+int32_t basic_directory_tree<InlineCapacity, AttributeStorage>::resolve(const char *path, directory_path_t &resolved, char (&name)[MaximumNameLength]) {
+    resolved = directory_path_t{};
+    resolved.trees[0] = tree_.to_tree_ptr();
+
+    auto p = path;
+    while (true) {
+        while (*p == '/') {
+            p++;
+        }
+
+        auto end = strchr(p, '/');
+        if (end == nullptr) {
+            break;
+        }
+
+        auto length = (size_t)(end - p);
+        if (length >= MaximumNameLength || resolved.depth == MaximumDirectoryDepth) {
+            phyerrorf("'%s' too long", path);
+            return -1;
+        }
+
+        memcpy(name, p, length);
+        name[length] = 0;
+
+        tree_ptr_t children;
+        auto err = find_directory(resolved, name, children);
+        if (err <= 0) {
+            return err;
+        }
+
+        resolved.keys[resolved.depth] = dir_key::make(name);
+        resolved.depth++;
+        resolved.trees[resolved.depth] = children;
+
+        p = end + 1;
+    }
+
+    if (strlen(p) >= MaximumNameLength) {
+        phyerrorf("'%s' too long", path);
+        return -1;
+    }
+
+    strncpy(name, p, MaximumNameLength);
+
+    return 1;
+}
+
+template<size_t InlineCapacity, typename AttributeStorage>
+int32_t basic_directory_tree<InlineCapacity, AttributeStorage>::enter(const char *path, char (&name)[MaximumNameLength]) {
+    directory_path_t resolved;
+    auto err = resolve(path, resolved, name);
+    if (err <= 0) {
+        return err;
+    }
+
+    auto depth = resolved.depth;
+    if (depth == path_.depth && (depth == 0 || resolved.trees[depth] == path_.trees[depth])) {
+        return 1;
+    }
+
+    // Batched entries all belong to the directory they were touched in.
+    if (batch_ != nullptr && batch_->size > 0) {
+        err = flush_batch();
+        if (err < 0) {
+            return err;
+        }
+    }
+
+    path_ = resolved;
+
+    if (depth > 0) {
+        dir_ = dir_tree_type{ pc(), path_.trees[depth], "dir-tree" };
+        dir_.copy_on_write(tree_.journal());
+    }
+
+    return 1;
+}
+
+template<size_t InlineCapacity, typename AttributeStorage>
+int32_t basic_directory_tree<InlineCapacity, AttributeStorage>::find_directory(directory_path_t const &path, const char *name, tree_ptr_t &children) {
+    dir_tree_type walking{ pc(), path.trees[path.depth], "dir-tree" };
+    auto &tree = path.depth == 0 ? tree_ : walking;
+
+    tree_value_ptr_t found_ptr;
+    auto err = tree.find(dir_key::make(name), nullptr, &found_ptr);
+    if (err <= 0) {
+        return err;
+    }
+
+    return tree.visit(found_ptr, [&](dir_node_type const &node) -> int32_t {
+        auto mask = (uint16_t)FsDirTreeFlags::Deleted;
+        if ((node.u.e.flags & mask) == mask) {
+            return 0;
+        }
+
+        if (node.u.e.type != entry_type::FsDirectoryEntry || strncmp(node.u.e.name, name, sizeof(node.u.e.name)) != 0) {
+            phyerrorf("'%s' isn't a directory", name);
+            return -1;
+        }
+
+        children = node.u.dir.children;
+
+        return 1;
+    });
+}
+
+template<size_t InlineCapacity, typename AttributeStorage>
+int32_t basic_directory_tree<InlineCapacity, AttributeStorage>::update_parents() {
+    if (path_.depth == 0) {
+        return 0;
+    }
+
+    auto children = dir_.to_tree_ptr();
+
+    for (auto depth = path_.depth; depth > 0 && children != path_.trees[depth]; --depth) {
+        phydebugf("update-parents depth=%zu root=%d", depth, children.root);
+
+        path_.trees[depth] = children;
+
+        dir_tree_type walking{ pc(), path_.trees[depth - 1], "dir-tree" };
+        walking.copy_on_write(tree_.journal());
+        auto &parent = depth == 1 ? tree_ : walking;
+
+        tree_value_ptr_t found_ptr;
+        auto err = parent.find(path_.keys[depth - 1], nullptr, &found_ptr);
+        if (err < 0) {
+            return err;
+        }
+        if (err == 0) {
+            phyerrorf("update-parents missing directory");
+            return -1;
+        }
+
+        err = parent.modify_in_place(found_ptr, [&](dir_node_type *node) -> int32_t {
+            node->u.dir.children = children;
+            return 1;
+        });
+        if (err < 0) {
+            return err;
+        }
+
+        children = parent.to_tree_ptr();
+    }
+
+    // Copying the parents on write moves their neighbours as well.
+    if (tree_.copy_on_write()) {
+        cache_clear();
+    }
+
+    return 0;
+}
+
+template<size_t InlineCapacity, typename AttributeStorage>
+int32_t basic_directory_tree<InlineCapacity, AttributeStorage>::commit() {
+    logged_task lt{ "dir-tree-commit" };
+
+    assert(batch_ != nullptr);
+
+    auto err = flush_batch();
+
+    batch_ = nullptr;
+
+    return err;
+}
+
+template<size_t InlineCapacity, typename AttributeStorage>
+int32_t basic_directory_tree<InlineCapacity, AttributeStorage>::add_entry(dir_key_type key, dir_node_type &node) {
+    if (batch_ == nullptr) {
+        cache_clear();
+        auto err = current().add(key, &node, &file_node_ptr_);
+        if (err < 0) {
+            return err;
+        }
+
+        return update_parents();
+    }
+
+    file_node_ptr_ = {};
+
+    for (auto i = 0u; i < batch_->size; ++i) {
+        if (batch_->keys[i] == key) {
+            batch_->nodes[i] = node;
+            return 0;
+        }
+    }
+
+    if (batch_->size == batch_type::MaximumEntries) {
+        auto err = flush_batch();
+        if (err < 0) {
+            return err;
+        }
+    }
+
+    batch_->keys[batch_->size] = key;
+    batch_->nodes[batch_->size] = node;
+    batch_->size++;
+
+    return 0;
+}
+
+template<size_t InlineCapacity, typename AttributeStorage>
+int32_t basic_directory_tree<InlineCapacity, AttributeStorage>::flush_batch() {
+    auto &batch = *batch_;
+
+    phydebugf("flush-batch size=%zu", batch.size);
+
+    // Sorted so entries sharing a leaf are added with one write of it.
+    for (auto i = 1u; i < batch.size; ++i) {
+        for (auto j = i; j > 0 && batch.keys[j] < batch.keys[j - 1]; --j) {
+            std::swap(batch.keys[j], batch.keys[j - 1]);
+            std::swap(batch.nodes[j], batch.nodes[j - 1]);
+        }
+    }
+
+    cache_clear();
+
+    auto err = current().add_sorted(batch.keys, batch.nodes, batch.size);
+    if (err < 0) {
+        return err;
+    }
+
+    batch.size = 0;
+
+    return update_parents();
+}
+
+template<size_t InlineCapacity, typename AttributeStorage>
+int32_t basic_directory_tree<InlineCapacity, AttributeStorage>::unlink(const char *name) {
+    return unlink(name, nullptr);
+}
+
+template<size_t InlineCapacity, typename AttributeStorage>
+int32_t basic_directory_tree<InlineCapacity, AttributeStorage>::unlink(const char *path, free_sectors_chain *reclaimed) {
+    logged_task lt{ "dir-tree-unlink" };
+    trace_scope ts{ trace_operation::Unlink };
+
+    phydebugf("unlink '%s'", path);
+
+    file_ = {};
+    file_node_ptr_ = {};
+
+    char name[MaximumNameLength];
+    auto err = enter(path, name);
+    if (err <= 0) {
+        return err;
+    }
+
+    auto key = dir_key::make(name);
+
+    cache_clear();
+
+    tree_value_ptr_t found_ptr;
+    err = current().find(key, nullptr, &found_ptr);
+    if (err < 0) {
+        return err;
+    }
+    // Sectors the entry owns, given to reclaimed once it's removed.
+    head_tail_t chain;
+    tree_ptr_t attributes;
+    tree_ptr_t position_index;
+    tree_ptr_t record_index;
+    tree_ptr_t children;
+
+    if (err > 0) {
+        err = current().visit(found_ptr, [&](dir_node_type const &node) -> int32_t {
+            if (node.u.e.type != entry_type::FsDirectoryEntry) {
+                chain = node.u.file.chain;
+                attributes = node.u.file.attributes;
+                position_index = node.u.file.position_index;
+                record_index = node.u.file.record_index;
+                return 0;
+            }
+            children = node.u.dir.children;
+            return 1;
+        });
+        if (err < 0) {
+            return err;
+        }
+
+        if (err > 0) {
+            dir_tree_type child{ pc(), children, "dir-tree" };
+            cursor_type cursor;
+            directory_entry entry;
+            err = readdir(child, cursor, entry);
+            if (err < 0) {
+                return err;
+            }
+            if (err > 0) {
+                phyerrorf("unlink '%s' not empty", path);
+                return -1;
+            }
+        }
+    }
+
+    if (batch_ != nullptr) {
+        for (auto i = 0u; i < batch_->size; ++i) {
+            if (batch_->keys[i] == key) {
+                batch_->keys[i] = batch_->keys[batch_->size - 1];
+                batch_->nodes[i] = batch_->nodes[batch_->size - 1];
+                batch_->size--;
+                break;
+            }
+        }
+    }
+
+    err = current().remove(key, reclaimed);
+    if (err < 0) {
+        return err;
+    }
+
+    if (err == 0) {
+        phydebugf("unlink '%s' not found", path);
+    }
+
+    err = update_parents();
+    if (err < 0) {
+        return err;
+    }
+
+    if (reclaimed == nullptr) {
+        return 0;
+    }
+
+    // The saved tree still has the entry, so its sectors wait for it to
+    // be replaced.
+    if (tree_.copy_on_write()) {
+        if (nunlinked_ == MaximumUnlinked) {
+            phywarnf("unlink '%s' too many unreleased, leaking", path);
+            return 0;
+        }
+
+        unlinked_[nunlinked_++] = unlinked_t{ chain, attributes, position_index, record_index, children };
+
+        return 0;
+    }
+
+    return reclaim(*reclaimed, chain, attributes, position_index, record_index, children);
+}
+
+template<size_t InlineCapacity, typename AttributeStorage>
+int32_t basic_directory_tree<InlineCapacity, AttributeStorage>::release(free_sectors_chain *reclaimed) {
+    // Released sectors are reused, so nothing cached may point at them.
+    cache_clear();
+
+    auto err = journal_.release(pc(), reclaimed);
+    if (err < 0) {
+        return err;
+    }
+
+    auto nunlinked = nunlinked_;
+
+    nunlinked_ = 0;
+
+    if (reclaimed == nullptr) {
+        return 0;
+    }
+
+    for (auto i = 0u; i < nunlinked; ++i) {
+        auto &e = unlinked_[i];
+        err = reclaim(*reclaimed, e.chain, e.attributes, e.position_index, e.record_index, e.children);
+        if (err < 0) {
+            return err;
+        }
+    }
+
+    return 0;
+}
+
+template<size_t InlineCapacity, typename AttributeStorage>
+int32_t basic_directory_tree<InlineCapacity, AttributeStorage>::reclaim(free_sectors_chain &reclaimed, head_tail_t chain,
+                                                                         tree_ptr_t attributes, tree_ptr_t position_index,
+                                                                         tree_ptr_t record_index, tree_ptr_t children) {
+    if (chain.valid()) {
+        auto err = reclaimed.add_chain(chain.head);
+        if (err < 0) {
+            return err;
+        }
+    }
+
+    if (attributes.valid()) {
+        attribute_storage_type attributes_storage{ pc() };
+        auto err = attributes_storage.reclaim(attributes, reclaimed);
+        if (err < 0) {
+            return err;
+        }
+    }
+
+    for (auto tree : { position_index, record_index }) {
+        if (tree.valid()) {
+            auto err = reclaimed.add_tree(tree);
+            if (err < 0) {
+                return err;
+            }
+        }
+    }
+
+    // Directories copied on write may have a root of their own.
+    if (children.valid()) {
+        dir_tree_type child{ pc(), children, "dir-tree" };
+        return child.reclaim(reclaimed);
+    }
+
+    return 0;
+}
+
+template<size_t InlineCapacity, typename AttributeStorage>
+int32_t basic_directory_tree<InlineCapacity, AttributeStorage>::find(const char *path, open_file_config file_cfg) {
+    logged_task lt{ "dir-tree-find" };
+    trace_scope ts{ trace_operation::Find };
+
+    phydebugf("finding '%s'", path);
+
+    file_ = found_file{};
+
+    char name[MaximumNameLength];
+    auto err = enter(path, name);
+    if (err <= 0) {
+        return err;
+    }
+
+    auto key = dir_key::make(name);
+    auto id = dir_key::id(key);
+
+    key_ = key;
+    file_ = found_file{};
+    file_.cfg = file_cfg;
+    file_.id = id;
+
+    // Zero attribute values before we scan.
+    for (auto i = 0u; i < file_cfg.nattrs; ++i) {
+        auto &attr = file_cfg.attributes[i];
+        bzero(attr.ptr, attr.size);
+    }
+
+    auto cached = cache_find(key);
+    if (cached == nullptr) {
+        err = current().find(key, nullptr, &file_node_ptr_);
+        if (err < 0) {
+            file_ = found_file{};
+            return err;
+        }
+        if (err == 0) {
+            phydebugf("no file");
+            return 0;
+        }
+
+        // Nodes are only ever read here, so finding a file never
+        // dirties a page.
+        err = current().visit(file_node_ptr_, [&](dir_node_type const &node) -> int32_t {
+            auto mask = (uint16_t)FsDirTreeFlags::Deleted;
+            if ((node.u.e.flags & mask) == mask) {
+                phydebugf("found, deleted");
+                return 0;
+            }
+
+            if (strncmp(node.u.e.name, name, sizeof(node.u.e.name)) != 0) {
+                phyerrorf("'%s' collides with another file", path);
+                return 0;
+            }
+
+            if (node.u.e.type != entry_type::FsFileEntry) {
+                phydebugf("found, directory");
+                return 0;
+            }
+
+            cached = cache_put(key, file_node_ptr_, node.u.file);
+
+            return 1;
+        });
+        if (err <= 0) {
+            file_ = found_file{};
+            file_node_ptr_ = {};
+            return err;
+        }
+    } else {
+        phydebugf("cached");
+        file_node_ptr_ = cached->node_ptr;
+    }
+
+    if (!cached->chain.valid()) {
+        if (((int32_t)file_cfg.flags & (int32_t)open_file_flags::Truncate) == 0) {
+            file_.directory_size = cached->directory_size;
+            file_.directory_capacity = DataCapacity - cached->directory_size;
+        }
+        else {
+            file_.directory_size = 0;
+            file_.directory_capacity = DataCapacity;
+        }
+    }
+    else {
+        file_.chain = cached->chain;
+        file_.position_index = cached->position_index;
+        file_.record_index = cached->record_index;
+    }
+
+    // If we're being asked to load attributes.
+    if (file_cfg.nattrs > 0 && cached->attributes.valid()) {
+        auto attributes = cached->attributes;
+        attribute_storage_type attributes_storage{ pc() };
+        err = attributes_storage.read(attributes, id, file_cfg);
+        if (err < 0) {
+            return err;
+        }
+    }
+
+    phydebugf("found");
+
+    return 1;
+}
+
+template<size_t InlineCapacity, typename AttributeStorage>
+typename basic_directory_tree<InlineCapacity, AttributeStorage>::cached_entry_t *
+basic_directory_tree<InlineCapacity, AttributeStorage>::cache_find(dir_key_type key) {
+    auto tree = current().to_tree_ptr().root;
+    for (auto &entry : cache_) {
+        if (entry.used > 0 && entry.key == key && entry.tree == tree) {
+            entry.used = ++cache_counter_;
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+template<size_t InlineCapacity, typename AttributeStorage>
+typename basic_directory_tree<InlineCapacity, AttributeStorage>::cached_entry_t *
+basic_directory_tree<InlineCapacity, AttributeStorage>::cache_put(dir_key_type key, tree_value_ptr_t node_ptr, dirtree_file_t const &file) {
+    // Replace this key's entry or the least recently used one, empty
+    // ones are always older.
+    auto entry = cache_find(key);
+    if (entry == nullptr) {
+        entry = &cache_[0];
+        for (auto &candidate : cache_) {
+            if (candidate.used < entry->used) {
+                entry = &candidate;
+            }
+        }
+    }
+
+    entry->tree = current().to_tree_ptr().root;
+    entry->key = key;
+    entry->used = ++cache_counter_;
+    entry->node_ptr = node_ptr;
+    entry->directory_size = file.directory_size;
+    entry->chain = file.chain;
+    entry->attributes = file.attributes;
+    entry->position_index = file.position_index;
+    entry->record_index = file.record_index;
+
+    return entry;
+}
+
+template<size_t InlineCapacity, typename AttributeStorage>
+void basic_directory_tree<InlineCapacity, AttributeStorage>::cache_clear() {
+    for (auto &entry : cache_) {
+        entry = cached_entry_t{};
+    }
+}
+
+template<size_t InlineCapacity, typename AttributeStorage>
+found_file basic_directory_tree<InlineCapacity, AttributeStorage>::open() {
+    assert(file_.id != UINT32_MAX);
+    return file_;
+}
+
+template<size_t InlineCapacity, typename AttributeStorage>
+int32_t basic_directory_tree<InlineCapacity, AttributeStorage>::readdir(cursor_type &cursor, directory_entry &entry) {
+    return readdir(tree_, cursor, entry);
+}
+
+template<size_t InlineCapacity, typename AttributeStorage>
+int32_t basic_directory_tree<InlineCapacity, AttributeStorage>::opendir(const char *path, directory_cursor &cursor) {
+    logged_task lt{ "dir-tree-opendir" };
+
+    cursor = directory_cursor{};
+
+    directory_path_t resolved;
+    char name[MaximumNameLength];
+    auto err = resolve(path, resolved, name);
+    if (err <= 0) {
+        return err;
+    }
+
+    if (name[0] == 0) {
+        cursor.tree = resolved.trees[resolved.depth];
+        return 1;
+    }
+
+    return find_directory(resolved, name, cursor.tree);
+}
+
+template<size_t InlineCapacity, typename AttributeStorage>
+int32_t basic_directory_tree<InlineCapacity, AttributeStorage>::readdir(directory_cursor &cursor, directory_entry &entry) {
+    dir_tree_type tree{ pc(), cursor.tree, "dir-tree" };
+
+    return readdir(tree, cursor.position, entry);
+}
+
+template<size_t InlineCapacity, typename AttributeStorage>
+int32_t basic_directory_tree<InlineCapacity, AttributeStorage>::readdir(dir_tree_type &tree, cursor_type &cursor, directory_entry &entry) {
+    auto mask = (uint16_t)FsDirTreeFlags::Deleted;
+
+    while (true) {
+        auto deleted = false;
+        auto err = tree.next_visit(cursor, [&](dir_key_type const &key, dir_node_type const &node) -> int32_t {
+            if ((node.u.e.flags & mask) == mask) {
+                deleted = true;
+                return 0;
+            }
+
+            entry = directory_entry{};
+            entry.id = dir_key::id(key);
+            entry.type = node.u.e.type;
+            memcpy(entry.name, node.u.e.name, sizeof(entry.name));
+
+            if (node.u.e.type == entry_type::FsFileEntry) {
+                entry.directory_size = node.u.file.directory_size;
+                entry.chain = node.u.file.chain;
+                entry.attributes = node.u.file.attributes;
+                entry.position_index = node.u.file.position_index;
+                entry.record_index = node.u.file.record_index;
+            }
+
+            return 0;
+        });
+        if (err <= 0) {
+            return err;
+        }
+
+        if (!deleted) {
+            return 1;
+        }
+    }
+}
+
+template<size_t InlineCapacity, typename AttributeStorage>
+int32_t basic_directory_tree<InlineCapacity, AttributeStorage>::file_data(file_id_t id, file_size_t position, uint8_t const *buffer, size_t size) {
+    assert(file_.id == id);
+
+    if (position + size > DataCapacity) {
+        return -1;
+    }
+
+    logged_task lt{ "dir-tree-file-data" };
+
+    auto err = flush([&](dir_node_type *node) -> int32_t {
+        memcpy(node->inline_data() + position, buffer, size);
+        node->u.file.directory_size = position + size;
+
+        return 1;
+    });
+    if (err < 0) {
+        return err;
+    }
+
+    return size;
+}
+
+template<size_t InlineCapacity, typename AttributeStorage>
+int32_t basic_directory_tree<InlineCapacity, AttributeStorage>::file_chain(file_id_t id, head_tail_t chain) {
+    assert(file_.id == id);
+
+    logged_task lt{ "dir-tree-file-chain" };
+
+    auto err = flush([&](dir_node_type *node) -> int32_t {
+        assert(!node->u.file.chain.valid());
+
+        node->u.file.directory_size = 0;
+        node->u.file.chain = chain;
+
+        file_.chain = node->u.file.chain;
+
+        return 1;
+    });
+    if (err < 0) {
+        return err;
+    }
+
+    return 0;
+}
+
+template<size_t InlineCapacity, typename AttributeStorage>
+int32_t basic_directory_tree<InlineCapacity, AttributeStorage>::file_attributes(file_id_t id, open_file_attribute *attributes, size_t nattrs) {
+    assert(file_.id == id);
+
+    logged_task lt{ "dir-tree-file-attrs" };
+
+    auto err = flush([&](dir_node_type *node) -> int32_t {
+        auto attributes_ptr = node->u.file.attributes;
+
+        attribute_storage_type attributes_storage{ pc() };
+        auto err = attributes_storage.update(attributes_ptr, id, attributes, nattrs);
+        if (err < 0) {
+            return err;
+        }
+
+        if (node->u.file.attributes != attributes_ptr) {
+            node->u.file.attributes = attributes_ptr;
+            return 1;
+        }
+
+        return 0;
+    });
+    if (err < 0) {
+        return err;
+    }
+
+    return 0;
+}
+
+template<size_t InlineCapacity, typename AttributeStorage>
+int32_t basic_directory_tree<InlineCapacity, AttributeStorage>::file_trees(file_id_t id, tree_ptr_t position_index, tree_ptr_t record_index) {
+    assert(file_.id == id);
+
+    logged_task lt{ "dir-tree-file-trees" };
+
+    auto err = flush([&](dir_node_type *node) -> int32_t {
+        node->u.file.position_index = position_index;
+        node->u.file.record_index = record_index;
+
+        return 1;
+    });
+    if (err < 0) {
+        return err;
+    }
+
+    return 0;
+}
+
+template<size_t InlineCapacity, typename AttributeStorage>
+int32_t basic_directory_tree<InlineCapacity, AttributeStorage>::read(file_id_t id, io_writer &writer) {
+    assert(file_.id == id);
+
+    logged_task lt{ "dir-tree-read" };
+
+    auto err = current().find(key_, nullptr, &file_node_ptr_);
+    if (err < 0) {
+        return err;
+    }
+
+    return current().visit(file_node_ptr_, [&](dir_node_type const &node) -> int32_t {
+        if (node.u.file.directory_size == 0) {
+            return 0;
+        }
+
+        return writer.write(node.inline_data(), node.u.file.directory_size);
+    });
+}
+
+using directory_tree = basic_directory_tree<128>;
+
+extern template class basic_directory_tree<128>;
+
 }
@@ -93,6 +93,13 @@ struct PHY_PACKED entry_t {
 enum class sector_flags : uint8_t {
     None = 0,
     Tail = 1,
+    // Data sector payload is a series of compressed blocks.
+    Compressed = 2,
+    // Tree sector holding only a copy-on-write root, it isn't part of
+    // the chain of the tree's other sectors.
+    Root = 4,
+    // Data sector header is a data_chain_checksummed_header_t.
+    Checksummed = 8,
 };
 
 struct PHY_PACKED sector_chain_header_t : entry_t {
@@ -110,11 +117,25 @@ struct PHY_PACKED sector_chain_header_t : entry_t {
     }
 };
 
+/**
+ * Bumped whenever the layout of what's on flash changes, volumes of any
+ * other version are refused when mounting.
+ *
+ * 2: Inner tree nodes are stored without the value region.
+ * 3: Directory trees are keyed by 64-bit file keys instead of file ids.
+ * 4: Names are split into directories on '/', see basic_directory_tree.
+ * 5: The directory's inline capacity is recorded, see file_ops::mount.
+ */
+static constexpr uint32_t SuperBlockVersion = 5;
+
 struct PHY_PACKED super_block_t : sector_chain_header_t {
     char magic[8];
-    uint32_t version{ 1 };
+    uint32_t version{ SuperBlockVersion };
     tree_ptr_t directory_tree{ };
     head_tail_t free_chain{ };
+    // Decides the size of directory entries, UINT16_MAX until the
+    // directory tree is formatted.
+    uint16_t inline_capacity{ UINT16_MAX };
 
     super_block_t() : sector_chain_header_t(entry_type::SuperBlock) {
         bzero(magic, sizeof(magic));
@@ -157,10 +178,69 @@ struct PHY_PACKED data_chain_header_t : sector_chain_header_t {
     }
 };
 
+struct PHY_PACKED data_chain_checksummed_header_t : data_chain_header_t {
+    // CRC32 of the payload, extended as bytes are appended.
+    uint32_t crc{ 0 };
+
+    data_chain_checksummed_header_t(sector_flags flags) : data_chain_header_t((uint16_t)0, InvalidSector, InvalidSector, flags) {
+    }
+};
+
+/**
+ * Running checksum of a file's contents, kept in an attribute. Bytes is
+ * how much of the file the CRC covers, so readers can tell when it's
+ * stale, for example after appending without the attribute.
+ */
+struct PHY_PACKED file_hash_t {
+    uint32_t crc{ 0 };
+    file_size_t bytes{ 0 };
+};
+
 inline uint32_t make_file_id(const char *path) {
     return crc32_checksum(path);
 }
 
+// FNV-1a, only used to widen directory keys so it's independent of the
+// CRC used for file ids.
+inline uint32_t make_file_id_secondary(const char *path) {
+    uint32_t hash = 2166136261u;
+    for (auto p = (uint8_t const *)path; *p != 0; ++p) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Maps paths to directory tree keys. Narrow keys are just the file id,
+ * wide keys append a second hash so that two paths sharing a file id
+ * are kept apart rather than aliasing one another.
+ */
+template<typename KEY>
+struct file_key;
+
+template<>
+struct file_key<uint32_t> {
+    static uint32_t make(const char *path) {
+        return make_file_id(path);
+    }
+
+    static file_id_t id(uint32_t key) {
+        return key;
+    }
+};
+
+template<>
+struct file_key<uint64_t> {
+    static uint64_t make(const char *path) {
+        return ((uint64_t)make_file_id(path) << 32) | make_file_id_secondary(path);
+    }
+
+    static file_id_t id(uint64_t key) {
+        return (file_id_t)(key >> 32);
+    }
+};
+
 enum class FsDirTreeFlags : uint16_t {
     None = 0,
     Deleted = 1 << 0,
@@ -179,7 +259,7 @@ struct PHY_PACKED dirtree_entry_t : entry_t {
 
 struct PHY_PACKED dirtree_dir_t : dirtree_entry_t {
     dhara_sector_t attributes{ InvalidSector };
-    dhara_sector_t children{ InvalidSector };
+    tree_ptr_t children{ };
 
     dirtree_dir_t(const char *name, uint16_t flags = 0)
         : dirtree_entry_t(entry_type::FsDirectoryEntry, name, flags) {
@@ -213,6 +293,39 @@ struct PHY_PACKED dirtree_tree_value_t {
 
     dirtree_tree_value_t() {
     }
+
+    uint8_t *inline_data() {
+        return data;
+    }
+
+    uint8_t const *inline_data() const {
+        return data;
+    }
+};
+
+// Without inline storage entries are just their header, files always
+// get a data chain.
+template<>
+struct PHY_PACKED dirtree_tree_value_t<0> {
+    union PHY_PACKED entry_union {
+        dirtree_entry_t e;
+        dirtree_dir_t dir;
+        dirtree_file_t file;
+
+        entry_union() {
+        }
+    } u;
+
+    dirtree_tree_value_t() {
+    }
+
+    uint8_t *inline_data() {
+        return nullptr;
+    }
+
+    uint8_t const *inline_data() const {
+        return nullptr;
+    }
 };
 
 struct PHY_PACKED file_entry_t : entry_t {
@@ -312,6 +425,8 @@ using index_type = int16_t;
 enum node_type : uint8_t {
     Leaf,
     Inner,
+    Free,
+    Packed,
 };
 
 struct PHY_PACKED tree_node_header_t : entry_t {
@@ -333,6 +448,19 @@ public:
     }
 };
 
+/**
+ * Leaf whose entries follow this header as varints, each key and value
+ * stored as the difference from the one before it.
+ */
+struct PHY_PACKED tree_packed_node_t : tree_node_header_t {
+public:
+    uint16_t size{ 0 };
+
+public:
+    tree_packed_node_t() : tree_node_header_t(node_type::Packed) {
+    }
+};
+
 template <typename KEY, typename VALUE, size_t Size>
 struct tree_node_t : tree_node_header_t {
 public:
@@ -348,8 +476,10 @@ public:
     };
 
 public:
-    data_t d;
+    // Keys come first so that inner nodes, which never use values, can
+    // be stored without the tail of the values.
     KEY keys[Size];
+    data_t d;
 
 public:
     tree_node_t() : tree_node_header_t() {
@@ -5,6 +5,23 @@ namespace phylum {
 file_appender::file_appender(phyctx pc, directory *directory, found_file file)
     : pc_(pc), directory_(directory), file_(file), buffer_(std::move(pc.buffers_.allocate(pc.sectors_.sector_size()))),
       data_chain_(pc, file.chain, "file-app") {
+    data_chain_.compress(((int32_t)file_.cfg.flags & (int32_t)open_file_flags::Compressed) > 0);
+    data_chain_.checksum(((int32_t)file_.cfg.flags & (int32_t)open_file_flags::Checksummed) > 0);
+    data_chain_.verify_checksums(((int32_t)file_.cfg.flags & (int32_t)open_file_flags::Unverified) == 0);
+
+    for (auto i = 0u; i < file_.cfg.nattrs; ++i) {
+        auto &attr = file_.cfg.attributes[i];
+        if (attr.type == FileHashAttribute && attr.size == sizeof(file_hash_t)) {
+            hash_ = &attr;
+        }
+    }
+
+    // Truncated files start over.
+    auto truncated = ((int32_t)file_.cfg.flags & (int32_t)open_file_flags::Truncate) > 0;
+    if (hash_ != nullptr && truncated) {
+        *(file_hash_t *)hash_->ptr = file_hash_t{};
+        hash_->dirty = true;
+    }
 }
 
 file_appender::~file_appender() {
@@ -37,18 +54,26 @@ file_size_t file_appender::position() {
 
 int32_t file_appender::write(uint8_t const *data, size_t size) {
     logged_task lt{ "fa-write" };
+    trace_scope ts{ trace_operation::Write };
 
     phyverbosef("appender-write: position=%d buffer=%d size=%d", cursor().position, buffer_.position(), size);
 
     auto wrote = buffer_.fill_from_buffer_ptr(data, size, [&](simple_buffer &) -> int32_t {
         auto flushing = buffer_.position();
-        auto err = flush();
+        auto err = flush_buffer();
         if (err < 0) {
             return err;
         }
         return flushing;
     });
 
+    if (hash_ != nullptr && wrote > 0) {
+        auto hash = (file_hash_t *)hash_->ptr;
+        hash->crc = crc32_checksum(hash->crc, data, wrote);
+        hash->bytes += wrote;
+        hash_->dirty = true;
+    }
+
     return wrote;
 }
 
@@ -85,6 +110,10 @@ int32_t file_appender::index_necessary() {
     // We use the appender cursor so that we don't keep indexing at
     // the start, while data chain cursor hasn't moved because we're
     // buffering. This doesn't affect anything.
+    if (!has_chain()) {
+        return 0;
+    }
+
     auto cursor = this->cursor();
     assert(cursor.sector != InvalidSector);
 
@@ -111,7 +140,36 @@ int32_t file_appender::seek() {
 
 int32_t file_appender::flush() {
     logged_task lt{ "fa-flush" };
+    trace_scope ts{ trace_operation::Flush };
+
+    auto err = flush_buffer();
+    if (err < 0) {
+        return err;
+    }
+
+    return checkpoint_hash();
+}
+
+int32_t file_appender::checkpoint_hash() {
+    if (hash_ == nullptr || !hash_->dirty) {
+        return 0;
+    }
+
+    // Attribute storage may be rewritten from what's passed, so the
+    // other attributes go along with the hash.
+    auto err = directory_->file_attributes(file_.id, file_.cfg.attributes, file_.cfg.nattrs);
+    if (err < 0) {
+        return err;
+    }
+
+    for (auto i = 0u; i < file_.cfg.nattrs; ++i) {
+        file_.cfg.attributes[i].dirty = false;
+    }
+
+    return 0;
+}
 
+int32_t file_appender::flush_buffer() {
     assert(file_.id != UINT32_MAX);
 
     // Do we already have a data chain?
@@ -199,8 +257,10 @@ int32_t file_appender::flush() {
 
 int32_t file_appender::close() {
     logged_task lt{ "fa-close" };
+    trace_scope ts{ trace_operation::Close };
 
-    auto err = flush();
+    // The checksum is saved below with the other attributes.
+    auto err = flush_buffer();
     if (err < 0) {
         return err;
     }
@@ -5,6 +5,8 @@
 #include "directory.h"
 #include "writer.h"
 #include "helpers.h"
+#include "trace.h"
+#include "tree_sector.h"
 
 namespace phylum {
 
@@ -16,6 +18,11 @@ private:
     simple_buffer buffer_;
     data_chain data_chain_;
     bool truncated_{ false };
+    open_file_attribute *hash_{ nullptr };
+    // Index trees are only appended to while the file is open, so the
+    // paths to their rightmost leaves are kept here between records.
+    tree_rightmost_t position_rightmost_;
+    tree_rightmost_t record_rightmost_;
 
 public:
     file_appender(phyctx pc, directory *directory, found_file file);
@@ -32,7 +39,7 @@ public:
 public:
     int32_t write_delimiter(size_t delimited_size) {
         uint8_t buffer[4];
-        auto size_of_delimiter = varint_encoding_length(delimited_size);
+        auto size_of_delimiter = varint_encoding_length32(delimited_size);
         varint_encode(delimited_size, buffer, sizeof(buffer));
         auto err = write(buffer, size_of_delimiter);
         if (err < 0) {
@@ -51,10 +58,20 @@ public:
 
     int32_t close();
 
+    /**
+     * The running checksum, if the file was opened with a
+     * FileHashAttribute, or nullptr.
+     */
+    file_hash_t const *hash() const {
+        return hash_ == nullptr ? nullptr : (file_hash_t const *)hash_->ptr;
+    }
+
     int32_t index_necessary();
 
     template<typename tree_type>
     int32_t index_if_necessary(record_number_t record_number) {
+        trace_scope ts{ trace_operation::Index };
+
         auto err = index_necessary();
         if (err <= 0) {
             return err;
@@ -65,23 +82,54 @@ public:
         alogf(LogLevels::INFO, "phylum", "indexing position=%" PRIu32 ", psos=%" PRIu32 " cursor=%" PRIu32 " buffer-pos=%zu",
               cursor.position, cursor.position_at_start_of_sector, cursor.sector, buffer_.position());
 
+        auto position_before = file_.position_index;
+        auto record_before = file_.record_index;
+
+        // Index trees are created lazily, the first time a file is
+        // large enough to need them.
+        if (!file_.position_index.valid()) {
+            auto sector = pc_.allocator_.allocate();
+            tree_type tree{ data_chain_.pc(), tree_ptr_t{ sector }, "pos-idx" };
+            auto err = tree.create();
+            if (err < 0) {
+                return err;
+            }
+            file_.position_index = tree.to_tree_ptr();
+        }
+
+        if (!file_.record_index.valid()) {
+            auto sector = pc_.allocator_.allocate();
+            tree_type tree{ data_chain_.pc(), tree_ptr_t{ sector }, "rec-idx" };
+            auto err = tree.create();
+            if (err < 0) {
+                return err;
+            }
+            file_.record_index = tree.to_tree_ptr();
+        }
+
         tree_type position_index{ data_chain_.pc(), file_.position_index, "pos-idx" };
-        err = position_index.add(cursor.position_at_start_of_sector, cursor.sector);
+        position_index.rightmost(position_rightmost_);
+        err = position_index.append(cursor.position_at_start_of_sector, cursor.sector);
         if (err < 0) {
+            position_rightmost_ = tree_rightmost_t{};
             return err;
         }
+        position_rightmost_ = position_index.rightmost();
 
         tree_type record_index{ data_chain_.pc(), file_.record_index, "rec-idx" };
-        err = record_index.add(record_number, cursor.position);
+        record_index.rightmost(record_rightmost_);
+        err = record_index.append(record_number, cursor.position);
         if (err < 0) {
+            record_rightmost_ = tree_rightmost_t{};
             return err;
         }
+        record_rightmost_ = record_index.rightmost();
 
         auto position_after = position_index.to_tree_ptr();
         auto record_after = record_index.to_tree_ptr();
 
-        auto position_changed = position_after != file_.position_index;
-        auto record_changed = record_after != file_.record_index;
+        auto position_changed = position_after != position_before;
+        auto record_changed = record_after != record_before;
 
         // Update tree_ptr_t's because they wander.
         if (position_changed || record_changed) {
@@ -102,6 +150,10 @@ public:
 private:
     int32_t make_data_chain();
 
+    int32_t flush_buffer();
+
+    int32_t checkpoint_hash();
+
     bool has_chain() {
         return data_chain_.valid();
     }
@@ -1,6 +1,7 @@
 #include "super_chain.h"
 #include "directory_tree.h"
 #include "tree_sector.h"
+#include "free_sectors_chain.h"
 
 namespace phylum {
 
@@ -10,6 +11,7 @@ private:
     phyctx pc_;
     super_chain &sc_;
     directory_type dir_;
+    bool batching_{ false };
 
 public:
     file_ops(phyctx pc, super_chain &sc) : pc_(pc), sc_(sc), dir_{ pc, sc.directory_tree() } {
@@ -25,7 +27,16 @@ public:
     }
 
 public:
+    /**
+     * Refuses volumes whose directory tree was formatted with another
+     * inline capacity, its entries are a different size.
+     */
     int32_t mount() {
+        if (sc_.inline_capacity() != directory_type::DataCapacity) {
+            phyerrorf("directory inline-capacity=%d expected=%d", sc_.inline_capacity(), (int32_t)directory_type::DataCapacity);
+            return -1;
+        }
+
         return 0;
     }
 
@@ -35,7 +46,12 @@ public:
             return err;
         }
 
-        err = sc_.update(dir_.to_tree_ptr());
+        err = sc_.format_directory(dir_.to_tree_ptr(), directory_type::DataCapacity);
+        if (err < 0) {
+            return err;
+        }
+
+        err = publish();
         if (err < 0) {
             return err;
         }
@@ -49,7 +65,41 @@ public:
             return err;
         }
 
-        err = sc_.update(dir_.to_tree_ptr());
+        // Batches that outgrow their entries are added to the tree before
+        // the commit, so a long one publishes along the way.
+        if (batching_ && !dir_.publishing_due()) {
+            return 0;
+        }
+
+        err = publish();
+        if (err < 0) {
+            return err;
+        }
+
+        return 0;
+    }
+
+    /**
+     * Defers touched files and the super block update until commit.
+     */
+    int32_t begin_batch(typename directory_type::batch_type &batch) {
+        dir_.begin_batch(batch);
+        batching_ = true;
+
+        return 0;
+    }
+
+    int32_t commit() {
+        assert(batching_);
+
+        batching_ = false;
+
+        auto err = dir_.commit();
+        if (err < 0) {
+            return err;
+        }
+
+        err = publish();
         if (err < 0) {
             return err;
         }
@@ -57,8 +107,75 @@ public:
         return 0;
     }
 
+    int32_t mkdir(const char *path) {
+        auto err = dir_.mkdir(path);
+        if (err < 0) {
+            return err;
+        }
+
+        err = publish();
+        if (err < 0) {
+            return err;
+        }
+
+        return 0;
+    }
+
+    /**
+     * Removes the file and gives its sectors to the volume's free
+     * sectors chain, creating the chain the first time.
+     */
+    int32_t unlink(const char *name) {
+        free_sectors_chain reclaimed{ pc_, sc_.free_chain() };
+        auto err = open_free_chain(reclaimed);
+        if (err < 0) {
+            return err;
+        }
+
+        err = dir_.unlink(name, &reclaimed);
+        if (err < 0) {
+            return err;
+        }
+
+        return publish(reclaimed);
+    }
+
     int32_t index_if_necessary(file_appender &appender, record_number_t record_number) {
-        return appender.index_if_necessary<tree_type>(record_number);
+        auto err = appender.index_if_necessary<tree_type>(record_number);
+        if (err <= 0) {
+            return err;
+        }
+
+        if (dir_.publishing_due()) {
+            auto err = publish();
+            if (err < 0) {
+                return err;
+            }
+        }
+
+        return err;
+    }
+
+    /**
+     * Flushes the appender and saves the directory tree, which copying
+     * on write moves whenever the file's entry changes.
+     */
+    int32_t flush(file_appender &appender) {
+        auto err = appender.flush();
+        if (err < 0) {
+            return err;
+        }
+
+        return publish_if_moved();
+    }
+
+    int32_t close(file_appender &appender) {
+        auto err = appender.close();
+        if (err < 0) {
+            return err;
+        }
+
+        return publish_if_moved();
     }
 
     int32_t seek_position(file_reader &reader, file_size_t position) {
@@ -70,6 +187,10 @@ public:
         return err;
     }
 
+    int32_t seek_indexed_record(file_reader &reader, record_number_t record) {
+        return reader.seek_indexed_record<tree_type>(record);
+    }
+
     int32_t seek_record(file_reader &reader, record_number_t record) {
         auto err = reader.seek_record<tree_type>(record);
         if (err < 0) {
@@ -79,6 +200,64 @@ public:
         return err;
     }
 
+    void verify_checksums(file_reader &reader, bool enabled) {
+        reader.verify_checksums(enabled);
+    }
+
+private:
+    int32_t open_free_chain(free_sectors_chain &reclaimed) {
+        if (sc_.free_chain().valid()) {
+            return 0;
+        }
+
+        return reclaimed.create_if_necessary();
+    }
+
+    int32_t publish_if_moved() {
+        if (batching_) {
+            return 0;
+        }
+
+        if (!dir_.releasable() && dir_.to_tree_ptr() == sc_.directory_tree()) {
+            return 0;
+        }
+
+        return publish();
+    }
+
+    /**
+     * Saves the directory tree in the super block, then frees what
+     * copying on write replaced.
+     */
+    int32_t publish() {
+        if (!dir_.releasable()) {
+            return sc_.update(dir_.to_tree_ptr());
+        }
+
+        free_sectors_chain reclaimed{ pc_, sc_.free_chain() };
+        auto err = open_free_chain(reclaimed);
+        if (err < 0) {
+            return err;
+        }
+
+        return publish(reclaimed);
+    }
+
+    int32_t publish(free_sectors_chain &reclaimed) {
+        auto err = sc_.update(dir_.to_tree_ptr(), reclaimed.chain());
+        if (err < 0) {
+            return err;
+        }
+
+        err = dir_.release(&reclaimed);
+        if (err < 0) {
+            return err;
+        }
+
+        // Releasing may have grown the free sectors chain.
+        return sc_.update(dir_.to_tree_ptr(), reclaimed.chain());
+    }
+
 };
 
 }
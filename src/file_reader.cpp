@@ -4,6 +4,7 @@ namespace phylum {
 
 file_reader::file_reader(phyctx pc, directory *directory, found_file file)
     : pc_(pc), directory_(directory), file_(file), data_chain_(pc, file.chain, "file-rdr") {
+    verify_checksums(((int32_t)file_.cfg.flags & (int32_t)open_file_flags::Unverified) == 0);
 }
 
 file_reader::~file_reader() {
@@ -23,6 +24,7 @@ int32_t file_reader::read(size_t size) {
 
 int32_t file_reader::read(uint8_t *data, size_t size) {
     logged_task lt{ "fr-read" };
+    trace_scope ts{ trace_operation::Read };
 
     if (has_chain()) {
         auto nread = 0u;
@@ -5,6 +5,7 @@
 #include "helpers.h"
 #include "reader.h"
 #include "simple_buffer.h"
+#include "trace.h"
 
 namespace phylum {
 
@@ -32,24 +33,39 @@ public:
 
     int32_t close();
 
+    /**
+     * Whether checksummed sectors are checked as they're read, on unless
+     * the file was found with open_file_flags::Unverified.
+     */
+    void verify_checksums(bool enabled) {
+        data_chain_.verify_checksums(enabled);
+    }
+
 public:
     template <typename tree_type> int32_t seek_position(uint32_t desired_position) {
+        trace_scope ts{ trace_operation::SeekPosition };
+
         return data_chain_helpers::indexed_seek<tree_type>(data_chain_, file_.position_index, desired_position);
     }
 
-    template <typename tree_type> int32_t seek_record(record_number_t desired_record) {
+    /**
+     * Seeks to the last indexed record at or before the desired one,
+     * returning its number. Records written through a delta_writer are
+     * keyframes there.
+     */
+    template <typename tree_type> int32_t seek_indexed_record(record_number_t desired_record) {
         int32_t err;
 
-        // TODO Skip this if desired_record == 0
-
-        tree_type record_index{ data_chain_.pc(), file_.record_index, "rec-idx" };
-
         uint32_t found_record = 0;
         uint32_t found_record_position = 0;
 
-        err = record_index.find_last_less_then(desired_record, &found_record_position, &found_record);
-        if (err < 0) {
-            return err;
+        if (file_.record_index.valid()) {
+            tree_type record_index{ data_chain_.pc(), file_.record_index, "rec-idx" };
+
+            err = record_index.find_last_less_then(desired_record, &found_record_position, &found_record);
+            if (err < 0) {
+                return err;
+            }
         }
 
         phydebugf("seeking record desired=%d found-record=%d found-position=%d", desired_record, found_record,
@@ -60,7 +76,22 @@ public:
             return err;
         }
 
-        phydebugf("skipping %d records position=%d", desired_record, err);
+        return found_record;
+    }
+
+    template <typename tree_type> int32_t seek_record(record_number_t desired_record) {
+        trace_scope ts{ trace_operation::SeekRecord };
+
+        // TODO Skip this if desired_record == 0
+
+        auto err = seek_indexed_record<tree_type>(desired_record);
+        if (err < 0) {
+            return err;
+        }
+
+        uint32_t found_record = err;
+
+        phydebugf("skipping %d records found-record=%d position=%d", desired_record, found_record, position());
 
         if (desired_record == UINT32_MAX) {
             err = data_chain_.skip_records(desired_record);
@@ -9,6 +9,49 @@ struct attribute_header_t {
     uint8_t reserved[2] = { 0xff, 0xff };
 };
 
+/**
+ * Returns where the value of an attribute goes in a buffer of headers
+ * and values, appending an entry for it if there isn't one yet or if
+ * the one there is a different size. Returns nullptr when the buffer is
+ * full.
+ */
+static uint8_t *find_or_append(simple_buffer &buffer, uint8_t type, uint8_t size) {
+    auto position = 0u;
+    while (position + sizeof(attribute_header_t) <= buffer.position()) {
+        auto header = (attribute_header_t *)(buffer.ptr() + position);
+        if (header->type == type) {
+            if (header->size == size) {
+                return buffer.ptr() + position + sizeof(attribute_header_t);
+            }
+
+            // The newer size wins, so the old entry is dropped.
+            phywarnf("attribute type=%d size=%d replaced by size=%d", type, header->size, size);
+            auto removing = sizeof(attribute_header_t) + header->size;
+            memmove(buffer.ptr() + position, buffer.ptr() + position + removing, buffer.position() - position - removing);
+            buffer.position(buffer.position() - removing);
+            break;
+        }
+        position += sizeof(attribute_header_t) + header->size;
+    }
+
+    if (!buffer.room_for(sizeof(attribute_header_t) + size)) {
+        return nullptr;
+    }
+
+    attribute_header_t header;
+    header.type = type;
+    header.size = size;
+
+    auto err = buffer.write((uint8_t *)&header, sizeof(attribute_header_t));
+    if (err < 0) {
+        return nullptr;
+    }
+
+    auto value = buffer.ptr() + buffer.position();
+    buffer.skip(size);
+    return value;
+}
+
 flat_attribute_storage::flat_attribute_storage(phyctx pc)
     : buffers_(&pc.buffers_), sectors_(&pc.sectors_), allocator_(&pc.allocator_) {
 }
@@ -36,18 +79,24 @@ int32_t flat_attribute_storage::read(tree_ptr_t &ptr, file_id_t /*id*/, open_fil
         bool found = false;
         for (auto i = 0u; i < file_cfg.nattrs; ++i) {
             auto &attr = file_cfg.attributes[i];
-            if (attr.type == header.type) {
-                assert(attr.size == header.size);
+            // Entries from before an attribute changed size are skipped.
+            if (attr.type == header.type && attr.size == header.size) {
                 auto err = chain.read((uint8_t *)attr.ptr, attr.size);
                 if (err < 0) {
                     return err;
                 }
                 found = true;
+                break;
             }
         }
+
+        // Callers only need to ask for the attributes they want.
         if (!found) {
-            phywarnf("attribute(unknown): type=%d size=%d", header.type, header.size);
-            break;
+            phyverbosef("attribute(skip): type=%d size=%d", header.type, header.size);
+            auto err = chain.read(nullptr, header.size);
+            if (err < 0) {
+                return err;
+            }
         }
     }
 
@@ -56,9 +105,21 @@ int32_t flat_attribute_storage::read(tree_ptr_t &ptr, file_id_t /*id*/, open_fil
 
 int32_t flat_attribute_storage::update(tree_ptr_t &ptr, file_id_t /*id*/, open_file_attribute *attributes,
                                        size_t nattrs) {
+    // Nothing to save, don't create storage just to keep it empty.
+    if (nattrs == 0 && !ptr.valid()) {
+        return 0;
+    }
+
     auto attribute_size = 0u;
+    auto snapshot_size = 0u;
+    auto dirty_size = 0u;
     for (auto i = 0u; i < nattrs; ++i) {
-        attribute_size += attributes[i].size;
+        auto &attr = attributes[i];
+        attribute_size += attr.size;
+        snapshot_size += sizeof(attribute_header_t) + attr.size;
+        if (attr.dirty) {
+            dirty_size += sizeof(attribute_header_t) + attr.size;
+        }
     }
 
     assert(attribute_size <= AttributeCapacity);
@@ -69,40 +130,94 @@ int32_t flat_attribute_storage::update(tree_ptr_t &ptr, file_id_t /*id*/, open_f
 
     data_chain chain{ pc(), head_tail };
 
+    // Existing chains are a log, only dirty attributes are appended and
+    // the last entry for a type wins when reading. Once the log would be
+    // CompactionFactor times a full snapshot it's rewritten as one.
+    auto compacting = true;
     if (!ptr.valid()) {
         auto err = chain.create_if_necessary();
         if (err < 0) {
             return err;
         }
+    } else {
+        if (dirty_size == 0) {
+            return 0;
+        }
+
+        auto logged = chain.total_bytes();
+        compacting = logged + dirty_size > snapshot_size * CompactionFactor;
+
+        phyverbosef("attributes logged=%zu dirty=%zu compacting=%d", logged, dirty_size, compacting);
     }
 
     auto buffer = buffers_->allocate(buffers_->buffer_size());
 
+    // Callers may pass only some of the attributes, so a compacted
+    // snapshot starts from what's logged and the attributes given here
+    // are laid over that, the last writer for each type winning.
+    if (compacting && ptr.valid()) {
+        data_chain logged{ pc(), head_tail };
+
+        while (true) {
+            attribute_header_t header;
+
+            auto err = logged.read((uint8_t *)&header, sizeof(attribute_header_t));
+            if (err < 0) {
+                return err;
+            }
+            if (err != sizeof(attribute_header_t)) {
+                break;
+            }
+
+            auto value = find_or_append(buffer, header.type, header.size);
+            if (value == nullptr) {
+                phyerrorf("attributes overflow");
+                return -1;
+            }
+
+            err = logged.read(value, header.size);
+            if (err < 0) {
+                return err;
+            }
+        }
+    }
+
     auto wrote = 0u;
     for (auto i = 0u; i < nattrs; ++i) {
         auto &attr = attributes[i];
+        if (!compacting && !attr.dirty) {
+            continue;
+        }
 
-        attribute_header_t header;
-        header.type = attr.type;
-        header.size = attr.size;
+        auto value = find_or_append(buffer, attr.type, attr.size);
+        if (value == nullptr) {
+            phyerrorf("attributes overflow");
+            return -1;
+        }
+
+        memcpy(value, attr.ptr, attr.size);
+    }
 
-        auto err = buffer.write((uint8_t *)&header, sizeof(attribute_header_t));
+    if (compacting) {
+        auto err = chain.truncate(buffer.ptr(), buffer.position());
         if (err < 0) {
             return err;
         }
 
-        err = buffer.write((uint8_t *)attr.ptr, attr.size);
+        wrote += err;
+    } else {
+        auto err = chain.write(buffer.ptr(), buffer.position());
         if (err < 0) {
             return err;
         }
-    }
 
-    auto err = chain.truncate(buffer.ptr(), buffer.position());
-    if (err < 0) {
-        return err;
-    }
+        wrote += err;
 
-    wrote += err;
+        err = chain.flush();
+        if (err < 0) {
+            return err;
+        }
+    }
 
     ptr = tree_ptr_t{ chain.head(), chain.tail() };
 
@@ -111,4 +226,8 @@ int32_t flat_attribute_storage::update(tree_ptr_t &ptr, file_id_t /*id*/, open_f
     return wrote;
 }
 
+int32_t flat_attribute_storage::reclaim(tree_ptr_t ptr, free_sectors_chain &reclaimed) {
+    return reclaimed.add_chain(ptr.root);
+}
+
 } // namespace phylum
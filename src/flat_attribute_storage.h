@@ -6,12 +6,14 @@
 #include "working_buffers.h"
 #include "phyctx.h"
 #include "directory.h"
+#include "free_sectors_chain.h"
 
 namespace phylum {
 
 class flat_attribute_storage {
 public:
     static constexpr size_t AttributeCapacity = 4000;
+    static constexpr size_t CompactionFactor = 2;
 
 private:
     working_buffers *buffers_{ nullptr };
@@ -24,6 +26,7 @@ public:
 public:
     int32_t read(tree_ptr_t &ptr, file_id_t id, open_file_config file_cfg);
     int32_t update(tree_ptr_t &ptr, file_id_t id, open_file_attribute *attributes, size_t nattrs);
+    int32_t reclaim(tree_ptr_t ptr, free_sectors_chain &reclaimed);
 
 private:
     phyctx pc() const {
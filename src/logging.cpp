@@ -5,38 +5,10 @@
 
 namespace phylum {
 
-void phyinfof(const char *f, ...) {
+void phylogf(LogLevels level, const char *f, ...) {
     va_list args;
     va_start(args, f);
-    valogf(LogLevels::INFO, "phylum", f, args);
-    va_end(args);
-}
-
-void phyerrorf(const char *f, ...) {
-    va_list args;
-    va_start(args, f);
-    valogf(LogLevels::ERROR, "phylum", f, args);
-    va_end(args);
-}
-
-void phyverbosef(const char *f, ...) {
-    va_list args;
-    va_start(args, f);
-    valogf(LogLevels::VERBOSE, "phylum", f, args);
-    va_end(args);
-}
-
-void phydebugf(const char *f, ...) {
-    va_list args;
-    va_start(args, f);
-    valogf(LogLevels::DEBUG, "phylum", f, args);
-    va_end(args);
-}
-
-void phywarnf(const char *f, ...) {
-    va_list args;
-    va_start(args, f);
-    valogf(LogLevels::WARN, "phylum", f, args);
+    valogf(level, "phylum", f, args);
     va_end(args);
 }
 
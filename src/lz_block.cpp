@@ -0,0 +1,207 @@
+#include "phylum.h"
+#include "lz_block.h"
+
+#if !defined(PHYLUM_LZ_HASH_BITS)
+#if defined(__AVR__) || defined(__ARM_ARCH_6M__)
+#define PHYLUM_LZ_HASH_BITS 7
+#else
+#define PHYLUM_LZ_HASH_BITS 9
+#endif
+#endif
+
+namespace phylum {
+
+// These come from the LZ4 block format, the last match has to start 12
+// bytes before the end and the last 5 bytes are always literals.
+static constexpr size_t LzMinimumMatch = 4;
+static constexpr size_t LzLastLiterals = 5;
+static constexpr size_t LzMatchLimit = 12;
+static constexpr uint32_t LzHashBits = PHYLUM_LZ_HASH_BITS;
+static constexpr uint16_t LzEmpty = 0xffff;
+
+static inline uint32_t lz_read32(uint8_t const *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t lz_hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - LzHashBits);
+}
+
+static inline size_t lz_length_bytes(size_t length) {
+    return length >= 15 ? (length - 15) / 255 + 1 : 0;
+}
+
+static inline uint8_t *lz_write_length(uint8_t *op, size_t length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8_t)length;
+    return op;
+}
+
+/**
+ * Writes one sequence, a match_length of 0 means this is the final
+ * sequence and is only literals.
+ */
+static bool lz_sequence(uint8_t *&op, uint8_t const *end, uint8_t const *literals, size_t nliterals, size_t offset,
+                        size_t match_length) {
+    auto needed = 1 + lz_length_bytes(nliterals) + nliterals;
+    if (match_length > 0) {
+        needed += 2 + lz_length_bytes(match_length - LzMinimumMatch);
+    }
+    if ((size_t)(end - op) < needed) {
+        return false;
+    }
+
+    auto token = op++;
+    if (nliterals >= 15) {
+        *token = 15 << 4;
+        op = lz_write_length(op, nliterals - 15);
+    } else {
+        *token = (uint8_t)(nliterals << 4);
+    }
+
+    memcpy(op, literals, nliterals);
+    op += nliterals;
+
+    if (match_length > 0) {
+        *op++ = (uint8_t)(offset & 0xff);
+        *op++ = (uint8_t)(offset >> 8);
+
+        auto length = match_length - LzMinimumMatch;
+        if (length >= 15) {
+            *token |= 15;
+            op = lz_write_length(op, length - 15);
+        } else {
+            *token |= (uint8_t)length;
+        }
+    }
+
+    return true;
+}
+
+int32_t lz_compress(uint8_t const *source, size_t size, uint8_t *destination, size_t capacity) {
+    if (size > LzMaximumInput) {
+        return -1;
+    }
+
+    auto op = destination;
+    auto end = destination + capacity;
+    auto anchor = (size_t)0;
+
+    if (size > LzMatchLimit) {
+        uint16_t table[1 << LzHashBits];
+        memset(table, 0xff, sizeof(table));
+
+        auto match_end = size - LzLastLiterals;
+        auto ip = (size_t)0;
+
+        while (ip + LzMatchLimit < size) {
+            auto sequence = lz_read32(source + ip);
+            auto hash = lz_hash(sequence);
+            auto candidate = table[hash];
+            table[hash] = (uint16_t)ip;
+
+            if (candidate == LzEmpty || lz_read32(source + candidate) != sequence) {
+                // Step faster through data that isn't matching.
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            auto length = LzMinimumMatch;
+            while (ip + length < match_end && source[candidate + length] == source[ip + length]) {
+                length++;
+            }
+
+            if (!lz_sequence(op, end, source + anchor, ip - anchor, ip - candidate, length)) {
+                return -1;
+            }
+
+            ip += length;
+            anchor = ip;
+
+            table[lz_hash(lz_read32(source + ip - 2))] = (uint16_t)(ip - 2);
+        }
+    }
+
+    if (!lz_sequence(op, end, source + anchor, size - anchor, 0, 0)) {
+        return -1;
+    }
+
+    return op - destination;
+}
+
+static int32_t lz_read_length(uint8_t const *source, size_t size, size_t &ip, size_t &length) {
+    uint8_t byte;
+    do {
+        if (ip >= size) {
+            return -1;
+        }
+        byte = source[ip++];
+        length += byte;
+    } while (byte == 255);
+    return 0;
+}
+
+int32_t lz_decompress(uint8_t const *source, size_t size, uint8_t *destination, size_t capacity) {
+    auto ip = (size_t)0;
+    auto op = (size_t)0;
+
+    while (ip < size) {
+        auto token = source[ip++];
+
+        size_t nliterals = token >> 4;
+        if (nliterals == 15 && lz_read_length(source, size, ip, nliterals) < 0) {
+            return -1;
+        }
+        if (nliterals > size - ip || nliterals > capacity - op) {
+            return -1;
+        }
+
+        memcpy(destination + op, source + ip, nliterals);
+        ip += nliterals;
+        op += nliterals;
+
+        // Final sequence has no match.
+        if (ip == size) {
+            break;
+        }
+
+        if (size - ip < 2) {
+            return -1;
+        }
+
+        size_t offset = source[ip] | (source[ip + 1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) {
+            return -1;
+        }
+
+        size_t length = token & 0xf;
+        if (length == 15 && lz_read_length(source, size, ip, length) < 0) {
+            return -1;
+        }
+        length += LzMinimumMatch;
+        if (length > capacity - op) {
+            return -1;
+        }
+
+        // Matches may overlap what they're producing.
+        auto from = destination + op - offset;
+        if (offset >= length) {
+            memcpy(destination + op, from, length);
+        } else {
+            for (auto i = 0u; i < length; ++i) {
+                destination[op + i] = from[i];
+            }
+        }
+        op += length;
+    }
+
+    return op;
+}
+
+} // namespace phylum
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cinttypes>
+#include <cstdlib>
+
+namespace phylum {
+
+/**
+ * Largest input lz_compress accepts, match positions are kept as 16
+ * bits to keep the hash table small.
+ */
+constexpr size_t LzMaximumInput = 0xfffe;
+
+/**
+ * Compresses to the LZ4 block format. Returns the compressed size or
+ * -1 if the output would be larger than capacity, callers are expected
+ * to store the data as is when that happens.
+ */
+int32_t lz_compress(uint8_t const *source, size_t size, uint8_t *destination, size_t capacity);
+
+/**
+ * Decompresses an LZ4 block. Returns the decompressed size or -1 if the
+ * block is malformed or would overflow capacity.
+ */
+int32_t lz_decompress(uint8_t const *source, size_t size, uint8_t *destination, size_t capacity);
+
+} // namespace phylum
@@ -4,6 +4,7 @@
 
 #include "sector_map.h"
 #include "phylum.h"
+#include "trace.h"
 
 namespace phylum {
 
@@ -34,6 +35,7 @@ public:
     }
 
     int32_t trim(dhara_sector_t sector) override {
+        trace_event(trace_kind::SectorTrim, sector);
         if (map_[sector] != nullptr) {
             free(map_[sector]);
             map_[sector] = nullptr;
@@ -55,6 +57,7 @@ public:
         if (map_[sector] != nullptr) {
             free(map_[sector]);
         }
+        trace_event(trace_kind::SectorWrite, sector);
         map_[sector] = (uint8_t *)malloc(sector_size_);
         memcpy(map_[sector], data, size);
         phydebugf("dhara: write #%d", sector);
@@ -65,6 +68,7 @@ public:
         assert(sector != UINT32_MAX);
         assert(size <= sector_size_);
         phydebugf("dhara: read #%d", sector);
+        trace_event(trace_kind::SectorRead, sector);
         if (map_[sector] != nullptr) {
             memcpy(data, map_[sector], size);
             return 0;
@@ -76,6 +76,16 @@ bool simple_page_cache::set(dhara_sector_t sector, dhara_page_t page) {
     return true;
 }
 
+void simple_page_cache::invalidate(dhara_page_t first, dhara_page_t npages) {
+    for (auto i = 0u; i < size_; ++i) {
+        auto &e = entries_[i];
+        if (e.sector != InvalidSector && e.page >= first && e.page < first + npages) {
+            phyverbosef("page-cache-invalidate sector=%d page=%d", e.sector, e.page);
+            e.sector = InvalidSector;
+        }
+    }
+}
+
 void simple_page_cache::debug() {
     phyinfof("page-cache size=%zu", size_);
     for (auto i = 0u; i < size_; ++i) {
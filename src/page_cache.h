@@ -16,6 +16,8 @@ class sector_page_cache {
 public:
     virtual bool get(dhara_sector_t sector, dhara_page_t *page) = 0;
     virtual bool set(dhara_sector_t sector, dhara_page_t page) = 0;
+    /** Forgets sectors cached in pages [first, first + npages), after an erase. */
+    virtual void invalidate(dhara_page_t first, dhara_page_t npages) = 0;
 
 };
 
@@ -29,6 +31,9 @@ public:
         return true;
     }
 
+    void invalidate(dhara_page_t /*first*/, dhara_page_t /*npages*/) override {
+    }
+
     void debug() {
     }
 };
@@ -53,6 +58,7 @@ public:
 public:
     bool get(dhara_sector_t sector, dhara_page_t *page) override;
     bool set(dhara_sector_t sector, dhara_page_t page) override;
+    void invalidate(dhara_page_t first, dhara_page_t npages) override;
     void debug();
 
 private:
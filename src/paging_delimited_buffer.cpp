@@ -1,6 +1,7 @@
 #include <string.h>
 
 #include "paging_delimited_buffer.h"
+#include "trace.h"
 
 namespace phylum {
 
@@ -109,8 +110,11 @@ int32_t paging_delimited_buffer::replace(dhara_sector_t sector, bool read_only,
         return 0;
     }
 
-    auto miss_fn = [this, overwrite](dhara_sector_t page_sector, uint8_t *buffer, size_t size) -> int32_t {
+    auto hit = true;
+
+    auto miss_fn = [this, overwrite, &hit](dhara_sector_t page_sector, uint8_t *buffer, size_t size) -> int32_t {
         assert(size > 0);
+        hit = false;
         if (overwrite) {
             phyverbosef("page-lock: overwriting %d", page_sector);
             return 0;
@@ -140,6 +144,15 @@ int32_t paging_delimited_buffer::replace(dhara_sector_t sector, bool read_only,
 
     ptr(opened, buffers_->buffer_size());
 
+    auto flags = (uint8_t)(read_only ? trace_flags::Reading : trace_flags::Writing);
+    if (overwrite) {
+        flags |= (uint8_t)trace_flags::Overwrite;
+    }
+    if (hit) {
+        flags |= (uint8_t)trace_flags::Hit;
+    }
+    trace_event(trace_kind::PageOpen, sector, flags);
+
     phyverbosef("page-lock: replaced previous=%d sector=%d buffer=0x%x read-only=%d", sector_, sector, opened, read_only);
 
     sector_ = sector;
@@ -157,6 +170,8 @@ int32_t paging_delimited_buffer::flush(dhara_sector_t sector) {
         return sectors_->write(page_sector, buffer, size);
     };
 
+    trace_event(trace_kind::PageFlush, sector);
+
     auto err = buffers_->flush_sector(sector, flush_fn);
     if (err < 0) {
         return err;
@@ -24,10 +24,12 @@ public:
     friend class sector_chain;
     friend class file_appender;
     friend class file_reader;
+    friend class tree_journal;
 
     template <typename KEY, typename VALUE, size_t Size>
     friend class tree_sector;
-    friend class directory_tree;
+    template <size_t InlineCapacity, typename AttributeStorage>
+    friend class basic_directory_tree;
 
     friend class tree_attribute_storage;
     friend class flat_attribute_storage;
@@ -11,8 +11,42 @@
 
 #if defined(PHYLUM_LOCAL_EXCHANGE)
 #include <exchange.h>
+#else
+#include <utility>
 #endif
 
+/**
+ * Messages below this level are compiled away, their arguments are
+ * never evaluated. The rest are still checked against the runtime log
+ * level before any formatting happens. Values follow LogLevels.
+ */
+#define PHYLUM_LOG_LEVEL_VERBOSE 0
+#define PHYLUM_LOG_LEVEL_TRACE   1
+#define PHYLUM_LOG_LEVEL_DEBUG   2
+#define PHYLUM_LOG_LEVEL_INFO    3
+#define PHYLUM_LOG_LEVEL_WARN    4
+#define PHYLUM_LOG_LEVEL_ERROR   5
+#define PHYLUM_LOG_LEVEL_NONE    6
+
+#if !defined(PHYLUM_LOG_LEVEL)
+#define PHYLUM_LOG_LEVEL PHYLUM_LOG_LEVEL_VERBOSE
+#endif
+
+// Disabled levels keep the call inside a dead branch so the arguments
+// are still type checked and count as used.
+#define PHYLUM_LOG_AT(enabled, level, ...)                                      \
+    do {                                                                       \
+        if ((enabled) && phylum::phylog_enabled(level)) {                      \
+            phylum::phylogf(level, __VA_ARGS__);                               \
+        }                                                                      \
+    } while (0)
+
+#define phyverbosef(...) PHYLUM_LOG_AT(PHYLUM_LOG_LEVEL <= PHYLUM_LOG_LEVEL_VERBOSE, LogLevels::VERBOSE, __VA_ARGS__)
+#define phydebugf(...) PHYLUM_LOG_AT(PHYLUM_LOG_LEVEL <= PHYLUM_LOG_LEVEL_DEBUG, LogLevels::DEBUG, __VA_ARGS__)
+#define phyinfof(...) PHYLUM_LOG_AT(PHYLUM_LOG_LEVEL <= PHYLUM_LOG_LEVEL_INFO, LogLevels::INFO, __VA_ARGS__)
+#define phywarnf(...) PHYLUM_LOG_AT(PHYLUM_LOG_LEVEL <= PHYLUM_LOG_LEVEL_WARN, LogLevels::WARN, __VA_ARGS__)
+#define phyerrorf(...) PHYLUM_LOG_AT(PHYLUM_LOG_LEVEL <= PHYLUM_LOG_LEVEL_ERROR, LogLevels::ERROR, __VA_ARGS__)
+
 namespace phylum {
 
 static inline int32_t phy_vsnprintf(char *buffer, size_t size, const char *f, va_list args) {
@@ -23,15 +57,13 @@ uint32_t crc32_checksum(const char *str);
 
 uint32_t crc32_checksum(const uint8_t *data, size_t size);
 
-void phyinfof(const char *f, ...);
+uint32_t crc32_checksum(uint32_t previous, const uint8_t *data, size_t size);
 
-void phydebugf(const char *f, ...);
+void phylogf(LogLevels level, const char *f, ...);
 
-void phyerrorf(const char *f, ...);
-
-void phywarnf(const char *f, ...);
-
-void phyverbosef(const char *f, ...);
+static inline bool phylog_enabled(LogLevels level) {
+    return (uint8_t)level >= log_get_level();
+}
 
 void phygraphf(const char *f, ...);
 
@@ -71,7 +71,7 @@ int32_t record_chain::prepare(page_lock &page_lock, size_t required) {
 }
 
 int32_t record_chain::grow_if_necessary(page_lock &page_lock, size_t required) {
-    auto delimiter_overhead = varint_encoding_length(required);
+    auto delimiter_overhead = varint_encoding_length32(required);
     auto total_required = delimiter_overhead + required;
     if (db().room_for(total_required)) {
         return 0;
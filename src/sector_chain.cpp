@@ -158,7 +158,7 @@ int32_t sector_chain::prepare_sector(page_lock &lock, dhara_sector_t previous_se
     assert(db().write_header<sector_chain_header_t>([&](sector_chain_header_t *header) {
         header->pp = previous_sector;
         header->np = following_sector;
-        header->flags = sector_flags::Tail;
+        header->flags = (sector_flags)((int32_t)header->flags | (int32_t)sector_flags::Tail);
         return 0;
     }) == 0);
 
@@ -348,7 +348,7 @@ int32_t sector_chain::grow_tail(page_lock &lock) {
             else {
                 allocated = false;
             }
-            header->flags = sector_flags::None;
+            header->flags = (sector_flags)((int32_t)header->flags & ~(int32_t)sector_flags::Tail);
             following_sector = header->np;
             return 0;
         }) == 0);
@@ -262,7 +262,9 @@ public:
     }
 
     int32_t constrain(size_t bytes) {
-        assert(bytes <= size_);
+        if (bytes > size_) {
+            return -1;
+        }
         size_ = bytes;
         return 0;
     }
@@ -272,13 +274,12 @@ public:
             return false;
         }
 
-        int32_t err = -1;
-        size = (uint32_t)varint_decode(ptr_ + position_, size_ - position_, &err);
-        if (err < 0) {
+        auto nread = varint_decode32(ptr_ + position_, size_ - position_, &size);
+        if (nread < 0) {
             return false;
         }
 
-        position_ += varint_encoding_length(size);
+        position_ += nread;
 
         return true;
     }
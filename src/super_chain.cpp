@@ -11,8 +11,14 @@ int32_t super_chain::mount() {
     }
 
     auto hdr = db().header<super_block_t>();
+    if (hdr->version != SuperBlockVersion) {
+        phyerrorf("super-block version=%d expected=%d", hdr->version, SuperBlockVersion);
+        return -1;
+    }
 
     directory_tree_ = hdr->directory_tree;
+    free_chain_ = hdr->free_chain;
+    inline_capacity_ = hdr->inline_capacity;
 
     return 0;
 }
@@ -29,6 +35,10 @@ int32_t super_chain::format() {
 }
 
 int32_t super_chain::update(tree_ptr_t directory_tree) {
+    return update(directory_tree, free_chain_);
+}
+
+int32_t super_chain::update(tree_ptr_t directory_tree, head_tail_t free_chain) {
     auto page_lock = db().writing(head());
     auto modified = false;
 
@@ -37,9 +47,16 @@ int32_t super_chain::update(tree_ptr_t directory_tree) {
             header->directory_tree = directory_tree;
             modified = true;
         }
+        if (header->free_chain != free_chain) {
+            header->free_chain = free_chain;
+            modified = true;
+        }
         return 0;
     }) == 0);
 
+    directory_tree_ = directory_tree;
+    free_chain_ = free_chain;
+
     if (modified) {
         phyinfof("saving super block");
 
@@ -51,6 +68,23 @@ int32_t super_chain::update(tree_ptr_t directory_tree) {
     return 0;
 }
 
+int32_t super_chain::format_directory(tree_ptr_t directory_tree, uint16_t inline_capacity) {
+    auto page_lock = db().writing(head());
+
+    assert(db().write_header<super_block_t>([&](super_block_t *header) {
+        header->directory_tree = directory_tree;
+        header->inline_capacity = inline_capacity;
+        return 0;
+    }) == 0);
+
+    directory_tree_ = directory_tree;
+    inline_capacity_ = inline_capacity;
+
+    page_lock.dirty();
+
+    return flush(page_lock);
+}
+
 int32_t super_chain::write_header(page_lock &page_lock) {
     db().emplace<super_block_t>();
 
@@ -7,6 +7,8 @@ namespace phylum {
 class super_chain : public record_chain {
 private:
     tree_ptr_t directory_tree_;
+    head_tail_t free_chain_;
+    uint16_t inline_capacity_{ UINT16_MAX };
 
 public:
     super_chain(phyctx pc, dhara_sector_t head) : record_chain(pc, head_tail_t{ head, InvalidSector }, "super-chain") {
@@ -19,11 +21,35 @@ public:
 
     int32_t update(tree_ptr_t directory_tree);
 
+    int32_t update(tree_ptr_t directory_tree, head_tail_t free_chain);
+
+    /**
+     * Saves a newly formatted directory tree along with the number of
+     * bytes of each file it keeps inline.
+     */
+    int32_t format_directory(tree_ptr_t directory_tree, uint16_t inline_capacity);
+
 public:
     tree_ptr_t directory_tree() const {
         return directory_tree_;
     }
 
+    /**
+     * Sectors given back by unlinking, invalid until the first unlink
+     * creates the chain.
+     */
+    head_tail_t free_chain() const {
+        return free_chain_;
+    }
+
+    /**
+     * Inline capacity the directory tree was formatted with, UINT16_MAX
+     * before it's formatted.
+     */
+    uint16_t inline_capacity() const {
+        return inline_capacity_;
+    }
+
 protected:
     int32_t write_header(page_lock &page_lock) override;
 
@@ -0,0 +1,95 @@
+#if defined(__linux__)
+#include <time.h>
+#endif
+
+#include "trace.h"
+#include "writer.h"
+
+namespace phylum {
+
+bool trace_enabled{ false };
+
+struct trace_state_t {
+    trace_event_t *events{ nullptr };
+    uint32_t size{ 0 };
+    uint32_t recorded{ 0 };
+    trace_clock_fn_t clock{ nullptr };
+    trace_operation operation{ trace_operation::None };
+    uint8_t depth{ 0 };
+};
+
+static trace_state_t trace_state;
+
+static uint32_t trace_default_clock() {
+#if defined(__linux__)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+#else
+    return 0;
+#endif
+}
+
+void trace_configure(trace_event_t *events, size_t size, trace_clock_fn_t clock) {
+    trace_state = trace_state_t{};
+    trace_state.events = events;
+    trace_state.size = events == nullptr ? 0 : size;
+    trace_state.clock = clock == nullptr ? trace_default_clock : clock;
+    trace_enabled = trace_state.size > 0;
+}
+
+void trace_record(trace_kind kind, dhara_sector_t sector, uint8_t flags) {
+    auto &event = trace_state.events[trace_state.recorded % trace_state.size];
+    event.time = trace_state.clock();
+    event.sector = sector;
+    event.kind = kind;
+    event.operation = trace_state.operation;
+    event.flags = flags;
+    event.depth = trace_state.depth;
+    trace_state.recorded++;
+}
+
+void trace_begin(trace_operation operation, trace_operation &previous) {
+    previous = trace_state.operation;
+    trace_state.operation = operation;
+    trace_state.depth++;
+    trace_record(trace_kind::Begin, InvalidSector, 0);
+}
+
+void trace_end(trace_operation previous) {
+    // Ending a scope begun before tracing was reconfigured.
+    if (!trace_enabled || trace_state.depth == 0) {
+        return;
+    }
+
+    trace_record(trace_kind::End, InvalidSector, 0);
+    trace_state.operation = previous;
+    trace_state.depth--;
+}
+
+int32_t trace_write(io_writer &writer) {
+    auto size = trace_state.size;
+    auto recorded = trace_state.recorded;
+    auto available = recorded < size ? recorded : size;
+
+    trace_header_t header;
+    header.number_events = available;
+    header.dropped = recorded - available;
+
+    auto err = writer.write((uint8_t const *)&header, sizeof(header));
+    if (err < 0) {
+        return err;
+    }
+
+    for (auto i = recorded - available; i != recorded; ++i) {
+        auto &event = trace_state.events[i % size];
+        err = writer.write((uint8_t const *)&event, sizeof(event));
+        if (err < 0) {
+            return err;
+        }
+    }
+
+    return available;
+}
+
+} // namespace phylum
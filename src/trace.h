@@ -0,0 +1,132 @@
+#pragma once
+
+#include "phylum.h"
+
+namespace phylum {
+
+class io_writer;
+
+/**
+ * Binary trace of what the filesystem did to flash, cheap enough to
+ * leave compiled in. Events go into a fixed ring of trace_event_t that
+ * the caller provides, overwriting the oldest, and trace_write dumps
+ * them for tools/phytrace to decode. When tracing isn't configured
+ * recording an event costs a single branch.
+ */
+enum class trace_kind : uint8_t {
+    None = 0,
+    Begin,
+    End,
+    PageOpen,
+    PageFlush,
+    SectorRead,
+    SectorWrite,
+    SectorTrim,
+    TreeDescend,
+};
+
+/**
+ * The filesystem operation an event happened during, nested operations
+ * are attributed to the innermost one.
+ */
+enum class trace_operation : uint8_t {
+    None = 0,
+    Touch,
+    Find,
+    Unlink,
+    Mkdir,
+    Write,
+    Flush,
+    Close,
+    Read,
+    SeekPosition,
+    SeekRecord,
+    Index,
+};
+
+enum class trace_flags : uint8_t {
+    None = 0,
+    Reading = 1 << 0,
+    Writing = 1 << 1,
+    Overwrite = 1 << 2,
+    Hit = 1 << 3,
+};
+
+struct PHY_PACKED trace_event_t {
+    uint32_t time{ 0 };
+    dhara_sector_t sector{ InvalidSector };
+    trace_kind kind{ trace_kind::None };
+    trace_operation operation{ trace_operation::None };
+    uint8_t flags{ 0 };
+    uint8_t depth{ 0 };
+};
+
+struct PHY_PACKED trace_header_t {
+    static constexpr uint32_t Magic = 0x63727470; // 'ptrc'
+    static constexpr uint16_t Version = 1;
+
+    uint32_t magic{ Magic };
+    uint16_t version{ Version };
+    uint16_t event_size{ sizeof(trace_event_t) };
+    uint32_t number_events{ 0 };
+    uint32_t dropped{ 0 };
+};
+
+/**
+ * Returns ticks for event timestamps, a cycle counter on hardware. Only
+ * differences between ticks are used so wrapping is fine.
+ */
+typedef uint32_t (*trace_clock_fn_t)();
+
+/**
+ * Starts recording into events, or stops when events is null. Without a
+ * clock the host's monotonic clock in microseconds is used.
+ */
+void trace_configure(trace_event_t *events, size_t size, trace_clock_fn_t clock = nullptr);
+
+/**
+ * Writes a trace_header_t and then the recorded events, oldest first.
+ */
+int32_t trace_write(io_writer &writer);
+
+extern bool trace_enabled;
+
+void trace_record(trace_kind kind, dhara_sector_t sector, uint8_t flags);
+
+static inline void trace_event(trace_kind kind, dhara_sector_t sector, uint8_t flags = 0) {
+    if (__builtin_expect(trace_enabled, 0)) {
+        trace_record(kind, sector, flags);
+    }
+}
+
+void trace_begin(trace_operation operation, trace_operation &previous);
+
+void trace_end(trace_operation previous);
+
+/**
+ * Records the beginning and end of an operation, so events in between
+ * can be attributed to it.
+ */
+class trace_scope {
+private:
+    trace_operation previous_{ trace_operation::None };
+    bool active_{ false };
+
+public:
+    trace_scope(trace_operation operation) {
+        if (__builtin_expect(trace_enabled, 0)) {
+            trace_begin(operation, previous_);
+            active_ = true;
+        }
+    }
+
+    trace_scope(trace_scope const &other) = delete;
+
+    ~trace_scope() {
+        if (__builtin_expect(active_, 0)) {
+            trace_end(previous_);
+        }
+    }
+};
+
+} // namespace phylum
@@ -4,6 +4,9 @@ namespace phylum {
 
 int32_t tree_attribute_storage::read(tree_ptr_t &ptr, file_id_t /*id*/, open_file_config file_cfg) {
     attr_tree_type tree{ phyctx{ *buffers_, *sectors_, *allocator_ }, ptr, "attrs" };
+
+    // Each attribute is a single descent, no matter how many others the
+    // file has.
     for (auto i = 0u; i < file_cfg.nattrs; ++i) {
         auto &attr = file_cfg.attributes[i];
         attr_node_type attr_node;
@@ -12,6 +15,9 @@ int32_t tree_attribute_storage::read(tree_ptr_t &ptr, file_id_t /*id*/, open_fil
         if (err < 0) {
             return err;
         }
+        if (err == 0) {
+            continue;
+        }
 
         assert(attr.size <= AttributeCapacity);
         memcpy(attr.ptr, attr_node.data, attr.size);
@@ -21,6 +27,11 @@ int32_t tree_attribute_storage::read(tree_ptr_t &ptr, file_id_t /*id*/, open_fil
 }
 
 int32_t tree_attribute_storage::update(tree_ptr_t &ptr, file_id_t /*id*/, open_file_attribute *attributes, size_t nattrs) {
+    // Nothing to save, don't create storage just to keep it empty.
+    if (nattrs == 0 && !ptr.valid()) {
+        return 0;
+    }
+
     auto attribute_size = 0u;
     for (auto i = 0u; i < nattrs; ++i) {
         assert(attributes[i].size <= AttributeCapacity);
@@ -46,8 +57,13 @@ int32_t tree_attribute_storage::update(tree_ptr_t &ptr, file_id_t /*id*/, open_f
         }
     }
 
+    // Only dirty attributes need writing once the tree exists.
     for (auto i = 0u; i < nattrs; ++i) {
         auto &attr = attributes[i];
+        if (!create && !attr.dirty) {
+            continue;
+        }
+
         attr_node_type node{ attr.ptr, attr.size };
         auto err = tree.add(attr.type, &node, nullptr);
         if (err < 0) {
@@ -32,7 +32,8 @@ class tree_attribute_storage {
 public:
     static constexpr size_t AttributeCapacity = 256;
     using attr_node_type = attribute_value_t<AttributeCapacity>;
-    using attr_tree_type = tree_sector<uint32_t, attr_node_type, 15>;
+    // Small enough that a node fits in a 2048 byte sector.
+    using attr_tree_type = tree_sector<uint32_t, attr_node_type, 6>;
 
 private:
     working_buffers *buffers_{ nullptr };
@@ -46,6 +47,10 @@ public:
 public:
     int32_t read(tree_ptr_t &ptr, file_id_t id, open_file_config file_cfg);
     int32_t update(tree_ptr_t &ptr, file_id_t id, open_file_attribute *attributes, size_t nattrs);
+
+    int32_t reclaim(tree_ptr_t ptr, free_sectors_chain &reclaimed) {
+        return reclaimed.add_tree(ptr);
+    }
 };
 
 } // namespace phylum
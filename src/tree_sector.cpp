@@ -4,5 +4,214 @@
 
 namespace phylum {
 
+bool tree_journal::written(node_ptr_t ptr) const {
+    for (auto i = 0u; i < nwritten_; ++i) {
+        if (written_[i] == ptr) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void tree_journal::wrote(node_ptr_t ptr) {
+    // Nodes we can't remember are copied again the next time, which is
+    // wasteful but still safe.
+    if (nwritten_ < Capacity && !written(ptr)) {
+        written_[nwritten_++] = ptr;
+    }
+}
+
+void tree_journal::forget(node_ptr_t ptr) {
+    for (auto i = 0u; i < nwritten_; ++i) {
+        if (written_[i] == ptr) {
+            written_[i] = written_[--nwritten_];
+            return;
+        }
+    }
+}
+
+int32_t tree_journal::replaced(node_ptr_t ptr) {
+    for (auto i = 0u; i < nreplaced_; ++i) {
+        if (replaced_[i] == ptr) {
+            return 0;
+        }
+    }
+    if (nreplaced_ == Capacity) {
+        phyerrorf("tree-journal: full, publish before replacing %d:%d", ptr.sector, ptr.position);
+        return -1;
+    }
+    replaced_[nreplaced_++] = ptr;
+    return 0;
+}
+
+dhara_sector_t tree_journal::spare_root() {
+    if (nspare_roots_ == 0) {
+        return InvalidSector;
+    }
+    return spare_roots_[--nspare_roots_];
+}
+
+int32_t tree_journal::release(phyctx pc, free_sectors_chain *reclaimed) {
+    auto nreplaced = nreplaced_;
+
+    nwritten_ = 0;
+    nreplaced_ = 0;
+
+    for (auto i = 0u; i < nreplaced; ++i) {
+        auto sector = replaced_[i].sector;
+        if (sector == InvalidSector) {
+            continue;
+        }
+
+        auto emptied = true;
+        auto chained = true;
+
+        {
+            paging_delimited_buffer buffer{ pc.buffers_, pc.sectors_ };
+
+            auto lock = buffer.writing(sector);
+
+            auto hdr = buffer.header<sector_chain_header_t>();
+
+            // Roots of their own sector are freed on their own, others
+            // are taken out of the chain using the link to the newer
+            // sector before them, which the tail doesn't have.
+            chained = ((int32_t)hdr->flags & (int32_t)sector_flags::Root) == 0;
+            if (chained && hdr->pp == InvalidSector) {
+                emptied = false;
+            }
+
+            for (auto iter = buffer.begin(); iter != buffer.end(); ++iter) {
+                auto rp = *iter;
+                if (rp.as<entry_t>()->type != entry_type::TreeNode) {
+                    continue;
+                }
+
+                auto node = buffer.as_mutable<tree_node_header_t>(rp);
+
+                for (auto j = i; j < nreplaced; ++j) {
+                    if (replaced_[j].sector == sector && replaced_[j].position == rp.position()) {
+                        node->type = node_type::Free;
+                        node->number_keys = 0;
+                        lock.dirty();
+                    }
+                }
+
+                if (node->type != node_type::Free) {
+                    emptied = false;
+                }
+            }
+
+            for (auto j = i; j < nreplaced; ++j) {
+                if (replaced_[j].sector == sector) {
+                    replaced_[j].sector = InvalidSector;
+                }
+            }
+
+            auto err = lock.flush(sector);
+            if (err < 0) {
+                return err;
+            }
+        }
+
+        if (!emptied) {
+            continue;
+        }
+
+        phydebugf("tree-journal: sector emptied %d", sector);
+
+        if (!chained && nspare_roots_ < MaximumSpareRoots) {
+            spare_roots_[nspare_roots_++] = sector;
+            continue;
+        }
+
+        if (reclaimed == nullptr) {
+            continue;
+        }
+
+        if (chained) {
+            auto err = unlink(pc, sector);
+            if (err < 0) {
+                return err;
+            }
+        }
+
+        auto err = reclaimed->add_chain(sector);
+        if (err < 0) {
+            return err;
+        }
+    }
+
+    return 0;
+}
+
+int32_t tree_journal::unlink(phyctx pc, dhara_sector_t sector) {
+    paging_delimited_buffer buffer{ pc.buffers_, pc.sectors_ };
+
+    dhara_sector_t newer = InvalidSector;
+    dhara_sector_t older = InvalidSector;
+
+    {
+        auto lock = buffer.reading(sector);
+        auto hdr = buffer.header<sector_chain_header_t>();
+        newer = hdr->pp;
+        older = hdr->np;
+    }
+
+    assert(newer != InvalidSector);
+
+    {
+        auto lock = buffer.writing(newer);
+
+        auto hdr = buffer.header<sector_chain_header_t>();
+        if (hdr->np != sector) {
+            phyerrorf("tree-journal: sector %d not after %d", sector, newer);
+            return -1;
+        }
+
+        assert(buffer.write_header<sector_chain_header_t>([&](sector_chain_header_t *header) {
+            header->np = older;
+            return 0;
+        }) == 0);
+
+        lock.dirty();
+
+        auto err = lock.flush(newer);
+        if (err < 0) {
+            return err;
+        }
+    }
+
+    if (older != InvalidSector) {
+        auto lock = buffer.writing(older);
+
+        auto hdr = buffer.header<sector_chain_header_t>();
+        if (hdr->pp == sector) {
+            assert(buffer.write_header<sector_chain_header_t>([&](sector_chain_header_t *header) {
+                header->pp = newer;
+                return 0;
+            }) == 0);
+
+            lock.dirty();
+
+            auto err = lock.flush(older);
+            if (err < 0) {
+                return err;
+            }
+        }
+    }
+
+    auto lock = buffer.writing(sector);
+
+    assert(buffer.write_header<sector_chain_header_t>([&](sector_chain_header_t *header) {
+        header->pp = InvalidSector;
+        header->np = InvalidSector;
+        return 0;
+    }) == 0);
+
+    lock.dirty();
+
+    return lock.flush(sector);
+}
 
 } // namespace phylum
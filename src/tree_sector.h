@@ -1,11 +1,16 @@
 #pragma once
 
+#include <type_traits>
+
 #include "sector_map.h"
 #include "sector_allocator.h"
 #include "delimited_buffer.h"
 #include "working_buffers.h"
 #include "paging_delimited_buffer.h"
+#include "free_sectors_chain.h"
+#include "varint.h"
 #include "phyctx.h"
+#include "trace.h"
 
 namespace phylum {
 
@@ -35,21 +40,150 @@ public:
     }
 };
 
+/**
+ * Differences between consecutive keys or values, used when packing
+ * leaves. Only integers can be packed, other types always keep the
+ * fixed-size layout.
+ */
+template <typename T, bool Integral = std::is_integral<T>::value>
+struct tree_delta_codec {
+    static constexpr bool supported = false;
+
+    static bool encodable(T const &/*previous*/, T const &/*value*/) {
+        return false;
+    }
+
+    static unsigned long long delta(T const &/*previous*/, T const &/*value*/) {
+        return 0;
+    }
+
+    static T apply(T const &previous, unsigned long long /*delta*/) {
+        return previous;
+    }
+};
+
+template <typename T>
+struct tree_delta_codec<T, true> {
+    static constexpr bool supported = true;
+
+    static bool encodable(T const &previous, T const &value) {
+        return !(value < previous);
+    }
+
+    static unsigned long long delta(T const &previous, T const &value) {
+        return (unsigned long long)(value - previous);
+    }
+
+    static T apply(T const &previous, unsigned long long delta) {
+        return (T)(previous + delta);
+    }
+};
+
 struct tree_value_ptr_t {
     node_ptr_t node;
     index_type index;
 };
 
+/**
+ * Path from a tree's root to its rightmost leaf, kept between appends so
+ * they don't descend the tree every time.
+ */
+struct tree_rightmost_t {
+    static constexpr size_t MaximumDepth = 16;
+
+    node_ptr_t nodes[MaximumDepth];
+    int32_t height{ -1 };
+};
+
+/**
+ * Nodes touched by copy-on-write modifications since the tree was last
+ * published. Nodes written since then aren't reachable from the
+ * published tree, so they're modified in place, and the nodes they
+ * replaced are freed after the new root has been saved.
+ */
+class tree_journal {
+public:
+    // Copied paths between publishes, each writes and replaces at most
+    // one node per level. Replaced nodes that don't fit would leak their
+    // sectors, so running out fails the modification instead.
+    static constexpr size_t MaximumPaths = 12;
+    static constexpr size_t Capacity = tree_rightmost_t::MaximumDepth * MaximumPaths;
+    static constexpr size_t MaximumSpareRoots = 2;
+
+private:
+    node_ptr_t written_[Capacity];
+    size_t nwritten_{ 0 };
+    node_ptr_t replaced_[Capacity];
+    size_t nreplaced_{ 0 };
+    // Sectors of released roots, reused for the next roots instead of
+    // allocating. These are only kept in memory, so they're lost to a
+    // reset until the sectors are reclaimed some other way.
+    dhara_sector_t spare_roots_[MaximumSpareRoots];
+    size_t nspare_roots_{ 0 };
+
+public:
+    bool empty() const {
+        return nwritten_ == 0 && nreplaced_ == 0;
+    }
+
+    /**
+     * True once half the room for replaced nodes is used, publishing
+     * then leaves plenty for the modifications in progress.
+     */
+    bool filling() const {
+        return nreplaced_ > Capacity / 2;
+    }
+
+    bool room(size_t nodes) const {
+        return Capacity - nreplaced_ >= nodes;
+    }
+
+    bool written(node_ptr_t ptr) const;
+
+    void wrote(node_ptr_t ptr);
+
+    void forget(node_ptr_t ptr);
+
+    int32_t replaced(node_ptr_t ptr);
+
+    /**
+     * Returns a released root's sector for a new root, or InvalidSector
+     * when there aren't any.
+     */
+    dhara_sector_t spare_root();
+
+    /**
+     * Frees the replaced nodes, only call this once the tree they were
+     * replaced in has been saved. Sectors left without nodes are given
+     * to the free sectors chain, when there is one.
+     */
+    int32_t release(phyctx pc, free_sectors_chain *reclaimed);
+
+private:
+    int32_t unlink(phyctx pc, dhara_sector_t sector);
+
+};
+
 template <typename KEY, typename VALUE, size_t Size>
 class tree_sector {
 public:
     static constexpr size_t NodeSize = Size;
+    static constexpr index_type MinimumKeys = Size / 2;
     using key_type = KEY;
     using value_type = VALUE;
     using default_node_type = tree_node_t<KEY, VALUE, Size>;
+    // Inner nodes are stored without values, only their keys and
+    // children. The root is always stored in full because it changes
+    // from a leaf to an inner node.
+    static constexpr size_t InnerNodeSize = sizeof(default_node_type) - sizeof(typename default_node_type::data_t) + sizeof(node_ptr_t) * (Size + 1);
+    static constexpr size_t LeafNodeSize = sizeof(default_node_type);
+    // Full leaves that append moves past are packed when both keys and
+    // values are integers that never decrease, see seal_leaf.
+    static constexpr bool Packable = tree_delta_codec<KEY>::supported && tree_delta_codec<VALUE>::supported;
 
 private:
     static constexpr size_t ScopeNameLength = 32;
+    static constexpr size_t MaximumDepth = tree_rightmost_t::MaximumDepth;
 
     struct insertion_t {
         bool split{ false };
@@ -58,6 +192,34 @@ private:
         node_ptr_t right;
     };
 
+    struct bounds_t {
+        bool has_lower{ false };
+        bool has_upper{ false };
+        KEY lower{ 0 };
+        KEY upper{ 0 };
+    };
+
+    struct path_entry_t {
+        node_ptr_t ptr;
+        index_type index{ 0 };
+        bounds_t bounds;
+    };
+
+    struct emptied_t {
+        dhara_sector_t sectors[MaximumDepth];
+        size_t size{ 0 };
+
+        void add(dhara_sector_t sector) {
+            for (auto i = 0u; i < size; ++i) {
+                if (sectors[i] == sector) {
+                    return;
+                }
+            }
+            assert(size < MaximumDepth);
+            sectors[size++] = sector;
+        }
+    };
+
     struct persisted_node_t {
         default_node_type *node{ nullptr };
         node_ptr_t ptr{};
@@ -78,6 +240,14 @@ private:
     dhara_sector_t tail_{ InvalidSector };
     const char *prefix_{ "tree-sector" };
     char name_[ScopeNameLength];
+    // Any modification other than an append invalidates this.
+    tree_rightmost_t rightmost_;
+    // When enabled modifications never touch nodes of the last saved
+    // tree, the path to the modified leaf is copied into the tail
+    // sector and a replaced root gets a sector of its own. Until the
+    // new tree_ptr_t is saved the previous one is still a complete
+    // tree, after that the journal frees the nodes that were replaced.
+    tree_journal *journal_{ nullptr };
 
 public:
     tree_sector(phyctx pc, tree_ptr_t tree, const char *prefix = "tree")
@@ -103,6 +273,30 @@ public:
         return tree_ptr_t{ root_, tail_ };
     }
 
+    bool copy_on_write() const {
+        return journal_ != nullptr;
+    }
+
+    tree_journal *journal() const {
+        return journal_;
+    }
+
+    void copy_on_write(tree_journal *journal) {
+        journal_ = journal;
+    }
+
+    /**
+     * The cached path to the rightmost leaf, handing this to a later
+     * instance for the same tree saves its first append a descent.
+     */
+    tree_rightmost_t const &rightmost() const {
+        return rightmost_;
+    }
+
+    void rightmost(tree_rightmost_t const &path) {
+        rightmost_ = path;
+    }
+
 protected:
     sector_allocator &allocator() {
         return *allocator_;
@@ -115,6 +309,9 @@ private:
             auto rp = *iter;
             if (rp.as<entry_t>()->type == entry_type::TreeNode) {
                 auto node = db.as_mutable<default_node_type>(rp);
+                if (node->type == node_type::Free) {
+                    continue;
+                }
                 if (selected.node == nullptr || selected.node->depth < node->depth) {
                     selected = persisted_node_t{ node, node_ptr_t{ sector, (sector_offset_t)rp.position() } };
                 }
@@ -129,6 +326,9 @@ private:
         for (auto iter = db.begin(); iter != db.end(); ++iter) {
             auto rp = *iter;
             if (rp.position() == ptr.position) {
+                if (rp.as<entry_t>()->type != entry_type::TreeNode) {
+                    break;
+                }
                 auto node = db.as_mutable<default_node_type>(rp);
                 return persisted_node_t{ node, ptr };
             }
@@ -136,6 +336,189 @@ private:
         return persisted_node_t{};
     }
 
+    static constexpr size_t node_size(node_type type) {
+        return type == node_type::Inner ? InnerNodeSize : (type == node_type::Packed ? sizeof(tree_packed_node_t) : LeafNodeSize);
+    }
+
+    static default_node_type *emplace_node(void *ptr, node_type type) {
+        if (type == node_type::Packed) {
+            return reinterpret_cast<default_node_type *>(new (ptr) tree_packed_node_t{ });
+        }
+
+        if (type != node_type::Inner) {
+            return new (ptr) default_node_type{ };
+        }
+
+        new (ptr) tree_node_header_t{ node_type::Inner };
+
+        auto node = reinterpret_cast<default_node_type *>(ptr);
+        for (auto i = 0u; i < Size; ++i) {
+            node->keys[i] = 0;
+        }
+        for (auto i = 0u; i < Size + 1; ++i) {
+            node->d.children[i] = {};
+        }
+        return node;
+    }
+
+    static uint8_t *packed_data(default_node_type *node) {
+        return reinterpret_cast<uint8_t *>(node) + sizeof(tree_packed_node_t);
+    }
+
+    static uint8_t const *packed_data(default_node_type const *node) {
+        return reinterpret_cast<uint8_t const *>(node) + sizeof(tree_packed_node_t);
+    }
+
+    /**
+     * Calls fn(index, key, value) for each entry in a packed leaf, until
+     * it returns false.
+     */
+    template<typename EntryFunction>
+    static void packed_each(default_node_type const *node, EntryFunction fn) {
+        auto packed = reinterpret_cast<tree_packed_node_t const *>(node);
+        auto ptr = packed_data(node);
+        auto end = ptr + packed->size;
+        KEY key{ 0 };
+        VALUE value{ };
+
+        for (index_type i = 0; i < node->number_keys; ++i) {
+            int32_t err = 0;
+
+            auto key_delta = varint_decode(ptr, end - ptr, &err);
+            if (err < 0) {
+                phyerrorf("packed leaf: malformed");
+                return;
+            }
+            ptr += varint_encoding_length(key_delta);
+
+            auto value_delta = varint_decode(ptr, end - ptr, &err);
+            if (err < 0) {
+                phyerrorf("packed leaf: malformed");
+                return;
+            }
+            ptr += varint_encoding_length(value_delta);
+
+            key = tree_delta_codec<KEY>::apply(key, key_delta);
+            value = tree_delta_codec<VALUE>::apply(value, value_delta);
+
+            if (!fn(i, key, value)) {
+                return;
+            }
+        }
+    }
+
+    /**
+     * Returns the number of bytes needed to pack the leaf's entries or
+     * 0 if they can't be packed.
+     */
+    static size_t packed_size(default_node_type const *node) {
+        KEY key{ 0 };
+        VALUE value{ };
+        size_t size = 0;
+
+        for (auto i = 0; i < node->number_keys; ++i) {
+            if (!tree_delta_codec<KEY>::encodable(key, node->keys[i]) || !tree_delta_codec<VALUE>::encodable(value, node->d.values[i])) {
+                return 0;
+            }
+
+            size += varint_encoding_length(tree_delta_codec<KEY>::delta(key, node->keys[i]));
+            size += varint_encoding_length(tree_delta_codec<VALUE>::delta(value, node->d.values[i]));
+
+            key = node->keys[i];
+            value = node->d.values[i];
+        }
+
+        return size;
+    }
+
+    static void pack(default_node_type *node, default_node_type const *leaf, size_t size) {
+        auto packed = reinterpret_cast<tree_packed_node_t *>(node);
+        auto ptr = packed_data(node);
+        KEY key{ 0 };
+        VALUE value{ };
+
+        packed->depth = leaf->depth;
+        packed->number_keys = leaf->number_keys;
+        packed->size = (uint16_t)size;
+
+        for (auto i = 0; i < leaf->number_keys; ++i) {
+            auto key_delta = tree_delta_codec<KEY>::delta(key, leaf->keys[i]);
+            varint_encode(key_delta, ptr, size);
+            ptr += varint_encoding_length(key_delta);
+
+            auto value_delta = tree_delta_codec<VALUE>::delta(value, leaf->d.values[i]);
+            varint_encode(value_delta, ptr, size);
+            ptr += varint_encoding_length(value_delta);
+
+            key = leaf->keys[i];
+            value = leaf->d.values[i];
+        }
+    }
+
+    static void unpack_range(default_node_type *node, default_node_type const *source, index_type from, index_type to) {
+        node->type = node_type::Leaf;
+        node->depth = source->depth;
+        node->number_keys = to - from;
+
+        packed_each(source, [&](index_type i, KEY const &key, VALUE const &value) {
+            if (i >= to) {
+                return false;
+            }
+            if (i >= from) {
+                node->keys[i - from] = key;
+                node->d.values[i - from] = value;
+            }
+            return true;
+        });
+    }
+
+    static index_type leaf_position(default_node_type const *node, KEY const &key) {
+        if (node->type != node_type::Packed) {
+            return Keys::leaf_position_for(key, *node);
+        }
+
+        index_type position = node->number_keys;
+        packed_each(node, [&](index_type i, KEY const &entry_key, VALUE const &/*value*/) {
+            if (!(entry_key < key)) {
+                position = i;
+                return false;
+            }
+            return true;
+        });
+        return position;
+    }
+
+    static void leaf_entry(default_node_type const *node, index_type index, KEY *key, VALUE *value) {
+        assert(index < node->number_keys);
+
+        if (node->type != node_type::Packed) {
+            if (key != nullptr) {
+                *key = node->keys[index];
+            }
+            if (value != nullptr) {
+                *value = node->d.values[index];
+            }
+            return;
+        }
+
+        packed_each(node, [&](index_type i, KEY const &entry_key, VALUE const &entry_value) {
+            if (i == index) {
+                if (key != nullptr) {
+                    *key = entry_key;
+                }
+                if (value != nullptr) {
+                    *value = entry_value;
+                }
+                return false;
+            }
+            return true;
+        });
+    }
+
+    static void copy_node(default_node_type *node, default_node_type const *source) {
+        memcpy((void *)node, (void const *)source, node_size(source->type));
+    }
+
 private:
     void name(const char *f, ...) {
         va_list args;
@@ -200,26 +583,53 @@ private:
     }
 
     template<typename TFill>
-    int32_t allocate_node(page_lock &lock, node_ptr_t &ptr, TFill fill_fn) {
+    int32_t allocate_node(page_lock &lock, node_type type, node_ptr_t &ptr, TFill fill_fn) {
+        return allocate_node(lock, type, node_size(type), ptr, fill_fn);
+    }
+
+    template<typename TFill>
+    int32_t allocate_node(page_lock &lock, node_type type, size_t size, node_ptr_t &ptr, TFill fill_fn) {
         {
             auto &db = lock.db();
 
+            for (auto iter = db.begin(); iter != db.end(); ++iter) {
+                auto rp = *iter;
+                if (rp.as<entry_t>()->type == entry_type::TreeNode) {
+                    auto node = db.as_mutable<default_node_type>(rp);
+                    if (node->type == node_type::Free && rp.delimited_size() >= size) {
+                        phydebugf("%s reusing node %d:%d", name(), lock.sector(), rp.position());
+
+                        node = emplace_node(node, type);
+
+                        ptr = node_ptr_t{ lock.sector(), (sector_offset_t)rp.position() };
+
+                        node->dbg.sector = lock.sector();
+
+                        lock.dirty();
+
+                        return fill_fn(lock, node, ptr);
+                    }
+                }
+            }
+
             db.seek_end();
 
-            if (db.template room_for<default_node_type>()) {
-                phydebugf("%s appending node %d:%d (%d)", name(), lock.sector(), db.position(), sizeof(default_node_type));
+            if (db.room_for(size)) {
+                phydebugf("%s appending node %d:%d (%d)", name(), lock.sector(), db.position(), size);
+
+                auto placed = db.template reserve<default_node_type>(size);
 
-                auto placed = db.template reserve<default_node_type>();
+                auto node = emplace_node(placed.record, type);
 
                 ptr = node_ptr_t{ lock.sector(), placed.position };
 
-                placed.record->dbg.sector = lock.sector();
+                node->dbg.sector = lock.sector();
 
                 lock.dirty();
 
                 phyverbosef("allocate-node filling");
 
-                auto err = fill_fn(lock, placed.record, ptr);
+                auto err = fill_fn(lock, node, ptr);
                 if (err < 0) {
                     return err;
                 }
@@ -249,18 +659,22 @@ private:
 
         tail_ = allocated;
 
-        auto placed = db.template reserve<default_node_type>();
+        auto placed = db.template reserve<default_node_type>(size);
+
+        auto node = emplace_node(placed.record, type);
 
         phydebugf("creating new node %d:%d node-size=%d sector-size=%d",
-                  allocated, db.position(), sizeof(default_node_type), db.size());
+                  allocated, db.position(), size, db.size());
 
         ptr = node_ptr_t{ allocated, placed.position };
 
-        placed.record->dbg.sector = child_lock.sector();
+        node->dbg.sector = child_lock.sector();
+
+        child_lock.dirty();
 
         phyverbosef("allocate-node filling");
 
-        auto err = fill_fn(child_lock, placed.record, ptr);
+        auto err = fill_fn(child_lock, node, ptr);
         if (err < 0) {
             return err;
         }
@@ -276,6 +690,8 @@ private:
     }
 
     int32_t follow_node_ptr(page_lock &lock, node_ptr_t &ptr, persisted_node_t &followed) {
+        trace_event(trace_kind::TreeDescend, ptr.sector, (uint8_t)(ptr.sector == lock.sector() ? trace_flags::Hit : trace_flags::None));
+
         if (ptr.sector != lock.sector()) {
             phyinfof("follow %d -> %d:%d (load-sector)", lock.sector(), ptr.sector, ptr.position);
 
@@ -318,7 +734,7 @@ private:
         assert(node->type == node_type::Inner);
 
         node_ptr_t allocated_ptr;
-        auto err = allocate_node(lock, allocated_ptr, [this, index, &node_ptr, node, &child_ptr, child](page_lock &new_lock, default_node_type *new_node, node_ptr_t new_node_ptr) -> int32_t {
+        auto err = allocate_node(lock, child->type, allocated_ptr, [this, index, &node_ptr, node, &child_ptr, child](page_lock &new_lock, default_node_type *new_node, node_ptr_t new_node_ptr) -> int32_t {
             index_type threshold = (Size + 1) / 2;
 
             assert(child->number_keys >= threshold);
@@ -383,6 +799,97 @@ private:
         return 0;
     }
 
+    /**
+     * Adds or replaces a key in a leaf that has room for it.
+     */
+    static void insert_into_leaf(default_node_type *node, node_ptr_t node_ptr, KEY const &key, VALUE *value, tree_value_ptr_t *found_ptr) {
+        index_type index = node->number_keys - 1;
+
+        // Check for an overwrite before we shift. Is there a
+        // faster way?
+        for (auto i = 0; i < node->number_keys; ++i) {
+            if (node->keys[i] == key) {
+                phydebugf("replace leaf=%d:%d index=%d key=%d nkeys=%d", node_ptr.sector, node_ptr.position, i, key, node->number_keys);
+                if (value != nullptr) {
+                    node->d.values[i] = *value;
+                }
+                if (found_ptr != nullptr) {
+                    found_ptr->node = node_ptr;
+                    found_ptr->index = i;
+                }
+                return;
+            }
+        }
+
+        assert(node->number_keys < (index_type)Size);
+
+        while (index >= 0 && node->keys[index] > key) {
+            node->keys[index + 1] = node->keys[index];
+            node->d.values[index + 1] = node->d.values[index];
+            index--;
+        }
+
+        phydebugf("value leaf=%d:%d index=%d key=%d nkeys=%d", node_ptr.sector, node_ptr.position, index + 1, key, node->number_keys);
+        node->keys[index + 1] = key;
+        if (value != nullptr) {
+            node->d.values[index + 1] = *value;
+        }
+        if (found_ptr != nullptr) {
+            found_ptr->node = node_ptr;
+            found_ptr->index = index + 1;
+        }
+        node->number_keys++;
+    }
+
+    /**
+     * Finds the leaf a key belongs in, along with the smallest key that
+     * belongs in a leaf to its right. bounded is false for the rightmost
+     * leaf, which takes every larger key.
+     */
+    int32_t leaf_for(KEY const &key, node_ptr_t &leaf_ptr, KEY &upper, bool &bounded) {
+        buffer_type db{ *buffers_, *sectors_ };
+
+        auto lock = db.reading(root_);
+
+        auto err = back_to_root(lock);
+        if (err < 0) {
+            return err;
+        }
+
+        auto pnode = find_root_in_sector(lock.sector(), db);
+        auto node = pnode.node;
+        auto node_ptr = pnode.ptr;
+
+        assert(node != nullptr);
+
+        bounded = false;
+
+        auto d = node->depth;
+        while (d-- != 0 && node->type == node_type::Inner) {
+            auto index = Keys::inner_position_for(key, *node);
+            assert(index < node->number_keys + 1);
+
+            // Bounds further down are never looser than these.
+            if (index < node->number_keys) {
+                upper = node->keys[index];
+                bounded = true;
+            }
+
+            persisted_node_t followed;
+            auto err = follow_node_ptr(lock, node->d.children[index], followed);
+            if (err < 0) {
+                return err;
+            }
+
+            node = followed.node;
+            node_ptr = followed.ptr;
+        }
+
+        leaf_ptr = node_ptr;
+
+        return 0;
+    }
+
     int32_t insert_non_full(node_ptr_t node_ptr, KEY &key, VALUE *value, tree_value_ptr_t *found_ptr) {
         node_ptr_t insertion_ptr;
 
@@ -392,42 +899,7 @@ private:
             assert(node->number_keys < (index_type)Size);
 
             if (node->type == node_type::Leaf) {
-                // Check for an overwrite before we shift. Is there a
-                // faster way?
-                auto overwrite = false;
-                for (auto i = 0; i < node->number_keys; ++i) {
-                    if (node->keys[i] == key) {
-                        phydebugf("replace leaf=%d:%d index=%d key=%d nkeys=%d", node_ptr.sector, node_ptr.position, i, key, node->number_keys);
-                        if (value != nullptr) {
-                            node->d.values[i] = *value;
-                        }
-                        if (found_ptr != nullptr) {
-                            found_ptr->node = node_ptr;
-                            found_ptr->index = i;
-                        }
-                        overwrite = true;
-                        break;
-                    }
-                }
-
-                if (!overwrite) {
-                    while (index >= 0 && node->keys[index] > key) {
-                        node->keys[index + 1] = node->keys[index];
-                        node->d.values[index + 1] = node->d.values[index];
-                        index--;
-                    }
-
-                    phydebugf("value leaf=%d:%d index=%d key=%d nkeys=%d", node_ptr.sector, node_ptr.position, index + 1, key, node->number_keys);
-                    node->keys[index + 1] = key;
-                    if (value != nullptr) {
-                        node->d.values[index + 1] = *value;
-                    }
-                    if (found_ptr != nullptr) {
-                        found_ptr->node = node_ptr;
-                        found_ptr->index = index + 1;
-                    }
-                    node->number_keys++;
-                }
+                insert_into_leaf(node, node_ptr, key, value, found_ptr);
 
                 lock.dirty();
             }
@@ -436,8 +908,13 @@ private:
                     index--;
                 }
 
+                auto err = unpack_child(lock, node, index + 1);
+                if (err < 0) {
+                    return err;
+                }
+
                 auto child_ptr = node->d.children[index + 1];
-                auto err = dereference(false, child_ptr, [this, &lock, &index, &key, child_ptr, node_ptr, node](page_lock &child_lock, default_node_type *child) -> int32_t {
+                err = dereference(false, child_ptr, [this, &lock, &index, &key, child_ptr, node_ptr, node](page_lock &child_lock, default_node_type *child) -> int32_t {
                     if (child->number_keys == Size) {
                         phydebugf("splitting child %d:%d", child_ptr.sector, child_ptr.position);
 
@@ -450,7 +927,9 @@ private:
 
                         child_lock.dirty();
 
-                        if (node->keys[index + 1] < key) {
+                        // Keys equal to the separator go right, the
+                        // same way inner_position_for finds them.
+                        if (!(key < node->keys[index + 1])) {
                             index++;
                         }
                     }
@@ -484,255 +963,1658 @@ private:
         return 0;
     }
 
-    int32_t log_node(node_ptr_t node_ptr, default_node_type *node) {
-        name("%s[%d]", prefix_, node_ptr.sector);
+    int32_t rightmost_path() {
+        if (rightmost_.height >= 0) {
+            return 0;
+        }
 
-        // logged_task it{ name() };
+        buffer_type db{ *buffers_, *sectors_ };
 
-        if (node->type == node_type::Inner) {
-            phyinfof("inner nkeys=%d", node->number_keys);
-            for (auto i = 0; i <= node->number_keys; ++i) {
-                auto child = node->d.children[i];
-                phyinfof("inner %d:%d #%d key=%d -> %d:%d", node_ptr.sector, node_ptr.position, i, node->keys[i], child.sector, child.position);
-            }
-        }
-        else {
-            phyinfof("leaf nkeys=%d", node->number_keys);
+        auto lock = db.reading(root_);
 
-            for (auto i = 0; i < node->number_keys; ++i) {
-                phyinfof("leaf %d:%d #%d key=%d = %d", node_ptr.sector, node_ptr.position, i, node->keys[i], node->d.values[i]);
-            }
-        }
+        auto pnode = find_root_in_sector(lock.sector(), db);
+        auto node = pnode.node;
 
-        return 0;
-    }
+        assert(node != nullptr);
 
-    int32_t log(node_ptr_t node_ptr, bool graph) {
-        name("%s[%d]", prefix_, node_ptr.sector);
+        auto height = 0;
+        rightmost_.nodes[height] = pnode.ptr;
 
-        // logged_task it{ name() };
+        while (node->type == node_type::Inner) {
+            assert(height + 1 < (int32_t)MaximumDepth);
 
-        for (auto i = 0; i < (index_type)Size; ++i) {
-            node_ptr_t follow_ptr;
+            auto child_ptr = node->d.children[node->number_keys];
+            persisted_node_t followed;
+            auto err = follow_node_ptr(lock, child_ptr, followed);
+            if (err < 0) {
+                return err;
+            }
 
-            // We recurse outside of the dereference lambda so that we
-            // are only ever consuming the minimum number of pages.
-            auto err = dereference(true, node_ptr, [this, &i, &node_ptr, &follow_ptr](page_lock &/*lock*/, default_node_type *node) -> int32_t {
-                if (node->type == node_type::Inner) {
-                    if (i == 0) {
-                        phyinfof("inner nkeys=%d", node->number_keys);
+            node = followed.node;
+            rightmost_.nodes[++height] = followed.ptr;
+        }
+
+        rightmost_.height = height;
+
+        phydebugf("%s rightmost height=%d leaf=%d:%d", name(), height, rightmost_.nodes[height].sector, rightmost_.nodes[height].position);
+
+        return 0;
+    }
+
+    /**
+     * Replaces a packed child with a regular leaf so that it can be
+     * modified in place.
+     */
+    int32_t unpack_child(page_lock &lock, default_node_type *parent, index_type index) {
+        auto child_ptr = parent->d.children[index];
+
+        return dereference(false, child_ptr, [&](page_lock &child_lock, default_node_type *child) -> int32_t {
+            if (child->type != node_type::Packed) {
+                return 0;
+            }
+
+            node_ptr_t unpacked_ptr;
+            auto err = allocate_node(child_lock, node_type::Leaf, unpacked_ptr, [&](page_lock &new_lock, default_node_type *node, node_ptr_t /*node_ptr*/) -> int32_t {
+                unpack_range(node, child, 0, child->number_keys);
+                new_lock.dirty();
+                return 0;
+            });
+            if (err < 0) {
+                return err;
+            }
+
+            phydebugf("%s unpacked %d:%d -> %d:%d", name(), child_ptr.sector, child_ptr.position, unpacked_ptr.sector, unpacked_ptr.position);
+
+            child->type = node_type::Free;
+            child->number_keys = 0;
+            child_lock.dirty();
+
+            parent->d.children[index] = unpacked_ptr;
+            lock.dirty();
+
+            return 0;
+        });
+    }
+
+    /**
+     * Writes a packed copy of a full leaf to the tail sector and points
+     * the parent at the copy, which frees the leaf up for reuse. Leaves
+     * are left alone when their entries can't be packed or packing
+     * wouldn't save anything.
+     */
+    int32_t pack_leaf(node_ptr_t parent_ptr, node_ptr_t leaf_ptr, default_node_type const *leaf, bool &packed) {
+        packed = false;
+
+        if (!Packable) {
+            return 0;
+        }
+
+        auto size = packed_size(leaf);
+        auto record_size = sizeof(tree_packed_node_t) + size;
+        if (size == 0 || record_size >= LeafNodeSize) {
+            return 0;
+        }
+
+        node_ptr_t packed_ptr;
+
+        {
+            buffer_type buffer{ *buffers_, *sectors_ };
+
+            auto lock = buffer.writing(tail_);
+
+            auto err = allocate_node(lock, node_type::Packed, record_size, packed_ptr, [&](page_lock &new_lock, default_node_type *node, node_ptr_t /*node_ptr*/) -> int32_t {
+                pack(node, leaf, size);
+                new_lock.dirty();
+                return 0;
+            });
+            if (err < 0) {
+                return err;
+            }
+
+            if (lock.is_dirty()) {
+                err = lock.flush(lock.sector());
+                if (err < 0) {
+                    return err;
+                }
+            }
+        }
+
+        phydebugf("%s packed %d:%d -> %d:%d (%zu bytes)", name(), leaf_ptr.sector, leaf_ptr.position, packed_ptr.sector, packed_ptr.position, record_size);
+
+        return dereference(false, parent_ptr, [&](page_lock &lock, default_node_type *parent) -> int32_t {
+            assert(parent->type == node_type::Inner);
+
+            for (index_type i = 0; i <= parent->number_keys; ++i) {
+                if (parent->d.children[i] == leaf_ptr) {
+                    parent->d.children[i] = packed_ptr;
+                    lock.dirty();
+                    packed = true;
+                    return 0;
+                }
+            }
+
+            phyerrorf("%s pack: leaf missing from parent", name());
+
+            return -1;
+        });
+    }
+
+    int32_t grow_root(page_lock &lock, default_node_type *node, KEY key, node_ptr_t right_ptr, node_ptr_t &left_ptr) {
+        // Same trick as in add, the root never moves so the full root
+        // is copied into a new node that becomes the left child.
+        auto err = allocate_node(lock, node->type, left_ptr, [node](page_lock &new_lock, default_node_type *new_node, node_ptr_t /*new_node_ptr*/) -> int32_t {
+            copy_node(new_node, node);
+
+            new_lock.dirty();
+
+            return 0;
+        });
+        if (err < 0) {
+            return err;
+        }
+
+        auto depth = node->depth;
+
+        new (node) default_node_type{ };
+        node->type = node_type::Inner;
+        node->depth = depth + 1;
+        node->keys[0] = key;
+        node->d.children[0] = left_ptr;
+        node->d.children[1] = right_ptr;
+        node->number_keys = 1;
+
+        lock.dirty();
+
+        phydebugf("%s grow-root left=%d:%d right=%d:%d", name(), left_ptr.sector, left_ptr.position, right_ptr.sector, right_ptr.position);
+
+        return 0;
+    }
+
+    void free_node(page_lock &lock, default_node_type *node, emptied_t &emptied) {
+        node->type = node_type::Free;
+        node->number_keys = 0;
+
+        lock.dirty();
+
+        if (lock.sector() == root_) {
+            return;
+        }
+
+        auto &db = lock.db();
+        for (auto iter = db.begin(); iter != db.end(); ++iter) {
+            auto rp = *iter;
+            if (rp.as<entry_t>()->type == entry_type::TreeNode) {
+                if (rp.as<tree_node_header_t>()->type != node_type::Free) {
+                    return;
+                }
+            }
+        }
+
+        phydebugf("%s sector emptied %d", name(), lock.sector());
+
+        emptied.add(lock.sector());
+    }
+
+    // Children whose key range is empty are never reached by a search,
+    // splitting inner nodes leaves one of these behind and they share a
+    // node with another parent, so they're never borrowed from or
+    // merged with.
+    static bool empty_range(default_node_type const *node, index_type index, bounds_t const &bounds) {
+        auto has_lower = index > 0 || bounds.has_lower;
+        auto has_upper = index < node->number_keys || bounds.has_upper;
+        if (!has_lower || !has_upper) {
+            return false;
+        }
+        auto lower = index > 0 ? node->keys[index - 1] : bounds.lower;
+        auto upper = index < node->number_keys ? node->keys[index] : bounds.upper;
+        return !(lower < upper);
+    }
+
+    static void remove_child(default_node_type *parent, index_type key_index) {
+        for (auto j = key_index; j < parent->number_keys - 1; ++j) {
+            parent->keys[j] = parent->keys[j + 1];
+        }
+        for (auto j = key_index + 1; j < parent->number_keys; ++j) {
+            parent->d.children[j] = parent->d.children[j + 1];
+        }
+        parent->number_keys--;
+    }
+
+    // Moves everything in right into left, separated by the key at
+    // key_index in the parent.
+    static void merge_nodes(default_node_type *parent, index_type key_index, default_node_type *left, default_node_type *right) {
+        if (left->type == node_type::Leaf) {
+            for (auto j = 0; j < right->number_keys; ++j) {
+                left->keys[left->number_keys + j] = right->keys[j];
+                left->d.values[left->number_keys + j] = right->d.values[j];
+            }
+            left->number_keys += right->number_keys;
+        }
+        else {
+            left->keys[left->number_keys] = parent->keys[key_index];
+            for (auto j = 0; j < right->number_keys; ++j) {
+                left->keys[left->number_keys + 1 + j] = right->keys[j];
+            }
+            for (auto j = 0; j <= right->number_keys; ++j) {
+                left->d.children[left->number_keys + 1 + j] = right->d.children[j];
+            }
+            left->number_keys += right->number_keys + 1;
+        }
+
+        remove_child(parent, key_index);
+    }
+
+    static void borrow_from_left(default_node_type *parent, index_type key_index, default_node_type *left, default_node_type *node) {
+        if (node->type == node_type::Leaf) {
+            for (auto j = node->number_keys; j > 0; --j) {
+                node->keys[j] = node->keys[j - 1];
+                node->d.values[j] = node->d.values[j - 1];
+            }
+            node->keys[0] = left->keys[left->number_keys - 1];
+            node->d.values[0] = left->d.values[left->number_keys - 1];
+            parent->keys[key_index] = node->keys[0];
+        }
+        else {
+            for (auto j = node->number_keys; j > 0; --j) {
+                node->keys[j] = node->keys[j - 1];
+            }
+            for (auto j = node->number_keys + 1; j > 0; --j) {
+                node->d.children[j] = node->d.children[j - 1];
+            }
+            node->keys[0] = parent->keys[key_index];
+            node->d.children[0] = left->d.children[left->number_keys];
+            parent->keys[key_index] = left->keys[left->number_keys - 1];
+        }
+        node->number_keys++;
+        left->number_keys--;
+    }
+
+    static void borrow_from_right(default_node_type *parent, index_type key_index, default_node_type *node, default_node_type *right) {
+        if (node->type == node_type::Leaf) {
+            node->keys[node->number_keys] = right->keys[0];
+            node->d.values[node->number_keys] = right->d.values[0];
+            for (auto j = 0; j < right->number_keys - 1; ++j) {
+                right->keys[j] = right->keys[j + 1];
+                right->d.values[j] = right->d.values[j + 1];
+            }
+            right->number_keys--;
+            parent->keys[key_index] = right->keys[0];
+        }
+        else {
+            node->keys[node->number_keys] = parent->keys[key_index];
+            node->d.children[node->number_keys + 1] = right->d.children[0];
+            parent->keys[key_index] = right->keys[0];
+            for (auto j = 0; j < right->number_keys - 1; ++j) {
+                right->keys[j] = right->keys[j + 1];
+            }
+            for (auto j = 0; j < right->number_keys; ++j) {
+                right->d.children[j] = right->d.children[j + 1];
+            }
+            right->number_keys--;
+        }
+        node->number_keys++;
+    }
+
+    /**
+     * Fixes an underfull node by borrowing from or merging with one of
+     * its siblings. Sets underflow when this leaves the parent
+     * underfull.
+     */
+    int32_t rebalance(path_entry_t *path, int32_t level, bool &underflow, emptied_t &emptied) {
+        auto &parent = path[level - 1];
+        auto index = parent.index;
+
+        underflow = false;
+
+        return dereference(false, parent.ptr, [&](page_lock &parent_lock, default_node_type *parent_node) -> int32_t {
+            assert(parent_node->type == node_type::Inner);
+
+            auto left_ok = index > 0 && !empty_range(parent_node, index - 1, parent.bounds);
+            auto right_ok = index < parent_node->number_keys && !empty_range(parent_node, index + 1, parent.bounds);
+            if (!left_ok && !right_ok) {
+                phydebugf("%s rebalance: no siblings", name());
+                return 0;
+            }
+
+            auto sibling_index = left_ok ? index - 1 : index + 1;
+
+            auto err = unpack_child(parent_lock, parent_node, sibling_index);
+            if (err < 0) {
+                return err;
+            }
+
+            auto sibling_ptr = parent_node->d.children[sibling_index];
+
+            return dereference(false, path[level].ptr, [&](page_lock &lock, default_node_type *node) -> int32_t {
+                return dereference(false, sibling_ptr, [&](page_lock &sibling_lock, default_node_type *sibling) -> int32_t {
+                    assert(sibling->type == node->type);
+
+                    if (sibling->number_keys > MinimumKeys) {
+                        if (left_ok) {
+                            phydebugf("%s borrow-left %d:%d", name(), sibling_ptr.sector, sibling_ptr.position);
+                            borrow_from_left(parent_node, index - 1, sibling, node);
+                        }
+                        else {
+                            phydebugf("%s borrow-right %d:%d", name(), sibling_ptr.sector, sibling_ptr.position);
+                            borrow_from_right(parent_node, index, node, sibling);
+                        }
+
+                        sibling_lock.dirty();
+                        lock.dirty();
+                        parent_lock.dirty();
+
+                        return 0;
                     }
 
-                    if (i <= node->number_keys) {
-                        auto child = node->d.children[i];
-                        phyinfof("inner %d:%d #%d key=%d -> %d:%d", node_ptr.sector, node_ptr.position, i, node->keys[i], child.sector, child.position);
-                        follow_ptr = child;
+                    if (left_ok) {
+                        phydebugf("%s merge-left %d:%d", name(), sibling_ptr.sector, sibling_ptr.position);
+                        merge_nodes(parent_node, index - 1, sibling, node);
+                        sibling_lock.dirty();
+                        free_node(lock, node, emptied);
                     }
                     else {
-                        i = Size;
+                        phydebugf("%s merge-right %d:%d", name(), sibling_ptr.sector, sibling_ptr.position);
+                        merge_nodes(parent_node, index, node, sibling);
+                        lock.dirty();
+                        free_node(sibling_lock, sibling, emptied);
                     }
+
+                    parent_lock.dirty();
+
+                    underflow = parent_node->number_keys < MinimumKeys;
+
+                    return 0;
+                });
+            });
+        });
+    }
+
+    // The root never moves, so when it's left with a single child that
+    // child is copied into the root.
+    int32_t collapse_root(node_ptr_t root_ptr, emptied_t &emptied) {
+        return dereference(false, root_ptr, [&](page_lock &lock, default_node_type *node) -> int32_t {
+            if (node->type != node_type::Inner || node->number_keys > 0) {
+                return 0;
+            }
+
+            auto child_ptr = node->d.children[0];
+
+            return dereference(false, child_ptr, [&](page_lock &child_lock, default_node_type *child) -> int32_t {
+                phydebugf("%s collapse-root %d:%d", name(), child_ptr.sector, child_ptr.position);
+
+                auto depth = node->depth;
+
+                if (child->type == node_type::Packed) {
+                    new (node) default_node_type{ };
+                    unpack_range(node, child, 0, child->number_keys);
                 }
                 else {
-                    if (i == 0) {
-                        phyinfof("leaf nkeys=%d", node->number_keys);
+                    copy_node(node, child);
+                }
+                node->depth = depth;
+                node->dbg.sector = lock.sector();
 
-                        for (auto j = 0; j < node->number_keys; ++j) {
-                            phyinfof("leaf %d:%d #%d key=%d = (%d bytes)", node_ptr.sector, node_ptr.position, j, node->keys[j], sizeof(VALUE));
-                        }
-                    }
+                lock.dirty();
+
+                free_node(child_lock, child, emptied);
 
-                    i = Size;
-                }
                 return 0;
             });
+        });
+    }
+
+    /**
+     * Takes an emptied sector out of the chain formed by this tree's
+     * sectors and gives it to the free sectors chain.
+     */
+    int32_t reclaim_sector(dhara_sector_t sector, free_sectors_chain &reclaimed) {
+        assert(sector != root_);
+
+        buffer_type buffer{ *buffers_, *sectors_ };
+
+        dhara_sector_t following = InvalidSector;
+
+        {
+            auto lock = buffer.writing(sector);
+
+            assert(buffer.write_header<sector_chain_header_t>([&](sector_chain_header_t *header) {
+                following = header->np;
+                header->np = InvalidSector;
+                return 0;
+            }) == 0);
+
+            lock.dirty();
+
+            auto err = lock.flush(sector);
             if (err < 0) {
                 return err;
             }
+        }
 
-            if (follow_ptr.valid()) {
-                auto err = log(follow_ptr, graph);
+        dhara_sector_t preceding = InvalidSector;
+
+        if (tail_ == sector) {
+            tail_ = following;
+        }
+        else {
+            auto lock = buffer.writing(tail_);
+
+            while (true) {
+                auto hdr = buffer.header<sector_chain_header_t>();
+                if (hdr->np == sector) {
+                    assert(buffer.write_header<sector_chain_header_t>([&](sector_chain_header_t *header) {
+                        header->np = following;
+                        return 0;
+                    }) == 0);
+
+                    lock.dirty();
+
+                    auto err = lock.flush(lock.sector());
+                    if (err < 0) {
+                        return err;
+                    }
+
+                    preceding = lock.sector();
+
+                    break;
+                }
+
+                if (hdr->np == InvalidSector) {
+                    phyerrorf("%s reclaim: sector %d not in chain", name(), sector);
+                    return -1;
+                }
+
+                auto err = lock.replace(hdr->np);
                 if (err < 0) {
                     return err;
                 }
             }
         }
 
-        return 0;
+        // Copies made on write link sectors to the newer one before them.
+        if (following != InvalidSector) {
+            auto lock = buffer.writing(following);
+
+            if (buffer.header<sector_chain_header_t>()->pp == sector) {
+                assert(buffer.write_header<sector_chain_header_t>([&](sector_chain_header_t *header) {
+                    header->pp = preceding;
+                    return 0;
+                }) == 0);
+
+                lock.dirty();
+
+                auto err = lock.flush(following);
+                if (err < 0) {
+                    return err;
+                }
+            }
+        }
+
+        phydebugf("%s reclaimed sector=%d tail=%d", name(), sector, tail_);
+
+        return reclaimed.add_chain(sector);
     }
 
-public:
-    int32_t exists() {
-        logged_task lt{ "tree-exists" };
+    static void copy_range(default_node_type *node, default_node_type const *source, index_type from, index_type to) {
+        if (source->type == node_type::Packed) {
+            unpack_range(node, source, from, to);
+            return;
+        }
 
-        dhara_page_t page = 0;
-        auto err = sectors_->find(root_, &page);
-        if (err < 0) {
-            return 0;
+        node->type = source->type;
+        node->depth = source->depth;
+        node->number_keys = to - from;
+
+        for (auto j = from; j < to; ++j) {
+            node->keys[j - from] = source->keys[j];
         }
 
-        phydebugf("exists!");
+        if (source->type == node_type::Inner) {
+            for (auto j = from; j <= to; ++j) {
+                node->d.children[j - from] = source->d.children[j];
+            }
+        }
+        else {
+            for (auto j = from; j < to; ++j) {
+                node->d.values[j - from] = source->d.values[j];
+            }
+        }
+    }
 
-        return 1;
+    static index_type leaf_put(default_node_type *node, KEY key, VALUE *value) {
+        auto index = Keys::leaf_position_for(key, *node);
+        if (index == node->number_keys || node->keys[index] != key) {
+            assert(node->number_keys < (index_type)Size);
+            for (auto j = node->number_keys; j > index; --j) {
+                node->keys[j] = node->keys[j - 1];
+                node->d.values[j] = node->d.values[j - 1];
+            }
+            node->keys[index] = key;
+            node->number_keys++;
+        }
+        if (value != nullptr) {
+            node->d.values[index] = *value;
+        }
+        return index;
     }
 
-    int32_t create() {
-        if (root_ == InvalidSector) {
+    static void leaf_remove(default_node_type *node, index_type index) {
+        for (auto j = index; j < node->number_keys - 1; ++j) {
+            node->keys[j] = node->keys[j + 1];
+            node->d.values[j] = node->d.values[j + 1];
+        }
+        node->number_keys--;
+    }
+
+    static void inner_put(default_node_type *node, index_type index, insertion_t const &child) {
+        node->d.children[index] = child.left;
+        if (child.split) {
+            assert(node->number_keys < (index_type)Size);
+            for (auto j = node->number_keys; j > index; --j) {
+                node->keys[j] = node->keys[j - 1];
+            }
+            for (auto j = node->number_keys + 1; j > index + 1; --j) {
+                node->d.children[j] = node->d.children[j - 1];
+            }
+            node->keys[index] = child.key;
+            node->d.children[index + 1] = child.right;
+            node->number_keys++;
+        }
+    }
+
+    /**
+     * Appends a copy made on write to the tail sector. When the tail is
+     * full the new tail is recorded as the previous one's pp, so the
+     * journal can later unlink it without walking the chain.
+     */
+    template<typename TFill>
+    int32_t append_copy(page_lock &lock, node_type type, node_ptr_t &ptr, TFill fill_fn) {
+        auto previous_tail = tail_;
+
+        auto err = allocate_node(lock, type, ptr, fill_fn);
+        if (err < 0) {
+            return err;
+        }
+
+        journal_->wrote(ptr);
+
+        if (tail_ != previous_tail) {
+            assert(lock.sector() == previous_tail);
+
+            assert(lock.db().template write_header<sector_chain_header_t>([&](sector_chain_header_t *header) {
+                header->pp = tail_;
+                return 0;
+            }) == 0);
+
+            lock.dirty();
+
+            err = lock.flush(previous_tail);
+            if (err < 0) {
+                return err;
+            }
+
+            err = lock.replace(tail_);
+            if (err < 0) {
+                return err;
+            }
+        }
+
+        return 0;
+    }
+
+    /**
+     * Writes a new root to a sector of its own, outside of the chain,
+     * leaving the saved root alone until the journal frees it.
+     */
+    template<typename TFill>
+    int32_t write_root(node_ptr_t &ptr, TFill fill_fn) {
+        buffer_type buffer{ *buffers_, *sectors_ };
+
+        auto allocated = journal_->spare_root();
+        if (allocated == InvalidSector) {
+            allocated = allocator_->allocate();
+        }
+
+        auto lock = buffer.overwrite(allocated);
+
+        auto &db = lock.db();
+
+        db.clear();
+
+        db.template emplace<sector_chain_header_t>(entry_type::TreeSector, InvalidSector, InvalidSector, sector_flags::Root);
+
+        auto reserved = db.template reserve<default_node_type>();
+        auto root = reserved.record;
+
+        root->type = node_type::Leaf;
+        root->dbg.sector = allocated;
+
+        ptr = node_ptr_t{ allocated, reserved.position };
+
+        fill_fn(root, ptr);
+
+        lock.dirty();
+
+        auto err = lock.flush(allocated);
+        if (err < 0) {
+            return err;
+        }
+
+        journal_->wrote(ptr);
+
+        phydebugf("%s copy-path new-root=%d:%d", name(), ptr.sector, ptr.position);
+
+        return 0;
+    }
+
+    /**
+     * Copy-on-write version of add and remove. Nodes on the path from
+     * the root to the leaf holding the key that belong to the saved
+     * tree are copied to the tail sector and the journal, nodes written
+     * since then are changed in place. Returns 1 if the tree was
+     * changed.
+     */
+    int32_t copy_path(KEY key, VALUE *value, bool removing, tree_value_ptr_t *found_ptr) {
+        assert(root_ != InvalidSector);
+        assert(journal_ != nullptr);
+
+        rightmost_.height = -1;
+
+        node_ptr_t path[MaximumDepth];
+        index_type indices[MaximumDepth];
+        auto height = 0;
+        auto exists = false;
+
+        {
+            buffer_type db{ *buffers_, *sectors_ };
+
+            auto lock = db.reading(root_);
+
+            auto pnode = find_root_in_sector(lock.sector(), db);
+            auto node = pnode.node;
+
+            assert(node != nullptr);
+
+            path[0] = pnode.ptr;
+
+            while (node->type == node_type::Inner) {
+                assert(height + 1 < (int32_t)MaximumDepth);
+
+                auto index = Keys::inner_position_for(key, *node);
+                auto child_ptr = node->d.children[index];
+
+                indices[height] = index;
+
+                persisted_node_t followed;
+                auto err = follow_node_ptr(lock, child_ptr, followed);
+                if (err < 0) {
+                    return err;
+                }
+
+                node = followed.node;
+                path[++height] = followed.ptr;
+            }
+
+            auto index = leaf_position(node, key);
+            if (index < node->number_keys) {
+                KEY found{ 0 };
+                leaf_entry(node, index, &found, nullptr);
+                exists = found == key;
+            }
+        }
+
+        if (removing && !exists) {
+            return 0;
+        }
+
+        // Every level may replace a node, refuse before copying any of
+        // them so the tree can be published and this tried again.
+        if (!journal_->room(height + 1)) {
+            phyerrorf("%s journal full, publish first", name());
+            return -1;
+        }
+
+        buffer_type buffer{ *buffers_, *sectors_ };
+
+        auto lock = buffer.writing(tail_);
+
+        phydebugf("%s copy-path height=%d tail=%d", name(), height, tail_);
+
+        insertion_t below;
+        node_ptr_t root_ptr = path[0];
+        // Cleared once a node is changed in place, the nodes above it
+        // are left as they are.
+        auto changed = true;
+
+        for (auto level = height; level >= 0 && changed; --level) {
+            auto fresh = journal_->written(path[level]);
+
+            auto err = dereference(!fresh, path[level], [&](page_lock &source_lock, default_node_type *source) -> int32_t {
+                auto child = below;
+                auto leaf = source->type != node_type::Inner;
+                auto type = leaf ? node_type::Leaf : node_type::Inner;
+                auto index = leaf ? leaf_position(source, key) : indices[level];
+                auto full = source->number_keys == (index_type)Size;
+                auto split = full && (leaf ? (!exists && !removing) : child.split);
+
+                auto modify = [&](default_node_type *node, node_ptr_t node_ptr, index_type position) {
+                    if (!leaf) {
+                        inner_put(node, position, child);
+                    }
+                    else if (removing) {
+                        leaf_remove(node, position);
+                    }
+                    else {
+                        auto i = leaf_put(node, key, value);
+                        if (found_ptr != nullptr) {
+                            found_ptr->node = node_ptr;
+                            found_ptr->index = i;
+                        }
+                    }
+                };
+
+                if (!split) {
+                    if (fresh) {
+                        modify(source, path[level], index);
+                        source_lock.dirty();
+                        changed = false;
+                        return 0;
+                    }
+
+                    auto fill = [&](page_lock &/*new_lock*/, default_node_type *node, node_ptr_t node_ptr) -> int32_t {
+                        copy_range(node, source, 0, source->number_keys);
+                        modify(node, node_ptr, index);
+                        return 0;
+                    };
+
+                    node_ptr_t copied_ptr;
+                    auto err = level == 0 ? write_root(copied_ptr, [&](default_node_type *node, node_ptr_t node_ptr) {
+                        fill(lock, node, node_ptr);
+                    }) : append_copy(lock, type, copied_ptr, fill);
+                    if (err < 0) {
+                        return err;
+                    }
+
+                    err = journal_->replaced(path[level]);
+                    if (err < 0) {
+                        return err;
+                    }
+
+                    below = insertion_t{ false, 0, copied_ptr, node_ptr_t{} };
+                    if (level == 0) {
+                        root_ptr = copied_ptr;
+                    }
+
+                    return 0;
+                }
+
+                // Leaves keep the separator as their first key, inner
+                // nodes move it up to the parent.
+                index_type threshold = leaf ? (Size + 1) / 2 : Size / 2;
+                index_type right_from = leaf ? threshold : threshold + 1;
+                KEY separator{ 0 };
+                leaf_entry(source, threshold, &separator, nullptr);
+                auto goes_left = leaf ? key < separator : index <= threshold;
+
+                phydebugf("%s copy-path split level=%d separator=%d", name(), level, separator);
+
+                node_ptr_t left_ptr;
+                auto err = append_copy(lock, type, left_ptr, [&](page_lock &/*new_lock*/, default_node_type *node, node_ptr_t node_ptr) -> int32_t {
+                    copy_range(node, source, 0, threshold);
+                    if (goes_left) {
+                        modify(node, node_ptr, index);
+                    }
+                    return 0;
+                });
+                if (err < 0) {
+                    return err;
+                }
+
+                node_ptr_t right_ptr;
+                err = append_copy(lock, type, right_ptr, [&](page_lock &/*new_lock*/, default_node_type *node, node_ptr_t node_ptr) -> int32_t {
+                    copy_range(node, source, right_from, (index_type)Size);
+                    if (!goes_left) {
+                        modify(node, node_ptr, index - right_from);
+                    }
+                    return 0;
+                });
+                if (err < 0) {
+                    return err;
+                }
+
+                below = insertion_t{ true, separator, left_ptr, right_ptr };
+
+                auto grow = [&](default_node_type *root, node_ptr_t node_ptr) {
+                    auto depth = source->depth;
+                    new (root) default_node_type{ };
+                    root->type = node_type::Inner;
+                    root->depth = depth + 1;
+                    root->dbg.sector = node_ptr.sector;
+                    root->number_keys = 1;
+                    root->keys[0] = separator;
+                    root->d.children[0] = left_ptr;
+                    root->d.children[1] = right_ptr;
+                };
+
+                if (fresh) {
+                    if (level == 0) {
+                        grow(source, path[level]);
+                        source_lock.dirty();
+                        changed = false;
+                        return 0;
+                    }
+
+                    // Nothing saved refers to this node, so it's free as
+                    // soon as its parent points at the halves.
+                    source->type = node_type::Free;
+                    source->number_keys = 0;
+                    source_lock.dirty();
+                    journal_->forget(path[level]);
+                    return 0;
+                }
+
+                err = journal_->replaced(path[level]);
+                if (err < 0) {
+                    return err;
+                }
+
+                if (level == 0) {
+                    return write_root(root_ptr, grow);
+                }
+
+                return 0;
+            });
+            if (err < 0) {
+                return err;
+            }
+        }
+
+        auto err = lock.flush(lock.sector());
+        if (err < 0) {
+            return err;
+        }
+
+        root_ = root_ptr.sector;
+
+        name("%s[%d]", prefix_, root_);
+
+        return 1;
+    }
+
+    int32_t log_node(node_ptr_t node_ptr, default_node_type *node) {
+        name("%s[%d]", prefix_, node_ptr.sector);
+
+        // logged_task it{ name() };
+
+        if (node->type == node_type::Inner) {
+            phyinfof("inner nkeys=%d", node->number_keys);
+            for (auto i = 0; i <= node->number_keys; ++i) {
+                auto child = node->d.children[i];
+                phyinfof("inner %d:%d #%d key=%d -> %d:%d", node_ptr.sector, node_ptr.position, i, node->keys[i], child.sector, child.position);
+            }
+        }
+        else if (node->type == node_type::Packed) {
+            phyinfof("packed nkeys=%d", node->number_keys);
+
+            packed_each(node, [&](index_type i, KEY const &key, VALUE const &value) {
+                phyinfof("packed %d:%d #%d key=%d = %d", node_ptr.sector, node_ptr.position, i, key, value);
+                return true;
+            });
+        }
+        else {
+            phyinfof("leaf nkeys=%d", node->number_keys);
+
+            for (auto i = 0; i < node->number_keys; ++i) {
+                phyinfof("leaf %d:%d #%d key=%d = %d", node_ptr.sector, node_ptr.position, i, node->keys[i], node->d.values[i]);
+            }
+        }
+
+        return 0;
+    }
+
+    int32_t log(node_ptr_t node_ptr, bool graph) {
+        name("%s[%d]", prefix_, node_ptr.sector);
+
+        // logged_task it{ name() };
+
+        for (auto i = 0; i < (index_type)Size; ++i) {
+            node_ptr_t follow_ptr;
+
+            // We recurse outside of the dereference lambda so that we
+            // are only ever consuming the minimum number of pages.
+            auto err = dereference(true, node_ptr, [this, &i, &node_ptr, &follow_ptr](page_lock &/*lock*/, default_node_type *node) -> int32_t {
+                if (node == nullptr || node->type == node_type::Free) {
+                    phyinfof("free %d:%d", node_ptr.sector, node_ptr.position);
+                    i = Size;
+                    return 0;
+                }
+
+                if (node->type == node_type::Inner) {
+                    if (i == 0) {
+                        phyinfof("inner nkeys=%d", node->number_keys);
+                    }
+
+                    if (i <= node->number_keys) {
+                        auto child = node->d.children[i];
+                        phyinfof("inner %d:%d #%d key=%d -> %d:%d", node_ptr.sector, node_ptr.position, i, node->keys[i], child.sector, child.position);
+                        follow_ptr = child;
+                    }
+                    else {
+                        i = Size;
+                    }
+                }
+                else {
+                    if (i == 0) {
+                        phyinfof("leaf nkeys=%d", node->number_keys);
+
+                        for (auto j = 0; j < node->number_keys; ++j) {
+                            phyinfof("leaf %d:%d #%d key=%d = (%d bytes)", node_ptr.sector, node_ptr.position, j, node->keys[j], sizeof(VALUE));
+                        }
+                    }
+
+                    i = Size;
+                }
+                return 0;
+            });
+            if (err < 0) {
+                return err;
+            }
+
+            if (follow_ptr.valid()) {
+                auto err = log(follow_ptr, graph);
+                if (err < 0) {
+                    return err;
+                }
+            }
+        }
+
+        return 0;
+    }
+
+public:
+    int32_t exists() {
+        logged_task lt{ "tree-exists" };
+
+        dhara_page_t page = 0;
+        auto err = sectors_->find(root_, &page);
+        if (err < 0) {
+            return 0;
+        }
+
+        phydebugf("exists!");
+
+        return 1;
+    }
+
+    int32_t create() {
+        rightmost_.height = -1;
+
+        if (root_ == InvalidSector) {
             root_ = allocator_->allocate();
             tail_ = root_;
             phydebugf("tree-create allocating sector=%d", root_);
         }
 
-        logged_task lt{ name(), "tree-create" };
+        logged_task lt{ name(), "tree-create" };
+
+        phydebugf("creating");
+
+        buffer_type db{ *buffers_, *sectors_ };
+
+        auto lock = db.overwrite(root_);
+
+        assert(db.empty());
+
+        db.template emplace<sector_chain_header_t>(entry_type::TreeSector);
+
+        phydebugf("creating new tree position=%d node-size=%d sector-size=%d", db.position(), sizeof(default_node_type), db.size());
+
+        auto placed = db.template reserve<default_node_type>();
+
+        placed.record->type = node_type::Leaf;
+        placed.record->dbg.sector = lock.sector();
+
+        lock.dirty();
+
+        auto err = flush(lock);
+        if (err < 0) {
+            return err;
+        }
+
+        return 0;
+    }
+
+    /**
+     * Modifies the value at the given location. When copying on write
+     * the value is copied to a new leaf and value_ptr is updated to
+     * point there.
+     */
+    template<typename ModifyFunction>
+    int32_t modify_in_place(tree_value_ptr_t &value_ptr, ModifyFunction fn) {
+        auto packed = false;
+        // Leaves written since the tree was saved are changed in place.
+        auto copying = copy_on_write() && !journal_->written(value_ptr.node);
+
+        if (Packable && !copying) {
+            auto err = dereference(true, value_ptr.node, [&](page_lock &/*lock*/, default_node_type *node) -> int32_t {
+                packed = node->type == node_type::Packed;
+                return 0;
+            });
+            if (err < 0) {
+                return err;
+            }
+        }
+
+        // Packed leaves can't be modified in place, so those go through
+        // add, which unpacks them.
+        if (copying || packed) {
+            KEY key{ 0 };
+            VALUE value;
+
+            auto err = dereference(true, value_ptr.node, [&](page_lock &/*lock*/, default_node_type *node) -> int32_t {
+                leaf_entry(node, value_ptr.index, &key, &value);
+                return 0;
+            });
+            if (err < 0) {
+                return err;
+            }
+
+            err = fn(&value);
+            if (err <= 0) {
+                return err;
+            }
+
+            return add(key, &value, &value_ptr);
+        }
+
+        auto err = dereference(false, value_ptr.node, [&](page_lock &lock, default_node_type *node) -> int32_t {
+            auto value = &node->d.values[value_ptr.index];
+
+            auto err = fn(value);
+            if (err < 0) {
+                return err;
+            }
+
+            if (err > 0) {
+                lock.dirty();
+            }
+
+            return 0;
+        });
+        if (err < 0) {
+            return err;
+        }
+        return 0;
+    }
+
+    /**
+     * Gives every sector of this tree to the free sectors chain, which
+     * includes a root in a sector of its own.
+     */
+    int32_t reclaim(free_sectors_chain &reclaimed) {
+        auto root_only = false;
+
+        {
+            buffer_type buffer{ *buffers_, *sectors_ };
+
+            auto lock = buffer.reading(root_);
+
+            root_only = ((int32_t)buffer.header<sector_chain_header_t>()->flags & (int32_t)sector_flags::Root) > 0;
+        }
+
+        if (root_only) {
+            auto err = reclaimed.add_chain(root_);
+            if (err < 0) {
+                return err;
+            }
+        }
+
+        return reclaimed.add_tree(to_tree_ptr());
+    }
+
+    int32_t add(KEY key, VALUE value) {
+        return add(key, &value, nullptr);
+    }
+
+    int32_t add(KEY key, VALUE *value, tree_value_ptr_t *found_ptr) {
+        logged_task lt{ name(), "tree-add" };
+
+        assert(root_ != InvalidSector);
+
+        if (copy_on_write()) {
+            auto err = copy_path(key, value, false, found_ptr);
+            if (err < 0) {
+                return err;
+            }
+
+            return 0;
+        }
+
+        rightmost_.height = -1;
+
+        phydebugf("adding node");
+
+        node_ptr_t insertion_ptr;
+
+        auto err = dereference_root([this, &insertion_ptr, &key, &value, found_ptr](page_lock &lock, default_node_type *node, node_ptr_t node_ptr) -> int32_t {
+            phydebugf("adding node depth=%d", node->depth);
+
+            if (node->number_keys == 0) {
+                assert(node->type == node_type::Leaf);
+
+                node->keys[0] = key;
+                if (value != nullptr) {
+                    node->d.values[0] = *value;
+                }
+                if (found_ptr != nullptr) {
+                    found_ptr->node = node_ptr;
+                    found_ptr->index = 0;
+                }
+                node->number_keys++;
+
+                phydebugf("value leaf=%d:%d index=%d key=%d (root)", node_ptr.sector, node_ptr.position, 0, key);
+
+                lock.dirty();
+            }
+            else if (node->number_keys == Size) {
+                phydebugf("root full, growing tree");
+
+                node_ptr_t allocated_ptr;
+                auto err = allocate_node(lock, node->type, allocated_ptr,
+                                         [this, &lock, &insertion_ptr, &key, &value, node, &node_ptr]
+                                         (page_lock &new_lock, default_node_type *new_node, node_ptr_t new_node_ptr) -> int32_t {
+
+                    // This is unusual and the reason we do this is so
+                    // that the root node is always in the same
+                    // place. This has several benefits, the most
+                    // notable of which is that we don't need to
+                    // update references to this tree when we add
+                    // values and we keep the head of the "chain"
+                    // formed by the sectors in the tree.
+                    copy_node(new_node, node);
+
+                    new_lock.dirty();
+
+                    new (node) default_node_type{ };
+                    node->type = node_type::Inner;
+                    node->depth = new_node->depth + 1;
+                    node->d.children[0] = new_node_ptr;
+
+                    auto err = split_child(new_lock, 0, node_ptr, node, new_node_ptr, new_node);
+                    if (err < 0) {
+                        return err;
+                    }
+
+                    lock.dirty();
+
+                    auto index = 0;
+                    if (!(key < node->keys[0])) {
+                        index++;
+                    }
+
+                    insertion_ptr = node->d.children[index];
+
+                    return 0;
+                });
+                if (err < 0) {
+                    return err;
+                }
+
+                phydebugf("root full, root=%d:%d old-root=%d:%d", node_ptr.sector, node_ptr.position,
+                          allocated_ptr.sector, allocated_ptr.position);
+            }
+            else {
+                insertion_ptr = node_ptr;
+            }
+
+            return 0;
+        });
+        if (err < 0) {
+            return err;
+        }
+
+        if (insertion_ptr.valid()) {
+            auto err = insert_non_full(insertion_ptr, key, value, found_ptr);
+            if (err < 0) {
+                return err;
+            }
+        }
+
+        phydebugf("done adding");
+
+        return 0;
+    }
+
+    /**
+     * Adds keys given in ascending order. Keys landing in the same leaf
+     * as the key before them are added together, so a run of neighbours
+     * costs one write of their leaf rather than one each. Keys finding
+     * their leaf full, or packed, go through add, which splits.
+     */
+    int32_t add_sorted(KEY const *keys, VALUE *values, size_t number) {
+        logged_task lt{ name(), "tree-add-sorted" };
+
+        assert(root_ != InvalidSector);
+
+        auto i = 0u;
+        while (i < number) {
+            auto added = 0u;
+
+            if (!copy_on_write()) {
+                rightmost_.height = -1;
+
+                node_ptr_t leaf_ptr;
+                KEY upper{ 0 };
+                auto bounded = false;
+                auto err = leaf_for(keys[i], leaf_ptr, upper, bounded);
+                if (err < 0) {
+                    return err;
+                }
+
+                err = dereference(false, leaf_ptr, [&](page_lock &lock, default_node_type *node) -> int32_t {
+                    if (node->type != node_type::Leaf) {
+                        return 0;
+                    }
+
+                    for ( ; i + added < number; ++added) {
+                        auto &key = keys[i + added];
+                        if (bounded && !(key < upper)) {
+                            break;
+                        }
+                        if (node->number_keys == (index_type)Size) {
+                            break;
+                        }
+
+                        insert_into_leaf(node, leaf_ptr, key, values != nullptr ? &values[i + added] : nullptr, nullptr);
+                    }
+
+                    if (added > 0) {
+                        lock.dirty();
+                    }
+
+                    return 0;
+                });
+                if (err < 0) {
+                    return err;
+                }
+            }
+
+            if (added == 0) {
+                auto err = add(keys[i], values != nullptr ? &values[i] : nullptr, nullptr);
+                if (err < 0) {
+                    return err;
+                }
+
+                added = 1;
+            }
+
+            phydebugf("%s add-sorted added=%d", name(), added);
+
+            i += added;
+        }
+
+        return 0;
+    }
+
+    int32_t append(KEY key, VALUE value) {
+        return append(key, &value, nullptr);
+    }
+
+    /**
+     * Adds a key that's greater than every key in the tree, like the
+     * positions and record numbers we index while writing files. Full
+     * nodes are left full and a new, empty node is started to their
+     * right instead of splitting them in half, because nothing will
+     * ever be inserted to their left. Keys that are out of order are
+     * passed along to add.
+     */
+    int32_t append(KEY key, VALUE *value, tree_value_ptr_t *found_ptr) {
+        logged_task lt{ name(), "tree-append" };
+
+        assert(root_ != InvalidSector);
+
+        if (copy_on_write()) {
+            return add(key, value, found_ptr);
+        }
+
+        auto err = rightmost_path();
+        if (err < 0) {
+            return err;
+        }
+
+        auto height = rightmost_.height;
+        auto ordered = true;
+        auto carrying = false;
+        node_ptr_t carry_ptr;
+        node_ptr_t created[MaximumDepth];
+
+        err = dereference(false, rightmost_.nodes[height], [&](page_lock &lock, default_node_type *node) -> int32_t {
+            if (node->type == node_type::Packed) {
+                ordered = false;
+                return 0;
+            }
+
+            assert(node->type == node_type::Leaf);
+
+            if (node->number_keys > 0 && !(node->keys[node->number_keys - 1] < key)) {
+                ordered = false;
+                return 0;
+            }
+
+            if (node->number_keys < (index_type)Size) {
+                auto index = node->number_keys;
+                node->keys[index] = key;
+                if (value != nullptr) {
+                    node->d.values[index] = *value;
+                }
+                if (found_ptr != nullptr) {
+                    found_ptr->node = rightmost_.nodes[height];
+                    found_ptr->index = index;
+                }
+                node->number_keys++;
+
+                phydebugf("append leaf=%d:%d index=%d key=%d", rightmost_.nodes[height].sector, rightmost_.nodes[height].position, index, key);
+
+                lock.dirty();
+
+                return 0;
+            }
+
+            carrying = true;
+
+            if (height > 0) {
+                auto packed = false;
+                auto err = pack_leaf(rightmost_.nodes[height - 1], rightmost_.nodes[height], node, packed);
+                if (err < 0) {
+                    return err;
+                }
+
+                // The packed copy took this leaf's place in the parent,
+                // so the leaf is reused as the new rightmost one.
+                if (packed) {
+                    node->keys[0] = key;
+                    if (value != nullptr) {
+                        node->d.values[0] = *value;
+                    }
+                    if (found_ptr != nullptr) {
+                        found_ptr->node = rightmost_.nodes[height];
+                        found_ptr->index = 0;
+                    }
+                    node->number_keys = 1;
+
+                    carry_ptr = rightmost_.nodes[height];
+
+                    phydebugf("append reused-leaf=%d:%d key=%d", carry_ptr.sector, carry_ptr.position, key);
+
+                    lock.dirty();
+
+                    return 0;
+                }
+            }
+
+            return allocate_node(lock, node_type::Leaf, carry_ptr, [&](page_lock &new_lock, default_node_type *new_node, node_ptr_t new_node_ptr) -> int32_t {
+                new_node->type = node_type::Leaf;
+                new_node->depth = node->depth;
+                new_node->keys[0] = key;
+                if (value != nullptr) {
+                    new_node->d.values[0] = *value;
+                }
+                if (found_ptr != nullptr) {
+                    found_ptr->node = new_node_ptr;
+                    found_ptr->index = 0;
+                }
+                new_node->number_keys = 1;
+
+                phydebugf("append new-leaf=%d:%d key=%d", new_node_ptr.sector, new_node_ptr.position, key);
+
+                new_lock.dirty();
+
+                return 0;
+            });
+        });
+        if (err < 0) {
+            rightmost_.height = -1;
+            return err;
+        }
+
+        if (!ordered) {
+            phydebugf("%s append out of order, adding", name());
+            return add(key, value, found_ptr);
+        }
+
+        created[height] = carry_ptr;
 
-        phydebugf("creating");
+        // Walk back up the rightmost path with the new node, until we
+        // find a parent with room for it. Full parents get an empty
+        // sibling of their own that's carried further up.
+        auto level = height;
+        while (carrying && level > 0) {
+            level--;
 
-        buffer_type db{ *buffers_, *sectors_ };
+            err = dereference(false, rightmost_.nodes[level], [&](page_lock &lock, default_node_type *node) -> int32_t {
+                assert(node->type == node_type::Inner);
 
-        auto lock = db.overwrite(root_);
+                if (node->number_keys < (index_type)Size) {
+                    node->keys[node->number_keys] = key;
+                    node->d.children[node->number_keys + 1] = carry_ptr;
+                    node->number_keys++;
 
-        assert(db.empty());
+                    lock.dirty();
 
-        db.template emplace<sector_chain_header_t>(entry_type::TreeSector);
+                    carrying = false;
 
-        phydebugf("creating new tree position=%d node-size=%d sector-size=%d", db.position(), sizeof(default_node_type), db.size());
+                    return 0;
+                }
 
-        auto placed = db.template reserve<default_node_type>();
+                node_ptr_t sibling_ptr;
+                auto err = allocate_node(lock, node_type::Inner, sibling_ptr, [&](page_lock &new_lock, default_node_type *new_node, node_ptr_t /*new_node_ptr*/) -> int32_t {
+                    new_node->type = node_type::Inner;
+                    new_node->depth = node->depth;
+                    new_node->d.children[0] = created[level + 1];
+                    new_node->number_keys = 0;
 
-        placed.record->type = node_type::Leaf;
-        placed.record->dbg.sector = lock.sector();
+                    new_lock.dirty();
 
-        lock.dirty();
+                    return 0;
+                });
+                if (err < 0) {
+                    return err;
+                }
 
-        auto err = flush(lock);
-        if (err < 0) {
-            return err;
-        }
+                created[level] = sibling_ptr;
+                carry_ptr = sibling_ptr;
 
-        return 0;
-    }
+                return 0;
+            });
+            if (err < 0) {
+                rightmost_.height = -1;
+                return err;
+            }
+        }
 
-    template<typename ModifyFunction>
-    int32_t modify_in_place(tree_value_ptr_t value_ptr, ModifyFunction fn) {
-        auto err = dereference(false, value_ptr.node, [&](page_lock &lock, default_node_type *node) -> int32_t {
-            auto value = &node->d.values[value_ptr.index];
+        // Every node along the rightmost path was full, root included.
+        auto grew = false;
+        if (carrying) {
+            assert(level == 0);
 
-            auto err = fn(value);
+            node_ptr_t left_ptr;
+            err = dereference(false, rightmost_.nodes[0], [&](page_lock &lock, default_node_type *node) -> int32_t {
+                return grow_root(lock, node, key, carry_ptr, left_ptr);
+            });
             if (err < 0) {
+                rightmost_.height = -1;
                 return err;
             }
 
-            if (err > 0) {
-                lock.dirty();
-            }
+            grew = true;
+        }
 
-            return 0;
-        });
-        if (err < 0) {
-            return err;
+        // Keep the rightmost path current, everything below the level
+        // that took the new node was just created.
+        if (grew) {
+            if (height + 2 > (int32_t)MaximumDepth) {
+                rightmost_.height = -1;
+            }
+            else {
+                for (auto i = height; i >= 0; --i) {
+                    rightmost_.nodes[i + 1] = created[i];
+                }
+                rightmost_.height = height + 1;
+            }
+        }
+        else {
+            for (auto i = level + 1; i <= height; ++i) {
+                rightmost_.nodes[i] = created[i];
+            }
         }
-        return 0;
-    }
 
-    int32_t add(KEY key, VALUE value) {
-        return add(key, &value, nullptr);
+        return 0;
     }
 
-    int32_t add(KEY key, VALUE *value, tree_value_ptr_t *found_ptr) {
-        logged_task lt{ name(), "tree-add" };
+    /**
+     * Removes the given key, borrowing from or merging with siblings to
+     * keep nodes from being left underfull. Nodes freed by merging are
+     * reused by later additions and if given a free sectors chain, any
+     * sectors left without nodes are moved there. Returns 1 if the key
+     * was removed and 0 if it wasn't found.
+     */
+    int32_t remove(KEY key, free_sectors_chain *reclaimed = nullptr) {
+        logged_task lt{ name(), "tree-remove" };
 
         assert(root_ != InvalidSector);
 
-        phydebugf("adding node");
-
-        node_ptr_t insertion_ptr;
+        // Copies don't borrow or merge, emptied leaves are left behind
+        // and skipped over by later searches.
+        if (copy_on_write()) {
+            return copy_path(key, nullptr, true, nullptr);
+        }
 
-        auto err = dereference_root([this, &insertion_ptr, &key, &value, found_ptr](page_lock &lock, default_node_type *node, node_ptr_t node_ptr) -> int32_t {
-            phydebugf("adding node depth=%d", node->depth);
+        rightmost_.height = -1;
 
-            if (node->number_keys == 0) {
-                assert(node->type == node_type::Leaf);
+        path_entry_t path[MaximumDepth];
+        auto height = 0;
 
-                node->keys[0] = key;
-                if (value != nullptr) {
-                    node->d.values[0] = *value;
-                }
-                if (found_ptr != nullptr) {
-                    found_ptr->node = node_ptr;
-                    found_ptr->index = 0;
-                }
-                node->number_keys++;
+        {
+            buffer_type db{ *buffers_, *sectors_ };
 
-                phydebugf("value leaf=%d:%d index=%d key=%d (root)", node_ptr.sector, node_ptr.position, 0, key);
+            auto lock = db.reading(root_);
 
-                lock.dirty();
-            }
-            else if (node->number_keys == Size) {
-                phydebugf("root full, growing tree");
+            auto pnode = find_root_in_sector(lock.sector(), db);
+            auto node = pnode.node;
 
-                node_ptr_t allocated_ptr;
-                auto err = allocate_node(lock, allocated_ptr,
-                                         [this, &lock, &insertion_ptr, &key, &value, node, &node_ptr]
-                                         (page_lock &new_lock, default_node_type *new_node, node_ptr_t new_node_ptr) -> int32_t {
+            assert(node != nullptr);
 
-                    // This is unusual and the reason we do this is so
-                    // that the root node is always in the same
-                    // place. This has several benefits, the most
-                    // notable of which is that we don't need to
-                    // update references to this tree when we add
-                    // values and we keep the head of the "chain"
-                    // formed by the sectors in the tree.
-                    *new_node = *node;
+            path[0].ptr = pnode.ptr;
 
-                    new_lock.dirty();
+            while (node->type == node_type::Inner) {
+                assert(height + 1 < (int32_t)MaximumDepth);
 
-                    new (node) default_node_type{ };
-                    node->type = node_type::Inner;
-                    node->depth = new_node->depth + 1;
-                    node->d.children[0] = new_node_ptr;
+                auto index = Keys::inner_position_for(key, *node);
+                auto &here = path[height];
+                auto &child = path[height + 1];
 
-                    auto err = split_child(new_lock, 0, node_ptr, node, new_node_ptr, new_node);
-                    if (err < 0) {
-                        return err;
-                    }
+                here.index = index;
 
-                    lock.dirty();
+                child.bounds = here.bounds;
+                if (index > 0) {
+                    child.bounds.has_lower = true;
+                    child.bounds.lower = node->keys[index - 1];
+                }
+                if (index < node->number_keys) {
+                    child.bounds.has_upper = true;
+                    child.bounds.upper = node->keys[index];
+                }
 
-                    auto index = 0;
-                    if (node->keys[0] < key) {
-                        index++;
-                    }
+                persisted_node_t followed;
+                auto err = follow_node_ptr(lock, node->d.children[index], followed);
+                if (err < 0) {
+                    return err;
+                }
 
-                    insertion_ptr = node->d.children[index];
+                node = followed.node;
+                child.ptr = followed.ptr;
+                height++;
+            }
+        }
 
-                    return 0;
-                });
+        // Packed leaves are turned back into regular ones before they're
+        // modified, siblings are taken care of in rebalance.
+        if (height > 0) {
+            auto &parent = path[height - 1];
+            auto err = dereference(false, parent.ptr, [&](page_lock &lock, default_node_type *node) -> int32_t {
+                auto err = unpack_child(lock, node, parent.index);
                 if (err < 0) {
                     return err;
                 }
 
-                phydebugf("root full, root=%d:%d old-root=%d:%d", node_ptr.sector, node_ptr.position,
-                          allocated_ptr.sector, allocated_ptr.position);
+                path[height].ptr = node->d.children[parent.index];
+
+                return 0;
+            });
+            if (err < 0) {
+                return err;
             }
-            else {
-                insertion_ptr = node_ptr;
+        }
+
+        auto removed = false;
+        auto underflow = false;
+
+        auto err = dereference(false, path[height].ptr, [&](page_lock &lock, default_node_type *node) -> int32_t {
+            assert(node->type == node_type::Leaf);
+
+            auto index = Keys::leaf_position_for(key, *node);
+            if (index == node->number_keys || node->keys[index] != key) {
+                return 0;
+            }
+
+            for (auto j = index; j < node->number_keys - 1; ++j) {
+                node->keys[j] = node->keys[j + 1];
+                node->d.values[j] = node->d.values[j + 1];
             }
 
+            node->number_keys--;
+
+            phydebugf("removed leaf=%d:%d index=%d key=%d nkeys=%d", path[height].ptr.sector, path[height].ptr.position, index, key, node->number_keys);
+
+            lock.dirty();
+
+            removed = true;
+            underflow = node->number_keys < MinimumKeys;
+
             return 0;
         });
         if (err < 0) {
             return err;
         }
 
-        if (insertion_ptr.valid()) {
-            auto err = insert_non_full(insertion_ptr, key, value, found_ptr);
+        if (!removed) {
+            return 0;
+        }
+
+        emptied_t emptied;
+
+        for (auto level = height; level > 0 && underflow; --level) {
+            err = rebalance(path, level, underflow, emptied);
             if (err < 0) {
                 return err;
             }
         }
 
-        phydebugf("done adding");
+        err = collapse_root(path[0].ptr, emptied);
+        if (err < 0) {
+            return err;
+        }
 
-        return 0;
+        if (reclaimed != nullptr) {
+            for (auto i = 0u; i < emptied.size; ++i) {
+                auto err = reclaim_sector(emptied.sectors[i], *reclaimed);
+                if (err < 0) {
+                    return err;
+                }
+            }
+        }
+
+        return 1;
     }
 
     int32_t find(KEY key, VALUE *value = nullptr, tree_value_ptr_t *found_ptr = nullptr) {
@@ -772,13 +2654,17 @@ public:
             node_ptr = followed.ptr;
         }
 
-        assert(node->type == node_type::Leaf);
-        auto index = Keys::leaf_position_for(key, *node);
+        assert(node->type != node_type::Inner);
+        auto index = leaf_position(node, key);
         assert(index <= node->number_keys);
-        if (index < node->number_keys && node->keys[index] == key) {
+        KEY found_key{ 0 };
+        if (index < node->number_keys) {
+            leaf_entry(node, index, &found_key, nullptr);
+        }
+        if (index < node->number_keys && found_key == key) {
             phydebugf("found! %d:%d #%d key=%d", node_ptr.sector, node_ptr.position, index, key);
             if (value != nullptr) {
-                *value = node->d.values[index];
+                leaf_entry(node, index, nullptr, value);
             }
             if (found_ptr != nullptr) {
                 found_ptr->node = node_ptr;
@@ -829,34 +2715,165 @@ public:
             node = followed.node;
         }
 
-        assert(node->type == node_type::Leaf);
-        auto index = Keys::leaf_position_for(key, *node);
+        assert(node->type != node_type::Inner);
+        auto index = leaf_position(node, key);
 
         if (index <= node->number_keys) {
             if (index > 0) {
                 index -= 1;
             }
-            if (index < node->number_keys && key == node->keys[index]) {
+            KEY found_key{ 0 };
+            if (index < node->number_keys) {
+                leaf_entry(node, index, &found_key, nullptr);
+            }
+            if (index < node->number_keys && key == found_key) {
                 if (index > 0) {
                     index -= 1;
+                    leaf_entry(node, index, &found_key, nullptr);
                 }
             }
 
-            if (index < node->number_keys) {
-                assert(node->keys[index] <= key);
+            // Every key may be after the one we're looking for, like
+            // when the first entry of an index isn't at zero.
+            if (index < node->number_keys && found_key <= key) {
+                leaf_entry(node, index, out_key, value);
 
-                if (value != nullptr) {
-                    *value = node->d.values[index];
+                return 1;
+            }
+        }
+
+        return 0;
+    }
+
+    /**
+     * Position of an in-order walk over the tree, see next(). A default
+     * constructed cursor starts before the first key. Cursors are only
+     * valid while the tree is left unmodified.
+     */
+    struct cursor_t {
+        path_entry_t path[MaximumDepth];
+        int32_t height{ -1 };
+        bool done{ false };
+    };
+
+    /**
+     * Reads the key and value after the cursor and advances it, returns 1
+     * while there are entries and 0 at the end. Each node is visited
+     * once, so walking the whole tree is a single pass over its sectors.
+     */
+    int32_t next(cursor_t &cursor, KEY *key, VALUE *value = nullptr) {
+        return next_visit(cursor, [&](KEY const &entry_key, VALUE const &entry_value) -> int32_t {
+            if (key != nullptr) {
+                *key = entry_key;
+            }
+            if (value != nullptr) {
+                *value = entry_value;
+            }
+            return 0;
+        });
+    }
+
+    /**
+     * Like next, only the entry is passed to fn while its page is held
+     * under a reading lock instead of being copied out.
+     */
+    template<typename VisitFunction>
+    int32_t next_visit(cursor_t &cursor, VisitFunction fn) {
+        if (cursor.done) {
+            return 0;
+        }
+
+        buffer_type db{ *buffers_, *sectors_ };
+
+        auto lock = db.reading(root_);
+
+        if (cursor.height < 0) {
+            auto pnode = find_root_in_sector(lock.sector(), db);
+            assert(pnode.node != nullptr);
+
+            cursor.height = 0;
+            cursor.path[0] = path_entry_t{};
+            cursor.path[0].ptr = pnode.ptr;
+
+            auto err = descend_leftmost(lock, cursor, pnode.node);
+            if (err < 0) {
+                return err;
+            }
+        }
+
+        while (true) {
+            auto &leaf = cursor.path[cursor.height];
+
+            persisted_node_t followed;
+            auto err = follow_node_ptr(lock, leaf.ptr, followed);
+            if (err < 0) {
+                return err;
+            }
+
+            auto node = followed.node;
+            assert(node->type != node_type::Inner);
+
+            if (leaf.index < node->number_keys) {
+                auto err = visit_entry(node, leaf.index++, fn);
+                if (err < 0) {
+                    return err;
                 }
-                if (out_key != nullptr) {
-                    *out_key = node->keys[index];
+                return 1;
+            }
+
+            // Climb until there's a parent with children left to visit,
+            // skipping those left behind by splits that share a node
+            // with their left sibling.
+            while (true) {
+                if (cursor.height == 0) {
+                    cursor.done = true;
+                    return 0;
                 }
 
-                return 1;
+                cursor.height--;
+
+                auto &parent = cursor.path[cursor.height];
+                auto err = follow_node_ptr(lock, parent.ptr, followed);
+                if (err < 0) {
+                    return err;
+                }
+
+                auto parent_node = followed.node;
+                parent.index++;
+                while (parent.index <= parent_node->number_keys && empty_range(parent_node, parent.index, parent.bounds)) {
+                    parent.index++;
+                }
+
+                if (parent.index <= parent_node->number_keys) {
+                    auto err = descend_leftmost(lock, cursor, parent_node);
+                    if (err < 0) {
+                        return err;
+                    }
+                    break;
+                }
             }
         }
+    }
 
-        return 0;
+    /**
+     * Passes the value at value_ptr to fn without copying it or taking a
+     * writable lock, returns fn's result.
+     */
+    template<typename VisitFunction>
+    int32_t visit(tree_value_ptr_t const &value_ptr, VisitFunction fn) {
+        int32_t visited = 0;
+        auto err = dereference(true, value_ptr.node, [&](page_lock &/*lock*/, default_node_type *node) -> int32_t {
+            assert(node->type != node_type::Inner);
+            visited = visit_entry(node, value_ptr.index, [&](KEY const &/*key*/, VALUE const &value) -> int32_t {
+                return fn(value);
+            });
+            return visited;
+        });
+        if (err < 0) {
+            return err;
+        }
+
+        return visited;
     }
 
     int32_t log(bool graph = false) {
@@ -876,6 +2893,64 @@ public:
         return log(pnode.ptr, graph);
     }
 
+private:
+    // Packed leaves have to be decoded, so those entries are copied.
+    template<typename VisitFunction>
+    static int32_t visit_entry(default_node_type const *node, index_type index, VisitFunction fn) {
+        assert(index < node->number_keys);
+
+        if (node->type != node_type::Packed) {
+            return fn(node->keys[index], node->d.values[index]);
+        }
+
+        KEY key{ 0 };
+        VALUE value;
+        leaf_entry(node, index, &key, &value);
+        return fn(key, value);
+    }
+
+    // Pushes the path to the leftmost leaf under the child the top of the
+    // cursor's path points at, or starts the leaf if it is one.
+    int32_t descend_leftmost(page_lock &lock, cursor_t &cursor, default_node_type *node) {
+        while (node->type == node_type::Inner) {
+            assert(cursor.height + 1 < (int32_t)MaximumDepth);
+
+            auto &here = cursor.path[cursor.height];
+            auto &child = cursor.path[cursor.height + 1];
+            auto index = here.index;
+
+            child = path_entry_t{};
+            child.bounds = here.bounds;
+            if (index > 0) {
+                child.bounds.has_lower = true;
+                child.bounds.lower = node->keys[index - 1];
+            }
+            if (index < node->number_keys) {
+                child.bounds.has_upper = true;
+                child.bounds.upper = node->keys[index];
+            }
+
+            auto child_ptr = node->d.children[index];
+            persisted_node_t followed;
+            auto err = follow_node_ptr(lock, child_ptr, followed);
+            if (err < 0) {
+                return err;
+            }
+
+            node = followed.node;
+            child.ptr = followed.ptr;
+            cursor.height++;
+
+            if (node->type == node_type::Inner) {
+                while (child.index < node->number_keys && empty_range(node, child.index, child.bounds)) {
+                    child.index++;
+                }
+            }
+        }
+
+        return 0;
+    }
+
 };
 
 } // namespace phylum
@@ -7,29 +7,8 @@ namespace phylum {
 static const char MSB = (char)0x80;
 static const char MSBALL = (char)~0x7F;
 
-static const unsigned long long N1 = 128; // 2 ^ 7
-static const unsigned long long N2 = 16384;
-static const unsigned long long N3 = 2097152;
-static const unsigned long long N4 = 268435456;
-static const unsigned long long N5 = 34359738368;
-static const unsigned long long N6 = 4398046511104;
-static const unsigned long long N7 = 562949953421312;
-static const unsigned long long N8 = 72057594037927936;
-static const unsigned long long N9 = 9223372036854775808U;
-
 size_t varint_encoding_length(unsigned long long n) {
-    return (
-        n < N1 ? 1
-        : n < N2 ? 2
-        : n < N3 ? 3
-        : n < N4 ? 4
-        : n < N5 ? 5
-        : n < N6 ? 6
-        : n < N7 ? 7
-        : n < N8 ? 8
-        : n < N9 ? 9
-        :         10
-        );
+    return (size_t)((70 - __builtin_clzll(n | 1)) / 7);
 }
 
 uint8_t *varint_encode(unsigned long long n, uint8_t *buf, int32_t len) {
@@ -68,4 +47,22 @@ unsigned long long varint_decode(uint8_t const *buf, size_t len, int32_t *err) {
     return result;
 }
 
+int32_t varint_decode32_slow(uint8_t const *buf, size_t len, uint32_t *value) {
+    uint32_t result = 0;
+    auto available = len < 5 ? len : 5;
+    for (auto i = 0u; i < available; ++i) {
+        uint32_t byte = buf[i];
+        result |= (byte & 0x7f) << (7 * i);
+        if (!(byte & 0x80)) {
+            // The fifth byte only has room for four more bits.
+            if (i == 4 && byte > 0x0f) {
+                return -1;
+            }
+            *value = result;
+            return i + 1;
+        }
+    }
+    return -1;
+}
+
 } // namespace phylum
@@ -13,4 +13,35 @@ uint8_t *varint_encode(unsigned long long n, uint8_t *buf, int32_t len);
 
 unsigned long long varint_decode(uint8_t const *buf, size_t len, int32_t *err);
 
+/**
+ * 32-bit varints, which covers every record delimiter. Lengths come
+ * from the highest set bit instead of a chain of comparisons.
+ */
+inline size_t varint_encoding_length32(uint32_t n) {
+    return (size_t)((38 - __builtin_clz(n | 1)) / 7);
+}
+
+int32_t varint_decode32_slow(uint8_t const *buf, size_t len, uint32_t *value);
+
+/**
+ * Returns the number of bytes decoded or -1 if the varint is truncated
+ * or wider than 32 bits. One and two byte varints, so records under
+ * 16k, don't loop.
+ */
+inline int32_t varint_decode32(uint8_t const *buf, size_t len, uint32_t *value) {
+    if (len >= 2) {
+        uint32_t b0 = buf[0];
+        if (!(b0 & 0x80)) {
+            *value = b0;
+            return 1;
+        }
+        uint32_t b1 = buf[1];
+        if (!(b1 & 0x80)) {
+            *value = (b0 & 0x7f) | (b1 << 7);
+            return 2;
+        }
+    }
+    return varint_decode32_slow(buf, len, value);
+}
+
 } // namespace phylum
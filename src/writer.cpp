@@ -19,6 +19,16 @@ int32_t varint_decoder::write(uint8_t const *data, size_t size) {
         return 0;
     }
 
+    // Usually the whole delimiter is in one write.
+    if (bytes_read_ == 0) {
+        auto err = varint_decode32(data, size, &value_);
+        if (err > 0) {
+            bytes_read_ = err;
+            done_ = true;
+            return err;
+        }
+    }
+
     read_buffer buffer{ data, size };
     while (true) {
         uint8_t byte = 0;
@@ -30,6 +40,11 @@ int32_t varint_decoder::write(uint8_t const *data, size_t size) {
             return -1;
         }
 
+        // Wider than 32 bits.
+        if (width_ >= 32) {
+            return -1;
+        }
+
         nread++;
         bytes_read_++;
 
@@ -63,4 +78,16 @@ void blake2b_writer::finalize(void *hash, size_t buffer_length) {
     b2b_.finalize(hash, buffer_length);
 }
 
+crc32_writer::crc32_writer(io_writer *target, uint32_t previous) : target_(target), crc_(previous) {
+}
+
+int32_t crc32_writer::write(uint8_t const *data, size_t size) {
+    auto err = target_->write(data, size);
+    if (err <= 0) {
+        return err;
+    }
+    crc_ = crc32_checksum(crc_, data, err);
+    return err;
+}
+
 } // namespace phylum
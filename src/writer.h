@@ -114,4 +114,21 @@ public:
     void finalize(void *hash, size_t buffer_length);
 };
 
+class crc32_writer : public io_writer {
+private:
+    io_writer *target_{ nullptr };
+    uint32_t crc_{ 0 };
+
+public:
+    crc32_writer(io_writer *target, uint32_t previous = 0);
+
+public:
+    int32_t write(uint8_t const *data, size_t size) override;
+
+public:
+    uint32_t finalize() const {
+        return crc_;
+    }
+};
+
 } // namespace phylum
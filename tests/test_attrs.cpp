@@ -1,6 +1,7 @@
 #include <directory_chain.h>
 #include <directory_tree.h>
 #include <file_appender.h>
+#include <flat_attribute_storage.h>
 #include <tree_sector.h>
 
 #include "phylum_tests.h"
@@ -43,3 +44,102 @@ TYPED_TEST(AttributesFixture, Initialize) {
         phydebug_dump_memory("attr ", (uint8_t *)&value, sizeof(value));
     });
 }
+
+TYPED_TEST(AttributesFixture, FlatUpdatesOfSomeKeepTheRest) {
+    using layout_type = typename TypeParam::first_type;
+
+    layout_type layout;
+    FlashMemory memory{ layout.sector_size };
+    memory.mounted<directory_chain>([&](auto &dir) {
+        flat_attribute_storage storage{ memory.pc() };
+        tree_ptr_t ptr;
+
+        uint32_t values[4] = { 100, 200, 300, 400 };
+        open_file_attribute attrs[4];
+        for (auto i = 0u; i < 4; ++i) {
+            attrs[i] = open_file_attribute{ (uint8_t)(i + 1), sizeof(uint32_t) };
+            attrs[i].ptr = &values[i];
+            attrs[i].dirty = true;
+        }
+
+        ASSERT_GT(storage.update(ptr, 1, attrs, 4), 0);
+
+        // Enough updates of the second one alone that the log is
+        // compacted several times.
+        for (auto i = 0u; i < 32; ++i) {
+            uint32_t value = 1000 + i;
+            open_file_attribute changing{ 2, sizeof(uint32_t) };
+            changing.ptr = &value;
+            changing.dirty = true;
+            ASSERT_GT(storage.update(ptr, 1, &changing, 1), 0);
+        }
+
+        uint32_t read[4] = { 0, 0, 0, 0 };
+        for (auto i = 0u; i < 4; ++i) {
+            attrs[i].ptr = &read[i];
+            attrs[i].dirty = false;
+        }
+
+        open_file_config file_cfg;
+        file_cfg.attributes = attrs;
+        file_cfg.nattrs = 4;
+
+        ASSERT_EQ(storage.read(ptr, 1, file_cfg), 0);
+
+        EXPECT_EQ(read[0], 100u);
+        EXPECT_EQ(read[1], 1031u);
+        EXPECT_EQ(read[2], 300u);
+        EXPECT_EQ(read[3], 400u);
+    });
+}
+
+TYPED_TEST(AttributesFixture, FlatAttributesChangingSize) {
+    using layout_type = typename TypeParam::first_type;
+
+    layout_type layout;
+    FlashMemory memory{ layout.sector_size };
+    memory.mounted<directory_chain>([&](auto &dir) {
+        flat_attribute_storage storage{ memory.pc() };
+        tree_ptr_t ptr;
+
+        uint32_t values[2] = { 100, 200 };
+        open_file_attribute attrs[2];
+        for (auto i = 0u; i < 2; ++i) {
+            attrs[i] = open_file_attribute{ (uint8_t)(i + 1), sizeof(uint32_t) };
+            attrs[i].ptr = &values[i];
+            attrs[i].dirty = true;
+        }
+
+        ASSERT_GT(storage.update(ptr, 1, attrs, 2), 0);
+
+        suppress_logs sl;
+
+        // The first one grows, logged at first and then compacted.
+        uint64_t wider = 0;
+        open_file_attribute changing{ 1, sizeof(uint64_t) };
+        changing.ptr = &wider;
+        changing.dirty = true;
+
+        uint64_t read_wider = 0;
+        uint32_t read_second = 0;
+        open_file_attribute reading[2] = {
+            open_file_attribute{ 1, sizeof(uint64_t) },
+            open_file_attribute{ 2, sizeof(uint32_t) },
+        };
+        reading[0].ptr = &read_wider;
+        reading[1].ptr = &read_second;
+
+        open_file_config file_cfg;
+        file_cfg.attributes = reading;
+        file_cfg.nattrs = 2;
+
+        for (auto i = 0u; i < 8; ++i) {
+            wider = 0x100000000ull + i;
+            ASSERT_GT(storage.update(ptr, 1, &changing, 1), 0);
+
+            ASSERT_EQ(storage.read(ptr, 1, file_cfg), 0);
+            EXPECT_EQ(read_wider, wider);
+            EXPECT_EQ(read_second, 200u);
+        }
+    });
+}
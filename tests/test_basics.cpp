@@ -10,19 +10,46 @@ using namespace phylum;
 
 TEST(General, EntrySizes) {
     EXPECT_EQ(sizeof(tree_node_t<uint32_t, uint32_t, 8>), 104u);
-    EXPECT_EQ(sizeof(super_block_t), 38u);
+    EXPECT_EQ(sizeof(super_block_t), 40u);
     EXPECT_EQ(sizeof(directory_chain_header_t), 10u);
     EXPECT_EQ(sizeof(data_chain_header_t), 12u);
+    EXPECT_EQ(sizeof(data_chain_checksummed_header_t), 16u);
     EXPECT_EQ(sizeof(file_data_t), 41u);
     EXPECT_EQ(sizeof(file_attribute_t), 7u);
     EXPECT_EQ(sizeof(file_entry_t), 71u);
     EXPECT_EQ(sizeof(dirtree_entry_t), 79u);
-    EXPECT_EQ(sizeof(dirtree_dir_t), 87u);
+    EXPECT_EQ(sizeof(dirtree_dir_t), 91u);
     EXPECT_EQ(sizeof(dirtree_file_t), 115u);
+    EXPECT_EQ(sizeof(dirtree_tree_value_t<0>), 115u);
+    EXPECT_EQ(sizeof(dirtree_tree_value_t<128>), 243u);
     EXPECT_EQ(sizeof(entry_t), 1u);
     EXPECT_EQ(sizeof(tree_node_header_t), 16u);
 }
 
+TEST(General, Varint32) {
+    uint32_t values[] = { 0, 1, 127, 128, 16383, 16384, 2097151, 2097152, 268435455, 268435456, UINT32_MAX };
+    for (auto value : values) {
+        uint8_t buffer[10];
+        auto length = varint_encoding_length(value);
+        ASSERT_EQ(varint_encoding_length32(value), length);
+        varint_encode(value, buffer, sizeof(buffer));
+
+        uint32_t decoded = 0;
+        ASSERT_EQ(varint_decode32(buffer, length, &decoded), (int32_t)length);
+        ASSERT_EQ(decoded, value);
+
+        // Truncated.
+        ASSERT_EQ(varint_decode32(buffer, length - 1, &decoded), -1);
+    }
+
+    uint8_t erased[] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+    uint32_t decoded = 0;
+    ASSERT_LT(varint_decode32(erased, sizeof(erased), &decoded), 0);
+
+    uint8_t too_wide[] = { 0xff, 0xff, 0xff, 0xff, 0x1f };
+    ASSERT_LT(varint_decode32(too_wide, sizeof(too_wide), &decoded), 0);
+}
+
 TEST(General, ObjectSizes) {
     phydebugf("sizeof(malloc_working_buffers) = %zu", sizeof(working_buffers));
     phydebugf("sizeof(memory_flash_memory) = %zu", sizeof(memory_flash_memory));
@@ -49,7 +76,8 @@ template <typename T> class BasicsFixture : public PhylumFixture {};
 typedef ::testing::Types<
     std::pair<layout_256, directory_chain>,
     std::pair<layout_4096, directory_chain>,
-    std::pair<layout_4096, directory_tree>
+    std::pair<layout_4096, directory_tree>,
+    std::pair<layout_2048, basic_directory_tree<0>>
     >
     Implementations;
 
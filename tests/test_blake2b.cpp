@@ -0,0 +1,64 @@
+#include <blake2b.h>
+#include <writer.h>
+
+#include "phylum_tests.h"
+
+using namespace phylum;
+
+static blake2b_backend backends[] = { blake2b_backend::Portable, blake2b_backend::Sse41, blake2b_backend::Avx2, blake2b_backend::Neon };
+
+// BLAKE2b-512("abc") from RFC 7693.
+static uint8_t abc_hash[64] = {
+    0xba, 0x80, 0xa5, 0x3f, 0x98, 0x1c, 0x4d, 0x0d, 0x6a, 0x27, 0x97, 0xb6, 0x9f, 0x12, 0xf6, 0xe9,
+    0x4c, 0x21, 0x2f, 0x14, 0x68, 0x5a, 0xc4, 0xb7, 0x4b, 0x12, 0xbb, 0x6f, 0xdb, 0xff, 0xa2, 0xd1,
+    0x7d, 0x87, 0xc5, 0x39, 0x2a, 0xab, 0x79, 0x2d, 0xc2, 0x52, 0xd5, 0xde, 0x45, 0x33, 0xcc, 0x95,
+    0x18, 0xd3, 0x8a, 0xa8, 0xdb, 0xf1, 0x92, 0x5a, 0xb9, 0x23, 0x86, 0xed, 0xd4, 0x00, 0x99, 0x23,
+};
+
+TEST(Blake2b, KnownValues) {
+    ASSERT_TRUE(blake2b_supported(blake2b_selected()));
+
+    for (auto backend : backends) {
+        if (blake2b_supported(backend)) {
+            BLAKE2b b2b;
+            b2b.backend(backend);
+            b2b.reset();
+            b2b.update("abc", 3);
+
+            uint8_t hash[64];
+            b2b.finalize(hash, sizeof(hash));
+            ASSERT_EQ(memcmp(hash, abc_hash, sizeof(hash)), 0) << "backend=" << (int32_t)backend;
+        }
+    }
+}
+
+TEST(Blake2b, BackendsAgree) {
+    uint8_t data[1024 + 16];
+    for (auto i = 0u; i < sizeof(data); ++i) {
+        data[i] = (uint8_t)(i * 7919 + (i >> 3));
+    }
+
+    for (auto offset = 0u; offset < 8; offset += 3) {
+        for (auto size = 0u; size <= 1024; size += (size < 300 ? 1 : 61)) {
+            uint8_t expected[HashSize];
+            BLAKE2b portable;
+            portable.backend(blake2b_backend::Portable);
+            portable.reset(HashSize);
+            portable.update(data + offset, size);
+            portable.finalize(expected, sizeof(expected));
+
+            for (auto backend : backends) {
+                if (blake2b_supported(backend)) {
+                    uint8_t actual[HashSize];
+                    BLAKE2b b2b;
+                    b2b.backend(backend);
+                    b2b.reset(HashSize);
+                    b2b.update(data + offset, size);
+                    b2b.finalize(actual, sizeof(actual));
+                    ASSERT_EQ(memcmp(actual, expected, sizeof(actual)), 0)
+                        << "backend=" << (int32_t)backend << " offset=" << offset << " size=" << size;
+                }
+            }
+        }
+    }
+}
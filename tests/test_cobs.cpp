@@ -425,3 +425,48 @@ TEST_F(CobsFixture, Write_MultipleWrites_NullBordered) {
 
     EXPECT_EQ(memcmp(original, actual, sizeof(original)), 0);
 }
+
+class counting_writer : public io_writer {
+private:
+    io_writer *target_{ nullptr };
+
+public:
+    size_t writes{ 0 };
+
+public:
+    counting_writer(io_writer *target) : target_(target) {
+    }
+
+public:
+    int32_t write(uint8_t const *data, size_t size) override {
+        writes++;
+        return target_->write(data, size);
+    }
+};
+
+TEST_F(CobsFixture, Write_OneTargetWritePerBlock) {
+    malloc_write_buffer destination_buffer{ 2048 };
+    malloc_write_buffer lookahead{ 256 };
+    buffer_writer destination{ destination_buffer };
+    counting_writer counting{ &destination };
+    cobs_writer writer{ &counting, lookahead };
+
+    // Two full blocks and a short one, then a zero and an empty block.
+    uint8_t original[600];
+    for (auto i = 0u; i < sizeof(original); ++i) {
+        original[i] = (i % 251) + 1;
+    }
+    original[599] = 0;
+
+    ASSERT_EQ(writer.write(original, sizeof(original)), (int32_t)sizeof(original) + 4);
+    ASSERT_EQ(counting.writes, 4u);
+
+    read_buffer buffer = destination_buffer.read_back();
+    buffer_reader verifying{ buffer };
+    cobs_reader reader{ &verifying };
+    uint8_t actual[1024];
+    ASSERT_EQ(reader.read(actual, sizeof(actual)), (int32_t)sizeof(original));
+    ASSERT_EQ(memcmp(original, actual, sizeof(original)), 0);
+
+    ASSERT_EQ(reader.read(actual, sizeof(actual)), 0);
+}
@@ -0,0 +1,59 @@
+#include <crc32.h>
+#include <writer.h>
+
+#include "phylum_tests.h"
+
+using namespace phylum;
+
+static crc32_backend backends[] = { crc32_backend::Nibble, crc32_backend::Slicing8, crc32_backend::Armv8, crc32_backend::Pclmul };
+
+TEST(Crc32, KnownValues) {
+    auto check = "123456789";
+    ASSERT_EQ(crc32_checksum((uint8_t *)check, strlen(check)), 0xcbf43926u);
+    ASSERT_EQ(crc32_checksum((uint8_t *)check, 0), 0u);
+
+    for (auto backend : backends) {
+        if (crc32_supported(backend)) {
+            ASSERT_EQ(crc32_checksum(backend, 0, (uint8_t *)check, strlen(check)), 0xcbf43926u);
+        }
+    }
+}
+
+TEST(Crc32, BackendsAgree) {
+    uint8_t data[1024 + 16];
+    for (auto i = 0u; i < sizeof(data); ++i) {
+        data[i] = (uint8_t)(i * 7919 + (i >> 3));
+    }
+
+    ASSERT_TRUE(crc32_supported(crc32_selected()));
+
+    for (auto offset = 0u; offset < 8; ++offset) {
+        for (auto size = 0u; size <= 1024; size += (size < 160 ? 1 : 37)) {
+            auto expected = crc32_checksum(crc32_backend::Nibble, 0x5c423de, data + offset, size);
+            for (auto backend : backends) {
+                if (crc32_supported(backend)) {
+                    ASSERT_EQ(crc32_checksum(backend, 0x5c423de, data + offset, size), expected)
+                        << "backend=" << (int32_t)backend << " offset=" << offset << " size=" << size;
+                }
+            }
+        }
+    }
+}
+
+TEST(Crc32, ChainsAcrossCalls) {
+    uint8_t data[300];
+    for (auto i = 0u; i < sizeof(data); ++i) {
+        data[i] = (uint8_t)(i * 31);
+    }
+
+    auto whole = crc32_checksum(data, sizeof(data));
+    auto first = crc32_checksum(data, 100);
+    ASSERT_EQ(crc32_checksum(first, data + 100, 200), whole);
+
+    noop_writer target;
+    crc32_writer writer{ &target };
+    ASSERT_EQ(writer.write(data, 7), 7);
+    ASSERT_EQ(writer.write(data + 7, 200), 200);
+    ASSERT_EQ(writer.write(data + 207, 93), 93);
+    ASSERT_EQ(writer.finalize(), whole);
+}
@@ -0,0 +1,207 @@
+#include <vector>
+
+#include <delta.h>
+#include <data_chain.h>
+#include <directory_tree.h>
+#include <file_appender.h>
+#include <file_reader.h>
+#include <super_chain.h>
+#include <file_ops.h>
+
+#include "phylum_tests.h"
+#include "geometry.h"
+
+using namespace phylum;
+
+static constexpr size_t RecordSize = 128;
+
+/**
+ * Mostly constant records with a counter and a few slowly changing
+ * readings, like the sensor data this is meant for.
+ */
+static std::vector<uint8_t> sample_record(uint32_t number) {
+    std::vector<uint8_t> record(RecordSize);
+    for (auto i = 0u; i < RecordSize; ++i) {
+        record[i] = (uint8_t)lorem1k[i];
+    }
+    memcpy(record.data(), &number, sizeof(number));
+    record[40] = (uint8_t)(number / 7);
+    record[90] = (uint8_t)(number / 13);
+    return record;
+}
+
+TEST(Delta, RoundTrip) {
+    uint8_t storage[8192];
+    uint8_t writer_previous[RecordSize];
+    uint8_t writer_encoded[RecordSize + 1];
+    uint8_t reader_previous[RecordSize];
+    uint8_t reader_encoded[RecordSize + 1];
+
+    write_buffer stored{ storage, sizeof(storage) };
+    write_buffer wp{ writer_previous, sizeof(writer_previous) };
+    write_buffer we{ writer_encoded, sizeof(writer_encoded) };
+    buffer_writer target{ stored };
+    delta_writer writer{ &target, wp, we };
+
+    auto raw = 0u;
+    for (auto i = 0u; i < 100; ++i) {
+        if (i % 25 == 0) {
+            writer.keyframe();
+        }
+        auto record = sample_record(i);
+        // Shorter records exercise zero filling the tail.
+        auto size = i % 10 == 9 ? RecordSize / 2 : RecordSize;
+        ASSERT_GT(writer.write(record.data(), size), 0);
+        raw += size;
+    }
+
+    ASSERT_LT(stored.position(), raw / 4);
+
+    auto written = stored.read_back();
+    buffer_reader source{ written };
+    write_buffer rp{ reader_previous, sizeof(reader_previous) };
+    write_buffer re{ reader_encoded, sizeof(reader_encoded) };
+    delta_reader reader{ &source, rp, re };
+
+    for (auto i = 0u; i < 100; ++i) {
+        auto record = sample_record(i);
+        auto size = i % 10 == 9 ? RecordSize / 2 : RecordSize;
+        uint8_t buffer[RecordSize];
+        ASSERT_EQ(reader.read(buffer, sizeof(buffer)), (int32_t)size) << "record=" << i;
+        ASSERT_EQ(memcmp(buffer, record.data(), size), 0) << "record=" << i;
+    }
+
+    uint8_t buffer[RecordSize];
+    ASSERT_EQ(reader.read(buffer, sizeof(buffer)), 0);
+}
+
+TEST(Delta, RecordBeforeKeyframeRejected) {
+    uint8_t storage[1024];
+    uint8_t previous[RecordSize];
+    uint8_t encoded[RecordSize + 1];
+
+    write_buffer stored{ storage, sizeof(storage) };
+    write_buffer wp{ previous, sizeof(previous) };
+    write_buffer we{ encoded, sizeof(encoded) };
+    buffer_writer target{ stored };
+    delta_writer writer{ &target, wp, we };
+
+    auto first = sample_record(0);
+    auto second = sample_record(1);
+    auto keyframe_length = writer.write(first.data(), first.size());
+    ASSERT_EQ(keyframe_length, (int32_t)(RecordSize + 1 + 2));
+    ASSERT_LT(writer.write(second.data(), second.size()), 16);
+
+    // Starting at the second record has nothing to apply the delta to.
+    auto written = stored.read_back();
+    read_buffer skipped{ written.ptr() + keyframe_length, written.size() - keyframe_length };
+    buffer_reader source{ skipped };
+    delta_reader reader{ &source, wp, we };
+
+    uint8_t buffer[RecordSize];
+    ASSERT_LT(reader.read(buffer, sizeof(buffer)), 0);
+}
+
+TEST(Delta, RecordTooLargeRejected) {
+    uint8_t storage[1024];
+    uint8_t previous[RecordSize];
+    uint8_t encoded[RecordSize + 1];
+
+    write_buffer stored{ storage, sizeof(storage) };
+    write_buffer wp{ previous, sizeof(previous) };
+    write_buffer we{ encoded, sizeof(encoded) };
+    buffer_writer target{ stored };
+    delta_writer writer{ &target, wp, we };
+
+    std::vector<uint8_t> record(RecordSize + 1);
+    ASSERT_LT(writer.write(record.data(), record.size()), 0);
+    ASSERT_EQ(stored.position(), 0u);
+}
+
+class DeltaFixture : public PhylumFixture {};
+
+TEST_F(DeltaFixture, IndexedKeyframesSeek) {
+    using tree_type = tree_sector<uint32_t, uint32_t, 63>;
+    using file_ops_type = file_ops<directory_tree, tree_type>;
+
+    layout_4096 layout;
+    FlashMemory memory{ layout.sector_size };
+
+    uint8_t previous[RecordSize];
+    uint8_t encoded[RecordSize + 1];
+    write_buffer pb{ previous, sizeof(previous) };
+    write_buffer eb{ encoded, sizeof(encoded) };
+
+    auto records = 20000u;
+    auto keyframes = 0u;
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        file_ops_type fops{ memory.pc(), super };
+        ASSERT_EQ(fops.format(), 0);
+        ASSERT_EQ(fops.touch("data.bin"), 0);
+
+        ASSERT_EQ(fops.dir().find("data.bin", open_file_config{ }), 1);
+
+        file_appender appender{ memory.pc(), &fops.dir(), fops.dir().open() };
+        delta_writer writer{ &appender, pb, eb };
+
+        for (auto i = 0u; i < records; ++i) {
+            auto err = fops.index_if_necessary(appender, i);
+            ASSERT_GE(err, 0);
+            if (err > 0) {
+                writer.keyframe();
+                keyframes++;
+            }
+
+            auto record = sample_record(i);
+            ASSERT_GT(writer.write(record.data(), record.size()), 0);
+        }
+
+        ASSERT_EQ(appender.flush(), 0);
+    });
+
+    ASSERT_GT(keyframes, 1u);
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        file_ops_type fops{ memory.pc(), super };
+
+        ASSERT_EQ(fops.dir().find("data.bin", open_file_config{ }), 1);
+
+        data_chain chain{ memory.pc(), fops.dir().open().chain };
+        ASSERT_LT(chain.total_bytes(), records * RecordSize / 4);
+
+        file_reader reader{ memory.pc(), &fops.dir(), fops.dir().open() };
+        delta_reader deltas{ &reader, pb, eb };
+
+        for (auto i = 0u; i < records; ++i) {
+            auto record = sample_record(i);
+            uint8_t buffer[RecordSize];
+            ASSERT_EQ(deltas.read(buffer, sizeof(buffer)), (int32_t)RecordSize);
+            ASSERT_EQ(memcmp(buffer, record.data(), RecordSize), 0) << "record=" << i;
+        }
+    });
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        file_ops_type fops{ memory.pc(), super };
+
+        ASSERT_EQ(fops.dir().find("data.bin", open_file_config{ }), 1);
+
+        for (auto desired : { 0u, 1u, records / 3, records / 2 + 7, records - 1 }) {
+            file_reader reader{ memory.pc(), &fops.dir(), fops.dir().open() };
+            delta_reader deltas{ &reader, pb, eb };
+
+            auto found = fops.seek_indexed_record(reader, desired);
+            ASSERT_GE(found, 0);
+            ASSERT_LE((uint32_t)found, desired);
+            if (desired == records - 1) {
+                ASSERT_GT(found, 0);
+            }
+            ASSERT_EQ(deltas.skip(desired - found), (int32_t)(desired - found));
+
+            auto record = sample_record(desired);
+            uint8_t buffer[RecordSize];
+            ASSERT_EQ(deltas.read(buffer, sizeof(buffer)), (int32_t)RecordSize);
+            ASSERT_EQ(memcmp(buffer, record.data(), RecordSize), 0) << "record=" << desired;
+        }
+    });
+}
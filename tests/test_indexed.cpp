@@ -1,3 +1,5 @@
+#include <set>
+
 #include "string_format.h"
 
 #include <directory_chain.h>
@@ -80,6 +82,489 @@ TYPED_TEST(IndexedFixture, TouchedIndexed_10) {
     });
 }
 
+TYPED_TEST(IndexedFixture, TouchedIndexed_CopyOnWrite_10) {
+    using layout_type = typename TypeParam::layout_type;
+    using directory_type = typename TypeParam::directory_type;
+    using tree_type = typename TypeParam::tree_type;
+    using file_ops_type = file_ops<directory_type, tree_type>;
+
+    layout_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    std::vector<std::string> files;
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        file_ops_type fops{ memory.pc(), super };
+        ASSERT_EQ(fops.format(), 0);
+    });
+
+    for (auto i = 0; i < 10; ++i) {
+        memory.mounted<super_chain>([&](super_chain &super) {
+            std::string name = string_format("data-%d.txt", i);
+            file_ops_type fops{ memory.pc(), super };
+            fops.dir().copy_on_write(true);
+            auto before = super.directory_tree();
+            ASSERT_EQ(fops.touch(name.c_str()), 0);
+            ASSERT_NE(super.directory_tree().root, before.root);
+            files.push_back(name);
+        });
+    }
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        directory_type dir{ memory.pc(), super.directory_tree() };
+
+        for (auto name : files) {
+            ASSERT_EQ(dir.template find(name.c_str(), open_file_config{ }), 1);
+        }
+    });
+}
+
+TYPED_TEST(IndexedFixture, TouchedIndexed_Readdir) {
+    using layout_type = typename TypeParam::layout_type;
+    using directory_type = typename TypeParam::directory_type;
+    using tree_type = typename TypeParam::tree_type;
+    using file_ops_type = file_ops<directory_type, tree_type>;
+
+    layout_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    std::set<std::string> files;
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        file_ops_type fops{ memory.pc(), super };
+        ASSERT_EQ(fops.format(), 0);
+
+        for (auto i = 0; i < 20; ++i) {
+            std::string name = string_format("data-%d.txt", i);
+            ASSERT_EQ(fops.touch(name.c_str()), 0);
+            files.insert(name);
+        }
+
+        ASSERT_EQ(fops.unlink("data-7.txt"), 0);
+        files.erase("data-7.txt");
+    });
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        directory_type dir{ memory.pc(), super.directory_tree() };
+
+        std::set<std::string> listed;
+        typename directory_type::cursor_type cursor;
+        directory_entry entry;
+        file_id_t previous = 0;
+        while (dir.readdir(cursor, entry) == 1) {
+            ASSERT_EQ(entry.type, entry_type::FsFileEntry);
+            ASSERT_EQ(entry.id, make_file_id(entry.name));
+            ASSERT_TRUE(listed.empty() || previous < entry.id);
+            previous = entry.id;
+            listed.insert(entry.name);
+        }
+
+        ASSERT_EQ(listed, files);
+    });
+}
+
+TYPED_TEST(IndexedFixture, TouchedIndexed_Subdirectories) {
+    using layout_type = typename TypeParam::layout_type;
+    using directory_type = typename TypeParam::directory_type;
+    using tree_type = typename TypeParam::tree_type;
+    using file_ops_type = file_ops<directory_type, tree_type>;
+
+    layout_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        file_ops_type fops{ memory.pc(), super };
+        ASSERT_EQ(fops.format(), 0);
+
+        ASSERT_EQ(fops.mkdir("module-0"), 0);
+        ASSERT_EQ(fops.mkdir("module-1"), 0);
+        ASSERT_EQ(fops.mkdir("/module-1/logs"), 0);
+        ASSERT_EQ(fops.mkdir("module-1"), 0);
+        ASSERT_LT(fops.mkdir("module-2/logs"), 0);
+
+        for (auto i = 0; i < 20; ++i) {
+            std::string name = string_format("module-%d/data-%d.txt", i % 2, i);
+            ASSERT_EQ(fops.touch(name.c_str()), 0);
+        }
+
+        ASSERT_EQ(fops.touch("module-1/logs/startup.txt"), 0);
+        ASSERT_EQ(fops.touch("data.txt"), 0);
+        ASSERT_EQ(fops.touch("/slashed.txt"), 0);
+        ASSERT_LT(fops.touch("module-2/data.txt"), 0);
+        ASSERT_LT(fops.unlink("module-1/logs"), 0);
+    });
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        directory_type dir{ memory.pc(), super.directory_tree() };
+
+        ASSERT_EQ(dir.find("module-0/data-0.txt", open_file_config{}), 1);
+        ASSERT_EQ(dir.find("module-1/data-0.txt", open_file_config{}), 0);
+        ASSERT_EQ(dir.find("module-1/logs/startup.txt", open_file_config{}), 1);
+        ASSERT_EQ(dir.find("module-2/data-0.txt", open_file_config{}), 0);
+        ASSERT_EQ(dir.find("data.txt", open_file_config{}), 1);
+        // Leading slashes are dropped rather than kept in the name.
+        ASSERT_EQ(dir.find("slashed.txt", open_file_config{}), 1);
+        ASSERT_EQ(dir.find("/slashed.txt", open_file_config{}), 1);
+        ASSERT_EQ(dir.find("module-0", open_file_config{}), 0);
+
+        std::set<std::string> root;
+        typename directory_type::directory_cursor cursor;
+        directory_entry entry;
+        ASSERT_EQ(dir.opendir("/", cursor), 1);
+        while (dir.readdir(cursor, entry) == 1) {
+            root.insert(entry.name);
+        }
+        ASSERT_EQ(root, (std::set<std::string>{ "data.txt", "slashed.txt", "module-0", "module-1" }));
+
+        std::set<std::string> listed;
+        ASSERT_EQ(dir.opendir("module-1", cursor), 1);
+        // Finding files elsewhere leaves the listing alone.
+        ASSERT_EQ(dir.find("module-0/data-2.txt", open_file_config{}), 1);
+        while (dir.readdir(cursor, entry) == 1) {
+            if (entry.type == entry_type::FsDirectoryEntry) {
+                ASSERT_STREQ(entry.name, "logs");
+            }
+            listed.insert(entry.name);
+        }
+        ASSERT_EQ(listed.size(), 11u);
+        ASSERT_EQ(listed.count("data-1.txt"), 1u);
+        ASSERT_EQ(listed.count("data-2.txt"), 0u);
+
+        ASSERT_EQ(dir.opendir("module-2", cursor), 0);
+    });
+}
+
+TYPED_TEST(IndexedFixture, TouchedIndexed_SubdirectoryAppend) {
+    using layout_type = typename TypeParam::layout_type;
+    using directory_type = typename TypeParam::directory_type;
+    using tree_type = typename TypeParam::tree_type;
+    using file_ops_type = file_ops<directory_type, tree_type>;
+
+    layout_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    auto hello = "Hello, world!";
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        file_ops_type fops{ memory.pc(), super };
+        ASSERT_EQ(fops.format(), 0);
+        ASSERT_EQ(fops.mkdir("module"), 0);
+        ASSERT_EQ(fops.touch("data.txt"), 0);
+        ASSERT_EQ(fops.touch("module/data.txt"), 0);
+
+        ASSERT_EQ(fops.dir().find("module/data.txt", open_file_config{ }), 1);
+
+        file_appender opened{ fops.pc(), &fops.dir(), fops.dir().open() };
+        for (auto i = 0; i < 20; ++i) {
+            ASSERT_EQ(opened.write(hello), (int32_t)strlen(hello));
+        }
+        ASSERT_EQ(opened.close(), 0);
+    });
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        file_ops_type fops{ memory.pc(), super };
+
+        uint8_t buffer[512];
+
+        ASSERT_EQ(fops.dir().find("data.txt", open_file_config{ }), 1);
+        file_reader empty{ fops.pc(), &fops.dir(), fops.dir().open() };
+        ASSERT_EQ(empty.read(buffer, sizeof(buffer)), 0);
+
+        ASSERT_EQ(fops.dir().find("module/data.txt", open_file_config{ }), 1);
+        file_reader reader{ fops.pc(), &fops.dir(), fops.dir().open() };
+        ASSERT_EQ(reader.read(buffer, sizeof(buffer)), (int32_t)strlen(hello) * 20);
+        ASSERT_EQ(memcmp(buffer, hello, strlen(hello)), 0);
+    });
+}
+
+TYPED_TEST(IndexedFixture, TouchedIndexed_SubdirectoriesCopyOnWrite) {
+    using layout_type = typename TypeParam::layout_type;
+    using directory_type = typename TypeParam::directory_type;
+    using tree_type = typename TypeParam::tree_type;
+    using file_ops_type = file_ops<directory_type, tree_type>;
+
+    layout_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        file_ops_type fops{ memory.pc(), super };
+        ASSERT_EQ(fops.format(), 0);
+        ASSERT_EQ(fops.mkdir("module"), 0);
+        ASSERT_EQ(fops.mkdir("module/logs"), 0);
+    });
+
+    for (auto i = 0; i < 10; ++i) {
+        memory.mounted<super_chain>([&](super_chain &super) {
+            std::string name = string_format("module/logs/data-%d.txt", i);
+            file_ops_type fops{ memory.pc(), super };
+            fops.dir().copy_on_write(true);
+            auto before = super.directory_tree();
+            ASSERT_EQ(fops.touch(name.c_str()), 0);
+            ASSERT_NE(super.directory_tree().root, before.root);
+        });
+    }
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        directory_type dir{ memory.pc(), super.directory_tree() };
+
+        for (auto i = 0; i < 10; ++i) {
+            std::string name = string_format("module/logs/data-%d.txt", i);
+            ASSERT_EQ(dir.find(name.c_str(), open_file_config{ }), 1);
+        }
+    });
+}
+
+TYPED_TEST(IndexedFixture, WriteFile_InlineCopyOnWrite) {
+    using layout_type = typename TypeParam::layout_type;
+    using directory_type = typename TypeParam::directory_type;
+    using tree_type = typename TypeParam::tree_type;
+    using file_ops_type = file_ops<directory_type, tree_type>;
+
+    layout_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        file_ops_type fops{ memory.pc(), super };
+        ASSERT_EQ(fops.format(), 0);
+        ASSERT_EQ(fops.touch("data.txt"), 0);
+    });
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        file_ops_type fops{ memory.pc(), super };
+        fops.dir().copy_on_write(true);
+        ASSERT_EQ(fops.dir().find("data.txt", open_file_config{ }), 1);
+
+        file_appender opened{ fops.pc(), &fops.dir(), fops.dir().open() };
+        ASSERT_EQ(opened.write((uint8_t const *)lorem1k, 20), 20);
+        ASSERT_EQ(fops.close(opened), 0);
+    });
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        file_ops_type fops{ memory.pc(), super };
+        ASSERT_EQ(fops.dir().find("data.txt", open_file_config{ }), 1);
+
+        file_reader reader{ fops.pc(), &fops.dir(), fops.dir().open() };
+        uint8_t buffer[256];
+        ASSERT_EQ(reader.read(buffer, sizeof(buffer)), 20);
+        ASSERT_EQ(memcmp(buffer, lorem1k, 20), 0);
+    });
+}
+
+TYPED_TEST(IndexedFixture, WriteFile_ChainedCopyOnWrite) {
+    using layout_type = typename TypeParam::layout_type;
+    using directory_type = typename TypeParam::directory_type;
+    using tree_type = typename TypeParam::tree_type;
+    using file_ops_type = file_ops<directory_type, tree_type>;
+
+    layout_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        file_ops_type fops{ memory.pc(), super };
+        ASSERT_EQ(fops.format(), 0);
+        ASSERT_EQ(fops.touch("data.txt"), 0);
+    });
+
+    auto written = 0u;
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        file_ops_type fops{ memory.pc(), super };
+        fops.dir().copy_on_write(true);
+        ASSERT_EQ(fops.dir().find("data.txt", open_file_config{ }), 1);
+
+        file_appender opened{ fops.pc(), &fops.dir(), fops.dir().open() };
+        while (written < 10000) {
+            ASSERT_GE(fops.index_if_necessary(opened, 0), 0);
+            auto wrote = opened.write(lorem1k);
+            ASSERT_GT(wrote, 0);
+            written += wrote;
+        }
+        ASSERT_EQ(fops.flush(opened), 0);
+        ASSERT_EQ(fops.close(opened), 0);
+    });
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        file_ops_type fops{ memory.pc(), super };
+        ASSERT_EQ(fops.dir().find("data.txt", open_file_config{ }), 1);
+
+        file_reader reader{ fops.pc(), &fops.dir(), fops.dir().open() };
+        ASSERT_EQ(fops.seek_position(reader, UINT32_MAX), (int32_t)written);
+    });
+}
+
+TYPED_TEST(IndexedFixture, TouchedIndexed_CollidingIds) {
+    using layout_type = typename TypeParam::layout_type;
+    using directory_type = typename TypeParam::directory_type;
+    using tree_type = typename TypeParam::tree_type;
+    using file_ops_type = file_ops<directory_type, tree_type>;
+
+    layout_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    // These two share a CRC32 and so a file id.
+    auto first = "f-uejgtcuo.dat";
+    auto second = "f-iiwucoup.dat";
+    ASSERT_EQ(make_file_id(first), make_file_id(second));
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        file_ops_type fops{ memory.pc(), super };
+        ASSERT_EQ(fops.format(), 0);
+        ASSERT_EQ(fops.touch(first), 0);
+        ASSERT_EQ(fops.touch(second), 0);
+    });
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        directory_type dir{ memory.pc(), super.directory_tree() };
+
+        ASSERT_EQ(dir.find(first, open_file_config{ }), 1);
+        ASSERT_EQ(dir.find(second, open_file_config{ }), 1);
+
+        auto listed = 0;
+        typename directory_type::cursor_type cursor;
+        directory_entry entry;
+        while (dir.readdir(cursor, entry) == 1) {
+            listed++;
+        }
+        ASSERT_EQ(listed, 2);
+    });
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        file_ops_type fops{ memory.pc(), super };
+        ASSERT_EQ(fops.unlink(first), 0);
+    });
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        directory_type dir{ memory.pc(), super.directory_tree() };
+
+        ASSERT_EQ(dir.find(first, open_file_config{ }), 0);
+        ASSERT_EQ(dir.find(second, open_file_config{ }), 1);
+    });
+}
+
+TYPED_TEST(IndexedFixture, TouchedIndexed_Batch) {
+    using layout_type = typename TypeParam::layout_type;
+    using directory_type = typename TypeParam::directory_type;
+    using tree_type = typename TypeParam::tree_type;
+    using file_ops_type = file_ops<directory_type, tree_type>;
+
+    layout_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    std::vector<std::string> files;
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        file_ops_type fops{ memory.pc(), super };
+        ASSERT_EQ(fops.format(), 0);
+    });
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        file_ops_type fops{ memory.pc(), super };
+
+        typename directory_type::batch_type batch;
+        ASSERT_EQ(fops.begin_batch(batch), 0);
+
+        for (auto i = 0; i < 12; ++i) {
+            std::string name = string_format("data-%d.txt", i);
+            ASSERT_EQ(fops.touch(name.c_str()), 0);
+            files.push_back(name);
+        }
+
+        directory_type dir{ memory.pc(), super.directory_tree() };
+        ASSERT_EQ(dir.find(files.back().c_str(), open_file_config{ }), 0);
+
+        ASSERT_EQ(fops.commit(), 0);
+    });
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        directory_type dir{ memory.pc(), super.directory_tree() };
+
+        for (auto name : files) {
+            ASSERT_EQ(dir.find(name.c_str(), open_file_config{ }), 1);
+        }
+    });
+}
+
+TYPED_TEST(IndexedFixture, TouchedIndexed_BatchCopyOnWrite_500) {
+    using layout_type = typename TypeParam::layout_type;
+    using directory_type = typename TypeParam::directory_type;
+    using tree_type = typename TypeParam::tree_type;
+    using file_ops_type = file_ops<directory_type, tree_type>;
+
+    layout_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    std::vector<std::string> files;
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        file_ops_type fops{ memory.pc(), super };
+        ASSERT_EQ(fops.format(), 0);
+    });
+
+    // More replaced nodes than the journal holds, before the commit.
+    memory.mounted<super_chain>([&](super_chain &super) {
+        file_ops_type fops{ memory.pc(), super };
+        fops.dir().copy_on_write(true);
+
+        typename directory_type::batch_type batch;
+        ASSERT_EQ(fops.begin_batch(batch), 0);
+
+        for (auto i = 0; i < 500; ++i) {
+            std::string name = string_format("data-%d.txt", i);
+            ASSERT_EQ(fops.touch(name.c_str()), 0);
+            files.push_back(name);
+        }
+
+        ASSERT_EQ(fops.commit(), 0);
+    });
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        directory_type dir{ memory.pc(), super.directory_tree() };
+
+        for (auto name : files) {
+            ASSERT_EQ(dir.find(name.c_str(), open_file_config{ }), 1);
+        }
+    });
+}
+
+TYPED_TEST(IndexedFixture, TouchedIndexed_SmallFileStaysInline) {
+    using layout_type = typename TypeParam::layout_type;
+    using directory_type = typename TypeParam::directory_type;
+    using tree_type = typename TypeParam::tree_type;
+    using file_ops_type = file_ops<directory_type, tree_type>;
+
+    layout_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    auto hello = "Hello, world!";
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        file_ops_type fops{ memory.pc(), super };
+        ASSERT_EQ(fops.format(), 0);
+
+        auto allocated = memory.allocator().allocated();
+
+        ASSERT_EQ(fops.touch("data.txt"), 0);
+        ASSERT_EQ(fops.dir().find("data.txt", open_file_config{ }), 1);
+
+        file_appender opened{ fops.pc(), &fops.dir(), fops.dir().open() };
+        ASSERT_EQ(fops.index_if_necessary(opened, 0), 0);
+        ASSERT_EQ(opened.write(hello), (int32_t)strlen(hello));
+        ASSERT_EQ(opened.close(), 0);
+
+        ASSERT_EQ(memory.allocator().allocated(), allocated);
+    });
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        file_ops_type fops{ memory.pc(), super };
+        ASSERT_EQ(fops.dir().find("data.txt", open_file_config{ }), 1);
+
+        file_reader reader{ fops.pc(), &fops.dir(), fops.dir().open() };
+        uint8_t buffer[256];
+        ASSERT_EQ(reader.read(buffer, sizeof(buffer)), (int32_t)strlen(hello));
+        ASSERT_EQ(memcmp(buffer, hello, strlen(hello)), 0);
+    });
+}
+
 TYPED_TEST(IndexedFixture, TouchedIndexed_100_FindAfterEach) {
     using layout_type = typename TypeParam::layout_type;
     using directory_type = typename TypeParam::directory_type;
@@ -256,6 +741,98 @@ TYPED_TEST(IndexedFixture, WriteFile_Large_Position_SeekBeginningAndEnd) {
     });
 }
 
+TYPED_TEST(IndexedFixture, WriteFile_Compressed_Position_Seeks) {
+    using layout_type = typename TypeParam::layout_type;
+    using directory_type = typename TypeParam::directory_type;
+    using tree_type = typename TypeParam::tree_type;
+    using file_ops_type = file_ops<directory_type, tree_type>;
+
+    layout_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    record_number_t record_number = 0;
+    size_t written = 0u;
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        file_ops_type fops{ memory.pc(), super };
+        ASSERT_EQ(fops.format(), 0);
+        ASSERT_EQ(fops.touch("data.txt"), 0);
+
+        ASSERT_EQ(fops.dir().find("data.txt", this->file_cfg(open_file_flags::Compressed)), 1);
+
+        write_large_file(fops, 256u * 1024u, written, record_number);
+    });
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        file_ops_type fops{ memory.pc(), super };
+
+        ASSERT_EQ(fops.dir().find("data.txt", open_file_config{ }), 1);
+        file_reader reader{ memory.pc(), &fops.dir(), fops.dir().open() };
+
+        auto length = strlen(lorem1k);
+        for (auto position : { (size_t)0u, (size_t)1000u, written / 2 + 17, written - 100 }) {
+            ASSERT_EQ(fops.seek_position(reader, position), (int32_t)position);
+
+            uint8_t buffer[256];
+            auto reading = std::min(sizeof(buffer), written - position);
+            ASSERT_EQ(reader.read(buffer, reading), (int32_t)reading);
+            for (auto i = 0u; i < reading; ++i) {
+                ASSERT_EQ(buffer[i], (uint8_t)lorem1k[(position + i) % length]);
+            }
+        }
+
+        ASSERT_EQ(fops.seek_position(reader, UINT32_MAX), (int32_t)written);
+
+        data_chain chain{ memory.pc(), fops.dir().open().chain };
+        ASSERT_EQ(chain.total_bytes(), written);
+        ASSERT_LT(chain.visited_sectors(), written / layout.sector_size / 2);
+    });
+}
+
+TYPED_TEST(IndexedFixture, WriteFile_CompressedChecksummed_Position_Seeks) {
+    using layout_type = typename TypeParam::layout_type;
+    using directory_type = typename TypeParam::directory_type;
+    using tree_type = typename TypeParam::tree_type;
+    using file_ops_type = file_ops<directory_type, tree_type>;
+
+    layout_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    record_number_t record_number = 0;
+    size_t written = 0u;
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        file_ops_type fops{ memory.pc(), super };
+        ASSERT_EQ(fops.format(), 0);
+        ASSERT_EQ(fops.touch("data.txt"), 0);
+
+        auto flags = (open_file_flags)((int32_t)open_file_flags::Compressed | (int32_t)open_file_flags::Checksummed);
+        ASSERT_EQ(fops.dir().find("data.txt", this->file_cfg(flags)), 1);
+
+        write_large_file(fops, 64u * 1024u, written, record_number);
+    });
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        file_ops_type fops{ memory.pc(), super };
+
+        ASSERT_EQ(fops.dir().find("data.txt", open_file_config{ }), 1);
+        file_reader reader{ memory.pc(), &fops.dir(), fops.dir().open() };
+        fops.verify_checksums(reader, true);
+
+        auto length = strlen(lorem1k);
+        for (auto position : { (size_t)0u, written / 2 + 17, written - 100 }) {
+            ASSERT_EQ(fops.seek_position(reader, position), (int32_t)position);
+
+            uint8_t buffer[256];
+            auto reading = std::min(sizeof(buffer), written - position);
+            ASSERT_EQ(reader.read(buffer, reading), (int32_t)reading);
+            for (auto i = 0u; i < reading; ++i) {
+                ASSERT_EQ(buffer[i], (uint8_t)lorem1k[(position + i) % length]);
+            }
+        }
+    });
+}
+
 TYPED_TEST(IndexedFixture, WriteFile_OneIndex_Records_SeekBeginningAndEnd) {
     using layout_type = typename TypeParam::layout_type;
     using directory_type = typename TypeParam::directory_type;
@@ -476,3 +1053,62 @@ TYPED_TEST(IndexedFixture, WriteFile_IndexedSeekAndAppend) {
         ASSERT_EQ(opened.visited_sectors(), 0u);
     });
 }
+
+TYPED_TEST(IndexedFixture, UnlinkReclaimsSectors) {
+    using layout_type = typename TypeParam::layout_type;
+    using directory_type = typename TypeParam::directory_type;
+    using tree_type = typename TypeParam::tree_type;
+    using file_ops_type = file_ops<directory_type, tree_type>;
+
+    layout_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    head_tail_t chain;
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        file_ops_type fops{ memory.pc(), super };
+        ASSERT_EQ(fops.format(), 0);
+        ASSERT_EQ(fops.touch("data.txt"), 0);
+        ASSERT_EQ(fops.touch("other.txt"), 0);
+
+        ASSERT_EQ(fops.dir().find("data.txt", open_file_config{ }), 1);
+
+        record_number_t record_number = 0;
+        size_t written = 0u;
+        write_large_file(fops, 64u * 1024u, written, record_number);
+    });
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        file_ops_type fops{ memory.pc(), super };
+
+        ASSERT_FALSE(super.free_chain().valid());
+
+        ASSERT_EQ(fops.dir().find("data.txt", open_file_config{ }), 1);
+        chain = fops.dir().open().chain;
+        ASSERT_TRUE(chain.valid());
+
+        ASSERT_EQ(fops.unlink("data.txt"), 0);
+    });
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        directory_type dir{ memory.pc(), super.directory_tree() };
+        ASSERT_EQ(dir.find("data.txt", open_file_config{ }), 0);
+        ASSERT_EQ(dir.find("other.txt", open_file_config{ }), 1);
+
+        ASSERT_TRUE(super.free_chain().valid());
+
+        free_sectors_chain reclaimed{ memory.pc(), super.free_chain() };
+
+        std::set<dhara_sector_t> sectors;
+        dhara_sector_t sector = InvalidSector;
+        while (reclaimed.dequeue(&sector) > 0) {
+            ASSERT_EQ(sectors.count(sector), 0u);
+            sectors.insert(sector);
+        }
+
+        // The data chain, plus both index trees.
+        ASSERT_EQ(sectors.count(chain.head), 1u);
+        ASSERT_EQ(sectors.count(chain.tail), 1u);
+        ASSERT_GT(sectors.size(), 64u * 1024u / layout.sector_size);
+    });
+}
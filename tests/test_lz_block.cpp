@@ -0,0 +1,87 @@
+#include <vector>
+
+#include <lz_block.h>
+
+#include "phylum_tests.h"
+
+using namespace phylum;
+
+static std::vector<uint8_t> repeated_text(size_t size) {
+    auto length = strlen(lorem1k);
+    std::vector<uint8_t> data(size);
+    for (auto i = 0u; i < size; ++i) {
+        data[i] = lorem1k[i % length];
+    }
+    return data;
+}
+
+static std::vector<uint8_t> random_bytes(size_t size) {
+    std::vector<uint8_t> data(size);
+    uint32_t state = 0x1234567;
+    for (auto i = 0u; i < size; ++i) {
+        state = state * 1103515245 + 12345;
+        data[i] = (uint8_t)(state >> 16);
+    }
+    return data;
+}
+
+TEST(LzBlock, KnownBlock) {
+    // Three literals, a nine byte overlapping match and five final literals.
+    uint8_t block[] = { 0x35, 'a', 'b', 'c', 0x03, 0x00, 0x50, 'a', 'b', 'c', 'a', 'b' };
+
+    uint8_t decompressed[32];
+    ASSERT_EQ(lz_decompress(block, sizeof(block), decompressed, sizeof(decompressed)), 17);
+    ASSERT_EQ(memcmp(decompressed, "abcabcabcabcabcab", 17), 0);
+}
+
+TEST(LzBlock, CompressibleRoundTrip) {
+    for (auto size : { 0u, 1u, 12u, 13u, 100u, 1024u, 4096u }) {
+        auto data = repeated_text(size);
+
+        std::vector<uint8_t> compressed(size + 16);
+        auto stored = lz_compress(data.data(), size, compressed.data(), compressed.size());
+        ASSERT_GE(stored, 0) << "size=" << size;
+        if (size >= 4096) {
+            ASSERT_LT(stored, (int32_t)size / 2) << "size=" << size;
+        }
+
+        std::vector<uint8_t> decompressed(size + 1);
+        ASSERT_EQ(lz_decompress(compressed.data(), stored, decompressed.data(), size), (int32_t)size);
+        ASSERT_EQ(memcmp(decompressed.data(), data.data(), size), 0);
+    }
+}
+
+TEST(LzBlock, IncompressibleDoesNotFit) {
+    auto data = random_bytes(2048);
+
+    std::vector<uint8_t> compressed(data.size() + data.size() / 255 + 16);
+    ASSERT_EQ(lz_compress(data.data(), data.size(), compressed.data(), data.size() - 1), -1);
+
+    auto stored = lz_compress(data.data(), data.size(), compressed.data(), compressed.size());
+    ASSERT_GT(stored, 0);
+
+    std::vector<uint8_t> decompressed(data.size());
+    ASSERT_EQ(lz_decompress(compressed.data(), stored, decompressed.data(), decompressed.size()), (int32_t)data.size());
+    ASSERT_EQ(memcmp(decompressed.data(), data.data(), data.size()), 0);
+}
+
+TEST(LzBlock, MalformedRejected) {
+    auto data = repeated_text(1024);
+
+    std::vector<uint8_t> compressed(data.size());
+    auto stored = lz_compress(data.data(), data.size(), compressed.data(), compressed.size());
+    ASSERT_GT(stored, 0);
+
+    std::vector<uint8_t> decompressed(data.size());
+
+    // Too small a destination.
+    ASSERT_EQ(lz_decompress(compressed.data(), stored, decompressed.data(), data.size() - 1), -1);
+
+    // Match offset before the start of the output.
+    uint8_t bad_offset[] = { 0x10, 'a', 0x02, 0x00, 0x50, 'a', 'b', 'c', 'd', 'e' };
+    ASSERT_EQ(lz_decompress(bad_offset, sizeof(bad_offset), decompressed.data(), decompressed.size()), -1);
+
+    // Literals running past the end of the block.
+    uint8_t truncated[] = { 0x50, 'a', 'b' };
+    ASSERT_EQ(lz_decompress(truncated, sizeof(truncated), decompressed.data(), decompressed.size()), -1);
+}
@@ -384,3 +384,103 @@ TYPED_TEST(ReadFixture, ReadInlineWrite_NullRead) {
         ASSERT_EQ(reader.close(), 0);
     });
 }
+
+TYPED_TEST(ReadFixture, ReadDataChain_CorruptedPayload) {
+    using dir_type = typename TypeParam::second_type;
+    typename TypeParam::first_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    auto bytes_wrote = 0;
+
+    memory.mounted<dir_type>([&](auto &chain) {
+        ASSERT_EQ(chain.touch("data.txt"), 0);
+
+        open_file_config file_cfg;
+        file_cfg.flags = open_file_flags::Checksummed;
+
+        ASSERT_EQ(chain.find("data.txt", file_cfg), 1);
+        file_appender opened{ memory.pc(), &chain, chain.open() };
+        for (auto i = 0; i < 4; ++i) {
+            ASSERT_GT(opened.write(lorem1k), 0);
+            bytes_wrote += strlen(lorem1k);
+        }
+        ASSERT_EQ(opened.close(), 0);
+    });
+
+    // Flip a payload byte in the first data sector.
+    std::vector<uint8_t> raw(layout.sector_size);
+    auto corrupted = false;
+    for (auto sector = 0u; sector < memory.sectors().size() && !corrupted; ++sector) {
+        ASSERT_GE(memory.sectors().read(sector, raw.data(), raw.size()), 0);
+        if (raw[2] == (uint8_t)entry_type::DataSector) {
+            raw[64] ^= 0xff;
+            ASSERT_GE(memory.sectors().write(sector, raw.data(), raw.size()), 0);
+            corrupted = true;
+        }
+    }
+    ASSERT_TRUE(corrupted);
+
+    // Drop any cached copies of the sector.
+    memory.buffers().clear();
+
+    memory.mounted<dir_type>([&](auto &chain) {
+        ASSERT_EQ(chain.find("data.txt", open_file_config{ }), 1);
+        file_reader reader{ memory.pc(), &chain, chain.open() };
+
+        ASSERT_LT(reader.read(bytes_wrote), 0);
+    });
+
+    memory.mounted<dir_type>([&](auto &chain) {
+        open_file_config file_cfg;
+        file_cfg.flags = open_file_flags::Unverified;
+
+        ASSERT_EQ(chain.find("data.txt", file_cfg), 1);
+        file_reader reader{ memory.pc(), &chain, chain.open() };
+
+        ASSERT_EQ(reader.read(bytes_wrote), bytes_wrote);
+    });
+}
+
+TYPED_TEST(ReadFixture, ReadDataChain_UnchecksummedIgnoresCorruption) {
+    using dir_type = typename TypeParam::second_type;
+    typename TypeParam::first_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    auto bytes_wrote = 0;
+
+    memory.mounted<dir_type>([&](auto &chain) {
+        ASSERT_EQ(chain.touch("data.txt"), 0);
+
+        ASSERT_EQ(chain.find("data.txt", open_file_config{ }), 1);
+        file_appender opened{ memory.pc(), &chain, chain.open() };
+        for (auto i = 0; i < 4; ++i) {
+            ASSERT_GT(opened.write(lorem1k), 0);
+            bytes_wrote += strlen(lorem1k);
+        }
+        ASSERT_EQ(opened.close(), 0);
+    });
+
+    // Sectors written without a checksum have nothing to check.
+    std::vector<uint8_t> raw(layout.sector_size);
+    auto corrupted = false;
+    for (auto sector = 0u; sector < memory.sectors().size() && !corrupted; ++sector) {
+        ASSERT_GE(memory.sectors().read(sector, raw.data(), raw.size()), 0);
+        if (raw[2] == (uint8_t)entry_type::DataSector) {
+            auto header = (data_chain_header_t const *)&raw[2];
+            ASSERT_EQ((int32_t)header->flags & (int32_t)sector_flags::Checksummed, 0);
+            raw[64] ^= 0xff;
+            ASSERT_GE(memory.sectors().write(sector, raw.data(), raw.size()), 0);
+            corrupted = true;
+        }
+    }
+    ASSERT_TRUE(corrupted);
+
+    memory.buffers().clear();
+
+    memory.mounted<dir_type>([&](auto &chain) {
+        ASSERT_EQ(chain.find("data.txt", open_file_config{ }), 1);
+        file_reader reader{ memory.pc(), &chain, chain.open() };
+
+        ASSERT_EQ(reader.read(bytes_wrote), bytes_wrote);
+    });
+}
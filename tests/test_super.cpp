@@ -1,5 +1,8 @@
 #include <super_chain.h>
 #include <directory_tree.h>
+#include <file_appender.h>
+#include <file_reader.h>
+#include <file_ops.h>
 
 #include "phylum_tests.h"
 #include "geometry.h"
@@ -50,3 +53,66 @@ TYPED_TEST(SuperChainFixture, FormatPersists) {
         ASSERT_EQ(super.mount(), 0);
     });
 }
+
+TYPED_TEST(SuperChainFixture, RefusesOtherVersions) {
+    using layout_type = typename TypeParam::layout_type;
+
+    layout_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    memory.begin(true);
+
+    memory.sync([&]() {
+        super_chain super{ memory.pc(), 0 };
+        ASSERT_EQ(super.format(), 0);
+    });
+
+    memory.sync([&]() {
+        paging_delimited_buffer buffer{ memory.buffers(), memory.sectors() };
+        auto lock = buffer.writing(0);
+        ASSERT_EQ(buffer.write_header<super_block_t>([&](super_block_t *header) {
+            header->version = SuperBlockVersion - 1;
+            return 0;
+        }), 0);
+        lock.dirty();
+        ASSERT_EQ(lock.flush(0), 0);
+    });
+
+    memory.sync([&]() {
+        suppress_logs sl;
+
+        super_chain super{ memory.pc(), 0 };
+        ASSERT_EQ(super.mount(), -1);
+    });
+}
+
+TYPED_TEST(SuperChainFixture, RefusesOtherInlineCapacities) {
+    using layout_type = typename TypeParam::layout_type;
+    using tree_type = tree_sector<uint32_t, uint32_t, 63>;
+
+    layout_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        ASSERT_EQ(super.inline_capacity(), UINT16_MAX);
+
+        file_ops<directory_tree, tree_type> fops{ memory.pc(), super };
+        ASSERT_EQ(fops.format(), 0);
+        ASSERT_EQ(fops.touch("data.txt"), 0);
+    });
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        ASSERT_EQ(super.inline_capacity(), (uint16_t)directory_tree::DataCapacity);
+
+        file_ops<directory_tree, tree_type> fops{ memory.pc(), super };
+        ASSERT_EQ(fops.mount(), 0);
+        ASSERT_EQ(fops.dir().find("data.txt", open_file_config{ }), 1);
+    });
+
+    memory.mounted<super_chain>([&](super_chain &super) {
+        suppress_logs sl;
+
+        file_ops<basic_directory_tree<512>, tree_type> fops{ memory.pc(), super };
+        ASSERT_EQ(fops.mount(), -1);
+    });
+}
@@ -0,0 +1,100 @@
+#include <vector>
+
+#include <directory_tree.h>
+#include <trace.h>
+
+#include "phylum_tests.h"
+#include "geometry.h"
+
+using namespace phylum;
+
+class vector_writer : public io_writer {
+public:
+    std::vector<uint8_t> data;
+
+public:
+    int32_t write(uint8_t const *buffer, size_t size) override {
+        data.insert(data.end(), buffer, buffer + size);
+        return size;
+    }
+};
+
+class TraceFixture : public PhylumFixture {};
+
+TEST_F(TraceFixture, RecordsOperations) {
+    layout_4096 layout;
+    FlashMemory memory{ layout.sector_size };
+
+    trace_event_t events[512];
+
+    memory.mounted<directory_tree>([&](auto &dir) {
+        trace_configure(events, 512);
+
+        ASSERT_EQ(dir.touch("data.txt"), 0);
+        ASSERT_EQ(dir.find("data.txt", open_file_config{ }), 1);
+
+        vector_writer writer;
+        ASSERT_GT(trace_write(writer), 0);
+
+        trace_configure(nullptr, 0);
+
+        trace_header_t header;
+        ASSERT_GE(writer.data.size(), sizeof(header));
+        memcpy(&header, writer.data.data(), sizeof(header));
+        ASSERT_EQ(header.magic, (uint32_t)trace_header_t::Magic);
+        ASSERT_EQ(header.dropped, 0u);
+        ASSERT_EQ(writer.data.size(), sizeof(header) + header.number_events * sizeof(trace_event_t));
+
+        auto recorded = (trace_event_t const *)(writer.data.data() + sizeof(header));
+        auto depth = 0;
+        auto pages = 0;
+        for (auto i = 0u; i < header.number_events; ++i) {
+            auto &event = recorded[i];
+            if (event.kind == trace_kind::Begin) {
+                depth++;
+            } else if (event.kind == trace_kind::End) {
+                depth--;
+            } else if (event.kind == trace_kind::PageOpen) {
+                ASSERT_GT(depth, 0);
+                ASSERT_TRUE(event.operation == trace_operation::Touch || event.operation == trace_operation::Find);
+                pages++;
+            }
+        }
+
+        ASSERT_EQ(recorded[0].kind, trace_kind::Begin);
+        ASSERT_EQ(recorded[0].operation, trace_operation::Touch);
+        ASSERT_EQ(depth, 0);
+        ASSERT_GT(pages, 0);
+    });
+}
+
+TEST_F(TraceFixture, RingKeepsNewest) {
+    layout_4096 layout;
+    FlashMemory memory{ layout.sector_size };
+
+    trace_event_t events[8];
+
+    memory.mounted<directory_tree>([&](auto &dir) {
+        trace_configure(events, 8);
+
+        for (auto i = 0; i < 10; ++i) {
+            ASSERT_EQ(dir.find("data.txt", open_file_config{ }), 0);
+        }
+
+        vector_writer writer;
+        ASSERT_EQ(trace_write(writer), 8);
+
+        trace_configure(nullptr, 0);
+
+        trace_header_t header;
+        memcpy(&header, writer.data.data(), sizeof(header));
+        ASSERT_EQ(header.number_events, 8u);
+        ASSERT_GT(header.dropped, 0u);
+
+        auto recorded = (trace_event_t const *)(writer.data.data() + sizeof(header));
+        ASSERT_EQ(recorded[7].kind, trace_kind::End);
+        for (auto i = 1u; i < 8; ++i) {
+            ASSERT_LE(recorded[i - 1].time, recorded[i].time);
+        }
+    });
+}
@@ -1,7 +1,13 @@
+#include <algorithm>
+#include <map>
+#include <vector>
+
 #include <directory_chain.h>
 #include <directory_tree.h>
 #include <file_appender.h>
 #include <tree_sector.h>
+#include <free_sectors_chain.h>
+#include <trace.h>
 
 #include "phylum_tests.h"
 #include "geometry.h"
@@ -19,6 +25,27 @@ TEST(TreeInfo, NodeSizes) {
     EXPECT_EQ(sizeof(tree_node_t<uint32_t, uint32_t, 291>), 2932u);
     EXPECT_EQ(sizeof(tree_node_t<uint32_t, uint32_t, 201>), 2032u);
     EXPECT_EQ(sizeof(tree_node_t<uint32_t, uint32_t, 407>), 4092u);
+
+    EXPECT_EQ((size_t)(tree_sector<uint32_t, uint32_t, 201>::InnerNodeSize), 2032u);
+    EXPECT_EQ((size_t)(tree_sector<uint64_t, uint32_t, 287>::InnerNodeSize), 4040u);
+    EXPECT_EQ((size_t)directory_tree::dir_tree_type::InnerNodeSize, 82u);
+}
+
+TEST(TreeJournal, FullRefusesToReplace) {
+    tree_journal journal;
+
+    for (auto i = 0u; i < tree_journal::Capacity; ++i) {
+        ASSERT_EQ(journal.replaced(node_ptr_t{ (dhara_sector_t)(i + 1), (sector_offset_t)8 }), 0);
+    }
+
+    ASSERT_TRUE(journal.filling());
+
+    // Already replaced nodes don't need room.
+    ASSERT_EQ(journal.replaced(node_ptr_t{ (dhara_sector_t)1, (sector_offset_t)8 }), 0);
+
+    suppress_logs sl;
+
+    ASSERT_LT(journal.replaced(node_ptr_t{ (dhara_sector_t)1, (sector_offset_t)16 }), 0);
 }
 
 template<typename T>
@@ -224,6 +251,743 @@ TYPED_TEST(TreeFixture, OverwriteValue_SingleNode) {
     });
 }
 
+TYPED_TEST(TreeFixture, AppendMonotonic) {
+    typename TypeParam::first_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    memory.mounted<directory_chain>([&](auto &chain) {
+        auto first = memory.allocator().allocate();
+        typename TypeParam::second_type tree{ memory.pc(), tree_ptr_t{ first }, "tree" };
+
+        ASSERT_EQ(tree.create(), 0);
+
+        suppress_logs sl;
+
+        for (auto i = 1u; i < 1024; ++i) {
+            ASSERT_EQ(tree.append(i, i), 0);
+
+            if (i % 64 == 0) {
+                for (auto j = 1u; j <= i; ++j) {
+                    uint32_t found = 0u;
+                    EXPECT_EQ(tree.find(j, &found), 1);
+                    ASSERT_EQ(found, j);
+                }
+            }
+        }
+
+        typename TypeParam::second_type reopened{ memory.pc(), tree.to_tree_ptr(), "tree" };
+
+        for (auto i = 1u; i < 1024; ++i) {
+            uint32_t found = 0u;
+            EXPECT_EQ(reopened.find(i, &found), 1);
+            ASSERT_EQ(found, i);
+        }
+
+        typename TypeParam::second_type::key_type found_key = 0u;
+        uint32_t found_value = 0u;
+        ASSERT_EQ(reopened.find_last_less_then(2000, &found_value, &found_key), 1);
+        ASSERT_EQ(found_key, 1023u);
+        ASSERT_EQ(found_value, 1023u);
+    });
+}
+
+TYPED_TEST(TreeFixture, AppendOutOfOrderAndOverwrite) {
+    typename TypeParam::first_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    memory.mounted<directory_chain>([&](auto &chain) {
+        auto first = memory.allocator().allocate();
+        typename TypeParam::second_type tree{ memory.pc(), tree_ptr_t{ first }, "tree" };
+
+        ASSERT_EQ(tree.create(), 0);
+
+        suppress_logs sl;
+
+        for (auto i = 1u; i < 512; i += 2) {
+            ASSERT_EQ(tree.append(i, i), 0);
+        }
+
+        ASSERT_EQ(tree.append(511, 1000), 0);
+
+        for (auto i = 2u; i < 512; i += 2) {
+            ASSERT_EQ(tree.append(i, i), 0);
+        }
+
+        for (auto i = 512u; i < 1024; ++i) {
+            ASSERT_EQ(tree.append(i, i), 0);
+        }
+
+        for (auto i = 1u; i < 1024; ++i) {
+            uint32_t found = 0u;
+            EXPECT_EQ(tree.find(i, &found), 1);
+            ASSERT_EQ(found, i == 511 ? 1000u : i);
+        }
+    });
+}
+
+TYPED_TEST(TreeFixture, AppendUsesFewerSectorsThanAdd) {
+    typename TypeParam::first_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    memory.mounted<directory_chain>([&](auto &chain) {
+        suppress_logs sl;
+
+        auto before_adding = memory.allocator().allocated();
+
+        auto first = memory.allocator().allocate();
+        typename TypeParam::second_type added{ memory.pc(), tree_ptr_t{ first }, "tree" };
+        ASSERT_EQ(added.create(), 0);
+        for (auto i = 1u; i < 1024; ++i) {
+            ASSERT_EQ(added.add(i, i), 0);
+        }
+
+        auto before_appending = memory.allocator().allocated();
+
+        auto second = memory.allocator().allocate();
+        typename TypeParam::second_type appended{ memory.pc(), tree_ptr_t{ second }, "tree" };
+        ASSERT_EQ(appended.create(), 0);
+        for (auto i = 1u; i < 1024; ++i) {
+            ASSERT_EQ(appended.append(i, i), 0);
+        }
+
+        auto after_appending = memory.allocator().allocated();
+
+        EXPECT_LT(after_appending - before_appending, before_appending - before_adding);
+    });
+}
+
+TYPED_TEST(TreeFixture, AppendResumesRightmostPath) {
+    typename TypeParam::first_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    std::vector<trace_event_t> events(8192);
+
+    auto descents = [&]() {
+        auto descended = 0u;
+        for (auto &event : events) {
+            if (event.kind == trace_kind::TreeDescend) {
+                descended++;
+            }
+        }
+        std::fill(events.begin(), events.end(), trace_event_t{ });
+        return descended;
+    };
+
+    memory.mounted<directory_chain>([&](auto &chain) {
+        suppress_logs sl;
+
+        tree_ptr_t fresh_ptr{ memory.allocator().allocate() };
+        tree_ptr_t resumed_ptr{ memory.allocator().allocate() };
+        tree_rightmost_t rightmost;
+
+        {
+            typename TypeParam::second_type fresh{ memory.pc(), fresh_ptr, "tree" };
+            typename TypeParam::second_type resumed{ memory.pc(), resumed_ptr, "tree" };
+            ASSERT_EQ(fresh.create(), 0);
+            ASSERT_EQ(resumed.create(), 0);
+            fresh_ptr = fresh.to_tree_ptr();
+            resumed_ptr = resumed.to_tree_ptr();
+        }
+
+        // Appends made through a new instance each time, the way files
+        // append to their indices, with and without the previous path.
+        trace_configure(events.data(), events.size());
+        for (auto i = 1u; i < 1024; ++i) {
+            typename TypeParam::second_type tree{ memory.pc(), fresh_ptr, "tree" };
+            ASSERT_EQ(tree.append(i, i), 0);
+            fresh_ptr = tree.to_tree_ptr();
+        }
+        auto fresh = descents();
+
+        for (auto i = 1u; i < 1024; ++i) {
+            typename TypeParam::second_type tree{ memory.pc(), resumed_ptr, "tree" };
+            tree.rightmost(rightmost);
+            ASSERT_EQ(tree.append(i, i), 0);
+            rightmost = tree.rightmost();
+            resumed_ptr = tree.to_tree_ptr();
+        }
+        auto resumed = descents();
+
+        trace_configure(nullptr, 0);
+
+        EXPECT_GT(fresh, 0u);
+        EXPECT_EQ(resumed, 0u);
+
+        typename TypeParam::second_type tree{ memory.pc(), resumed_ptr, "tree" };
+        for (auto i = 1u; i < 1024; ++i) {
+            uint32_t found = 0u;
+            ASSERT_EQ(tree.find(i, &found), 1);
+            ASSERT_EQ(found, i);
+        }
+    });
+}
+
+TYPED_TEST(TreeFixture, AddSortedWritesLessThanAdd) {
+    using key_type = typename TypeParam::second_type::key_type;
+
+    typename TypeParam::first_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    std::vector<trace_event_t> events(8192);
+
+    auto sector_writes = [&]() {
+        auto writes = 0u;
+        for (auto &event : events) {
+            if (event.kind == trace_kind::SectorWrite) {
+                writes++;
+            }
+        }
+        return writes;
+    };
+
+    memory.mounted<directory_chain>([&](auto &chain) {
+        suppress_logs sl;
+
+        typename TypeParam::second_type added{ memory.pc(), tree_ptr_t{ memory.allocator().allocate() }, "tree" };
+        typename TypeParam::second_type sorted{ memory.pc(), tree_ptr_t{ memory.allocator().allocate() }, "tree" };
+        ASSERT_EQ(added.create(), 0);
+        ASSERT_EQ(sorted.create(), 0);
+
+        for (auto i = 1u; i < 512; i += 2) {
+            ASSERT_EQ(added.add(i, i), 0);
+            ASSERT_EQ(sorted.add(i, i), 0);
+        }
+
+        key_type keys[32];
+        uint32_t values[32];
+        for (auto i = 0u; i < 32; ++i) {
+            keys[i] = 100 + i * 2;
+            values[i] = 100 + i * 2;
+        }
+
+        trace_configure(events.data(), events.size());
+        for (auto i = 0u; i < 32; ++i) {
+            ASSERT_EQ(added.add(keys[i], values[i]), 0);
+        }
+        auto adding = sector_writes();
+
+        std::fill(events.begin(), events.end(), trace_event_t{ });
+        trace_configure(events.data(), events.size());
+        ASSERT_EQ(sorted.add_sorted(keys, values, 32), 0);
+        auto sorting = sector_writes();
+
+        trace_configure(nullptr, 0);
+
+        EXPECT_LT(sorting, adding);
+
+        for (auto i = 1u; i < 512; ++i) {
+            uint32_t found = 0u;
+            auto expected = i % 2 == 1 || (i >= 100 && i < 164);
+            ASSERT_EQ(sorted.find(i, &found), expected ? 1 : 0);
+            if (expected) {
+                ASSERT_EQ(found, i);
+            }
+        }
+    });
+}
+
+TYPED_TEST(TreeFixture, RemoveAll) {
+    typename TypeParam::first_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    memory.mounted<directory_chain>([&](auto &chain) {
+        auto first = memory.allocator().allocate();
+        typename TypeParam::second_type tree{ memory.pc(), tree_ptr_t{ first }, "tree" };
+
+        ASSERT_EQ(tree.create(), 0);
+
+        suppress_logs sl;
+
+        for (auto i = 1u; i < 1024; ++i) {
+            ASSERT_EQ(tree.add(i, i), 0);
+        }
+
+        ASSERT_EQ(tree.remove(2000), 0);
+
+        for (auto i = 1u; i < 1024; ++i) {
+            ASSERT_EQ(tree.remove(i), 1);
+            ASSERT_EQ(tree.find(i), 0);
+            ASSERT_EQ(tree.remove(i), 0);
+
+            if (i % 64 == 0) {
+                for (auto j = i + 1; j < 1024; ++j) {
+                    uint32_t found = 0u;
+                    EXPECT_EQ(tree.find(j, &found), 1);
+                    ASSERT_EQ(found, j);
+                }
+            }
+        }
+
+        for (auto i = 1u; i < 1024; ++i) {
+            ASSERT_EQ(tree.add(i, i + 1), 0);
+        }
+
+        for (auto i = 1u; i < 1024; ++i) {
+            uint32_t found = 0u;
+            EXPECT_EQ(tree.find(i, &found), 1);
+            ASSERT_EQ(found, i + 1);
+        }
+    });
+}
+
+TYPED_TEST(TreeFixture, CursorWalksInOrder) {
+    typename TypeParam::first_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    memory.mounted<directory_chain>([&](auto &chain) {
+        auto first = memory.allocator().allocate();
+        typename TypeParam::second_type tree{ memory.pc(), tree_ptr_t{ first }, "tree" };
+
+        ASSERT_EQ(tree.create(), 0);
+
+        suppress_logs sl;
+
+        for (auto i = 0u; i < 1021; ++i) {
+            auto key = (i * 7919) % 1021 + 1;
+            ASSERT_EQ(tree.add(key, key), 0);
+        }
+
+        for (auto i = 5u; i <= 1021; i += 5) {
+            ASSERT_EQ(tree.remove(i), 1);
+        }
+
+        typename TypeParam::second_type::cursor_t cursor;
+        typename TypeParam::second_type::key_type key = 0u;
+        uint32_t value = 0u;
+        uint32_t expected = 1u;
+        auto visited = 0u;
+        while (tree.next(cursor, &key, &value) == 1) {
+            if (expected % 5 == 0) {
+                expected++;
+            }
+            ASSERT_EQ(key, expected);
+            ASSERT_EQ(value, expected);
+            expected++;
+            visited++;
+        }
+
+        ASSERT_EQ(visited, 1021u - 1021u / 5);
+        ASSERT_EQ(tree.next(cursor, &key, &value), 0);
+    });
+}
+
+TYPED_TEST(TreeFixture, VisitFoundValues) {
+    typename TypeParam::first_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    memory.mounted<directory_chain>([&](auto &chain) {
+        auto first = memory.allocator().allocate();
+        typename TypeParam::second_type tree{ memory.pc(), tree_ptr_t{ first }, "tree" };
+
+        ASSERT_EQ(tree.create(), 0);
+
+        suppress_logs sl;
+
+        for (auto i = 1u; i < 512; ++i) {
+            ASSERT_EQ(tree.add(i, i * 3), 0);
+        }
+
+        for (auto i = 1u; i < 512; i += 17) {
+            tree_value_ptr_t found_ptr;
+            ASSERT_EQ(tree.find(i, nullptr, &found_ptr), 1);
+            ASSERT_EQ(tree.visit(found_ptr, [&](uint32_t const &value) -> int32_t {
+                EXPECT_EQ(value, i * 3);
+                return 1;
+            }), 1);
+        }
+    });
+}
+
+TYPED_TEST(TreeFixture, RemoveInterleaved) {
+    typename TypeParam::first_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    memory.mounted<directory_chain>([&](auto &chain) {
+        auto first = memory.allocator().allocate();
+        typename TypeParam::second_type tree{ memory.pc(), tree_ptr_t{ first }, "tree" };
+
+        ASSERT_EQ(tree.create(), 0);
+
+        suppress_logs sl;
+
+        for (auto i = 1u; i < 1024; ++i) {
+            ASSERT_EQ(tree.add(i, i), 0);
+        }
+
+        // Knock out every third key, then everything from the top down
+        // so merges happen on both sides.
+        for (auto i = 3u; i < 1024; i += 3) {
+            ASSERT_EQ(tree.remove(i), 1);
+        }
+
+        for (auto i = 1u; i < 1024; ++i) {
+            EXPECT_EQ(tree.find(i), i % 3 == 0 ? 0 : 1);
+        }
+
+        for (auto i = 1023u; i > 512; --i) {
+            ASSERT_EQ(tree.remove(i), i % 3 == 0 ? 0 : 1);
+        }
+
+        typename TypeParam::second_type reopened{ memory.pc(), tree.to_tree_ptr(), "tree" };
+
+        for (auto i = 1u; i < 1024; ++i) {
+            uint32_t found = 0u;
+            auto expected = (i % 3 == 0 || i > 512) ? 0 : 1;
+            EXPECT_EQ(reopened.find(i, &found), expected);
+            if (expected) {
+                ASSERT_EQ(found, i);
+            }
+        }
+    });
+}
+
+TYPED_TEST(TreeFixture, RemoveRandomlyInterleaved) {
+    typename TypeParam::first_type layout;
+
+    // Removing leaves separators behind in inner nodes, re-adding one of
+    // those keys has to land where find looks for it.
+    for (auto seed : { 1u, 2u, 11u, 12u, 13u }) {
+        FlashMemory memory{ layout.sector_size };
+
+        memory.mounted<directory_chain>([&](auto &chain) {
+            auto first = memory.allocator().allocate();
+            typename TypeParam::second_type tree{ memory.pc(), tree_ptr_t{ first }, "tree" };
+
+            ASSERT_EQ(tree.create(), 0);
+
+            suppress_logs sl;
+
+            std::map<uint32_t, uint32_t> expected;
+            uint32_t state = seed;
+            for (auto i = 0u; i < 2000; ++i) {
+                state = state * 1103515245 + 12345;
+                auto key = (state >> 16) % 400 + 1;
+                auto adding = ((state >> 8) & 3) != 0;
+                if (adding) {
+                    ASSERT_EQ(tree.add(key, i), 0);
+                    expected[key] = i;
+                } else {
+                    ASSERT_EQ(tree.remove(key), expected.erase(key) > 0 ? 1 : 0);
+                }
+            }
+
+            for (auto i = 1u; i <= 400; ++i) {
+                uint32_t found = 0u;
+                auto iter = expected.find(i);
+                ASSERT_EQ(tree.find(i, &found), iter == expected.end() ? 0 : 1);
+                if (iter != expected.end()) {
+                    ASSERT_EQ(found, iter->second);
+                }
+            }
+        });
+    }
+}
+
+TYPED_TEST(TreeFixture, RemoveReclaimsSectors) {
+    typename TypeParam::first_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    memory.mounted<directory_chain>([&](auto &chain) {
+        free_sectors_chain fsc{ memory.pc(), head_tail_t{ } };
+        ASSERT_EQ(fsc.create_if_necessary(), 0);
+
+        auto first = memory.allocator().allocate();
+        typename TypeParam::second_type tree{ memory.pc(), tree_ptr_t{ first }, "tree" };
+
+        ASSERT_EQ(tree.create(), 0);
+
+        suppress_logs sl;
+
+        for (auto i = 1u; i < 1024; ++i) {
+            ASSERT_EQ(tree.add(i, i), 0);
+        }
+
+        auto used = memory.allocator().allocated();
+
+        for (auto i = 1u; i < 1024; ++i) {
+            ASSERT_EQ(tree.remove(i, &fsc), 1);
+        }
+
+        auto reclaimed = 0u;
+        dhara_sector_t sector = InvalidSector;
+        while (fsc.dequeue(&sector) > 0) {
+            ASSERT_NE(sector, first);
+            reclaimed++;
+        }
+
+        if (used > 3) {
+            EXPECT_GT(reclaimed, 0u);
+        }
+
+        // Tree should still be usable, with the chain fixed up.
+        for (auto i = 1u; i < 1024; ++i) {
+            ASSERT_EQ(tree.add(i, i), 0);
+        }
+
+        for (auto i = 1u; i < 1024; ++i) {
+            uint32_t found = 0u;
+            EXPECT_EQ(tree.find(i, &found), 1);
+            ASSERT_EQ(found, i);
+        }
+    });
+}
+
+TYPED_TEST(TreeFixture, CopyOnWriteLeavesPreviousTree) {
+    typename TypeParam::first_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    memory.mounted<directory_chain>([&](auto &chain) {
+        auto first = memory.allocator().allocate();
+        typename TypeParam::second_type tree{ memory.pc(), tree_ptr_t{ first }, "tree" };
+
+        ASSERT_EQ(tree.create(), 0);
+
+        suppress_logs sl;
+
+        for (auto i = 1u; i < 128; ++i) {
+            ASSERT_EQ(tree.add(i, i), 0);
+        }
+
+        auto before = tree.to_tree_ptr();
+
+        // Kept small enough that every replaced node fits in the journal.
+        tree_journal journal;
+        tree.copy_on_write(&journal);
+
+        for (auto i = 128u; i < 256; ++i) {
+            ASSERT_EQ(tree.add(i, i), 0);
+        }
+
+        for (auto i = 1u; i < 256; i += 2) {
+            ASSERT_EQ(tree.add(i, i + 1), 0);
+        }
+
+        ASSERT_NE(tree.to_tree_ptr().root, before.root);
+
+        typename TypeParam::second_type previous{ memory.pc(), before, "tree" };
+
+        for (auto i = 1u; i < 256; ++i) {
+            uint32_t found = 0u;
+            if (i < 128) {
+                EXPECT_EQ(previous.find(i, &found), 1);
+                ASSERT_EQ(found, i);
+            }
+            else {
+                EXPECT_EQ(previous.find(i, &found), 0);
+            }
+        }
+
+        typename TypeParam::second_type reopened{ memory.pc(), tree.to_tree_ptr(), "tree" };
+
+        for (auto i = 1u; i < 256; ++i) {
+            uint32_t found = 0u;
+            EXPECT_EQ(reopened.find(i, &found), 1);
+            ASSERT_EQ(found, i % 2 == 1 ? i + 1 : i);
+        }
+    });
+}
+
+TYPED_TEST(TreeFixture, CopyOnWriteRemove) {
+    typename TypeParam::first_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    memory.mounted<directory_chain>([&](auto &chain) {
+        auto first = memory.allocator().allocate();
+        typename TypeParam::second_type tree{ memory.pc(), tree_ptr_t{ first }, "tree" };
+
+        ASSERT_EQ(tree.create(), 0);
+
+        suppress_logs sl;
+
+        tree_journal journal;
+        tree.copy_on_write(&journal);
+
+        for (auto i = 1u; i < 256; ++i) {
+            ASSERT_EQ(tree.add(i, i), 0);
+        }
+
+        // Only the saved tree is left alone, nodes written since are
+        // changed in place.
+        auto before = tree.to_tree_ptr();
+        ASSERT_EQ(journal.release(memory.pc(), nullptr), 0);
+
+        ASSERT_EQ(tree.remove(1000), 0);
+        ASSERT_EQ(tree.to_tree_ptr().root, before.root);
+
+        for (auto i = 1u; i < 256; i += 2) {
+            ASSERT_EQ(tree.remove(i), 1);
+        }
+
+        typename TypeParam::second_type previous{ memory.pc(), before, "tree" };
+
+        for (auto i = 1u; i < 256; ++i) {
+            EXPECT_EQ(previous.find(i), 1);
+            EXPECT_EQ(tree.find(i), i % 2 == 1 ? 0 : 1);
+        }
+    });
+}
+
+TYPED_TEST(TreeFixture, CopyOnWriteReleasesReplacedNodes) {
+    typename TypeParam::first_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    memory.mounted<directory_chain>([&](auto &chain) {
+        free_sectors_chain fsc{ memory.pc(), head_tail_t{ } };
+        ASSERT_EQ(fsc.create_if_necessary(), 0);
+
+        auto starting = memory.allocator().allocated();
+        auto first = memory.allocator().allocate();
+        typename TypeParam::second_type tree{ memory.pc(), tree_ptr_t{ first }, "tree" };
+
+        ASSERT_EQ(tree.create(), 0);
+
+        suppress_logs sl;
+
+        for (auto i = 1u; i < 512; ++i) {
+            ASSERT_EQ(tree.add(i, i), 0);
+        }
+
+        auto used = memory.allocator().allocated() - starting;
+
+        tree_journal journal;
+        tree.copy_on_write(&journal);
+
+        // Every change is saved before the next one, so each of them
+        // replaces nodes of a saved tree. Only sectors taken by the tree
+        // are counted, the free chain grows as it records them.
+        auto allocated = 0u;
+        auto reclaimed = 0u;
+        for (auto round = 1u; round <= 4; ++round) {
+            for (auto i = 1u; i < 512; ++i) {
+                auto before = memory.allocator().allocated();
+                ASSERT_EQ(tree.add(i, i + round), 0);
+                allocated += memory.allocator().allocated() - before;
+                ASSERT_EQ(journal.release(memory.pc(), &fsc), 0);
+            }
+
+            dhara_sector_t sector = InvalidSector;
+            while (fsc.dequeue(&sector) > 0) {
+                reclaimed++;
+            }
+
+            // Live nodes may be spread over more sectors than before,
+            // but the tree stays the same size from round to round
+            // instead of growing with every change.
+            ASSERT_LE(allocated - reclaimed, used * 2 + tree_journal::MaximumSpareRoots);
+        }
+
+        EXPECT_GT(reclaimed, 0u);
+
+        for (auto i = 1u; i < 512; ++i) {
+            uint32_t found = 0u;
+            EXPECT_EQ(tree.find(i, &found), 1);
+            ASSERT_EQ(found, i + 4);
+        }
+    });
+}
+
+TYPED_TEST(TreeFixture, AppendPacksFullLeaves) {
+    typename TypeParam::first_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    memory.mounted<directory_chain>([&](auto &chain) {
+        suppress_logs sl;
+
+        // Decreasing values can't be delta encoded, so these leaves
+        // keep their regular layout.
+        auto before_fixed = memory.allocator().allocated();
+
+        typename TypeParam::second_type fixed{ memory.pc(), tree_ptr_t{ memory.allocator().allocate() }, "fixed" };
+        ASSERT_EQ(fixed.create(), 0);
+
+        for (auto i = 1u; i < 4096; ++i) {
+            ASSERT_EQ(fixed.append(i, 8192 - i), 0);
+        }
+
+        auto before_packed = memory.allocator().allocated();
+
+        typename TypeParam::second_type packed{ memory.pc(), tree_ptr_t{ memory.allocator().allocate() }, "packed" };
+        ASSERT_EQ(packed.create(), 0);
+
+        for (auto i = 1u; i < 4096; ++i) {
+            ASSERT_EQ(packed.append(i * 4, i * 512), 0);
+        }
+
+        auto after_packed = memory.allocator().allocated();
+
+        EXPECT_LT(after_packed - before_packed, before_packed - before_fixed);
+
+        typename TypeParam::second_type reopened{ memory.pc(), packed.to_tree_ptr(), "packed" };
+
+        for (auto i = 1u; i < 4096; ++i) {
+            uint32_t found = 0u;
+            EXPECT_EQ(reopened.find(i * 4, &found), 1);
+            ASSERT_EQ(found, i * 512);
+            EXPECT_EQ(reopened.find(i * 4 + 1), 0);
+        }
+
+        typename TypeParam::second_type::key_type found_key = 0u;
+        uint32_t found_value = 0u;
+        ASSERT_EQ(reopened.find_last_less_then(4001, &found_value, &found_key), 1);
+        ASSERT_EQ(found_key, 4000u);
+        ASSERT_EQ(found_value, 1000u * 512);
+    });
+}
+
+TYPED_TEST(TreeFixture, ModifyPackedLeaves) {
+    typename TypeParam::first_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    memory.mounted<directory_chain>([&](auto &chain) {
+        auto first = memory.allocator().allocate();
+        typename TypeParam::second_type tree{ memory.pc(), tree_ptr_t{ first }, "tree" };
+
+        ASSERT_EQ(tree.create(), 0);
+
+        suppress_logs sl;
+
+        for (auto i = 2u; i < 2048; i += 2) {
+            ASSERT_EQ(tree.append(i, i), 0);
+        }
+
+        // Fill in the gaps, every one of these lands in a packed leaf.
+        for (auto i = 1u; i < 2048; i += 2) {
+            ASSERT_EQ(tree.add(i, i), 0);
+        }
+
+        for (auto i = 1u; i < 2048; i += 3) {
+            ASSERT_EQ(tree.remove(i), 1);
+        }
+
+        for (auto i = 1u; i < 2048; ++i) {
+            uint32_t found = 0u;
+            auto expected = (i - 1) % 3 == 0 ? 0 : 1;
+            EXPECT_EQ(tree.find(i, &found), expected);
+            if (expected) {
+                ASSERT_EQ(found, i);
+            }
+        }
+
+        typename TypeParam::second_type copying{ memory.pc(), tree.to_tree_ptr(), "tree" };
+
+        tree_journal journal;
+        copying.copy_on_write(&journal);
+
+        for (auto i = 2048u; i < 2560; i += 2) {
+            ASSERT_EQ(copying.append(i, i), 0);
+        }
+
+        for (auto i = 2u; i < 2560; i += 2) {
+            uint32_t found = 0u;
+            auto expected = (i < 2048 && (i - 1) % 3 == 0) ? 0 : 1;
+            EXPECT_EQ(copying.find(i, &found), expected);
+            if (expected) {
+                ASSERT_EQ(found, i);
+            }
+        }
+    });
+}
+
 TYPED_TEST(TreeFixture, DISABLED_Truncate_SingleSector) {
     typename TypeParam::first_type layout;
     FlashMemory memory{ layout.sector_size };
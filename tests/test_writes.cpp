@@ -14,7 +14,9 @@ class WriteFixture : public PhylumFixture {
 
 typedef ::testing::Types<
     std::pair<layout_256, directory_chain>,
-    std::pair<layout_4096, directory_tree>
+    std::pair<layout_4096, directory_tree>,
+    std::pair<layout_4096, basic_directory_tree<512>>,
+    std::pair<layout_2048, basic_directory_tree<128, tree_attribute_storage>>
     > Implementations;
 
 TYPED_TEST_SUITE(WriteFixture, Implementations);
@@ -277,6 +279,221 @@ TYPED_TEST(WriteFixture, WriteAndIncrementAttributeThreeTimes) {
     });
 }
 
+TYPED_TEST(WriteFixture, IncrementAttributeAndReopenMany) {
+    using layout_type = typename TypeParam::first_type;
+    using dir_type = typename TypeParam::second_type;
+
+    layout_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    memory.mounted<dir_type>([&](auto &dir) {
+        ASSERT_EQ(dir.touch("data.txt"), 0);
+
+        ASSERT_EQ(dir.find("data.txt", this->file_cfg()), 1);
+
+        attributes_helper attributes{ this->file_cfg() };
+        attributes.u32(ATTRIBUTE_TWO, 7);
+
+        file_appender opened{ memory.pc(), &dir, dir.open() };
+        ASSERT_GE(opened.close(), 0);
+    });
+
+    for (auto i = 1u; i <= 40; ++i) {
+        memory.mounted<dir_type>([&](auto &dir) {
+            ASSERT_EQ(dir.find("data.txt", this->file_cfg()), 1);
+
+            attributes_helper attributes{ this->file_cfg() };
+            ASSERT_EQ(attributes.u32(ATTRIBUTE_ONE), i - 1);
+            ASSERT_EQ(attributes.u32(ATTRIBUTE_TWO), 7u);
+            attributes.u32(ATTRIBUTE_ONE, i);
+
+            file_appender opened{ memory.pc(), &dir, dir.open() };
+            ASSERT_GE(opened.close(), 0);
+        });
+    }
+
+    memory.mounted<dir_type>([&](auto &dir) {
+        ASSERT_EQ(dir.find("data.txt", this->file_cfg()), 1);
+
+        attributes_helper attributes{ this->file_cfg() };
+        ASSERT_EQ(attributes.u32(ATTRIBUTE_ONE), 40u);
+        ASSERT_EQ(attributes.u32(ATTRIBUTE_TWO), 7u);
+    });
+}
+
+TYPED_TEST(WriteFixture, ReadOneAttribute) {
+    using layout_type = typename TypeParam::first_type;
+    using dir_type = typename TypeParam::second_type;
+
+    layout_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    memory.mounted<dir_type>([&](auto &dir) {
+        ASSERT_EQ(dir.touch("data.txt"), 0);
+
+        ASSERT_EQ(dir.find("data.txt", this->file_cfg()), 1);
+
+        attributes_helper attributes{ this->file_cfg() };
+        attributes.u32(ATTRIBUTE_ONE, 1);
+        attributes.u32(ATTRIBUTE_TWO, 2);
+
+        file_appender opened{ memory.pc(), &dir, dir.open() };
+        ASSERT_GE(opened.close(), 0);
+    });
+
+    memory.mounted<dir_type>([&](auto &dir) {
+        uint32_t value = 0;
+        open_file_attribute attrs[1] = { open_file_attribute{ ATTRIBUTE_TWO, sizeof(value) } };
+        attrs[0].ptr = &value;
+
+        open_file_config file_cfg;
+        file_cfg.attributes = attrs;
+        file_cfg.nattrs = 1;
+
+        ASSERT_EQ(dir.find("data.txt", file_cfg), 1);
+        ASSERT_EQ(value, 2u);
+    });
+}
+
+TYPED_TEST(WriteFixture, RunningHashExtendedAcrossAppends) {
+    using layout_type = typename TypeParam::first_type;
+    using dir_type = typename TypeParam::second_type;
+
+    layout_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    file_hash_t hash;
+    open_file_attribute attrs[1] = { open_file_attribute{ FileHashAttribute, sizeof(hash) } };
+    attrs[0].ptr = &hash;
+
+    open_file_config file_cfg;
+    file_cfg.attributes = attrs;
+    file_cfg.nattrs = 1;
+
+    auto first = 300u;
+    auto second = 600u;
+
+    memory.mounted<dir_type>([&](auto &dir) {
+        ASSERT_EQ(dir.touch("data.txt"), 0);
+
+        ASSERT_EQ(dir.find("data.txt", file_cfg), 1);
+        file_appender opened{ memory.pc(), &dir, dir.open() };
+        ASSERT_EQ(opened.write(lorem1k, first), (int32_t)first);
+        ASSERT_EQ(opened.flush(), 0);
+        ASSERT_EQ(opened.close(), 0);
+    });
+
+    memory.mounted<dir_type>([&](auto &dir) {
+        ASSERT_EQ(dir.find("data.txt", file_cfg), 1);
+        ASSERT_EQ(hash.bytes, first);
+        ASSERT_EQ(hash.crc, crc32_checksum((uint8_t const *)lorem1k, first));
+
+        file_appender opened{ memory.pc(), &dir, dir.open() };
+        ASSERT_EQ(opened.seek(), 0);
+        ASSERT_EQ(opened.write((uint8_t const *)lorem1k + first, second), (int32_t)second);
+        ASSERT_EQ(opened.flush(), 0);
+    });
+
+    memory.mounted<dir_type>([&](auto &dir) {
+        hash = file_hash_t{};
+        ASSERT_EQ(dir.find("data.txt", file_cfg), 1);
+        ASSERT_EQ(hash.bytes, first + second);
+        ASSERT_EQ(hash.crc, crc32_checksum((uint8_t const *)lorem1k, first + second));
+    });
+}
+
+TYPED_TEST(WriteFixture, RunningHashKeepsOtherAttributes) {
+    using layout_type = typename TypeParam::first_type;
+    using dir_type = typename TypeParam::second_type;
+
+    layout_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    uint32_t one = 0;
+    uint32_t two = 0;
+    file_hash_t hash;
+    open_file_attribute attrs[3] = {
+        open_file_attribute{ ATTRIBUTE_ONE, sizeof(one) },
+        open_file_attribute{ ATTRIBUTE_TWO, sizeof(two) },
+        open_file_attribute{ FileHashAttribute, sizeof(hash) },
+    };
+    attrs[0].ptr = &one;
+    attrs[1].ptr = &two;
+    attrs[2].ptr = &hash;
+
+    open_file_config file_cfg;
+    file_cfg.attributes = attrs;
+    file_cfg.nattrs = 3;
+
+    memory.mounted<dir_type>([&](auto &dir) {
+        ASSERT_EQ(dir.touch("data.txt"), 0);
+
+        ASSERT_EQ(dir.find("data.txt", file_cfg), 1);
+
+        one = 42;
+        two = 99;
+        attrs[0].dirty = true;
+        attrs[1].dirty = true;
+
+        file_appender opened{ memory.pc(), &dir, dir.open() };
+        ASSERT_EQ(opened.write(lorem1k, 100), 100);
+        ASSERT_EQ(opened.flush(), 0);
+    });
+
+    // Never closed, so checkpoints are all that save the attributes.
+    for (auto i = 0u; i < 4; ++i) {
+        memory.mounted<dir_type>([&](auto &dir) {
+            ASSERT_EQ(dir.find("data.txt", file_cfg), 1);
+
+            file_appender opened{ memory.pc(), &dir, dir.open() };
+            ASSERT_EQ(opened.seek(), 0);
+            ASSERT_EQ(opened.write(lorem1k, 100), 100);
+            ASSERT_EQ(opened.flush(), 0);
+        });
+    }
+
+    memory.mounted<dir_type>([&](auto &dir) {
+        one = 0;
+        two = 0;
+        hash = file_hash_t{};
+        ASSERT_EQ(dir.find("data.txt", file_cfg), 1);
+        ASSERT_EQ(one, 42u);
+        ASSERT_EQ(two, 99u);
+        ASSERT_EQ(hash.bytes, 500u);
+    });
+}
+
+TYPED_TEST(WriteFixture, FindAndAppendRepeatedly) {
+    using layout_type = typename TypeParam::first_type;
+    using dir_type = typename TypeParam::second_type;
+
+    layout_type layout;
+    FlashMemory memory{ layout.sector_size };
+
+    memory.mounted<dir_type>([&](auto &dir) {
+        ASSERT_EQ(dir.touch("data.txt"), 0);
+
+        auto hello = "Hello, world! How are you!";
+        auto written = 0u;
+
+        for (auto i = 0u; i < 8; ++i) {
+            ASSERT_EQ(dir.find("data.txt", this->file_cfg()), 1);
+            file_appender opened{ memory.pc(), &dir, dir.open() };
+            ASSERT_EQ(opened.seek(), 0);
+            ASSERT_EQ(opened.position(), written);
+            ASSERT_EQ(opened.write(hello), (int32_t)strlen(hello));
+            ASSERT_GE(opened.close(), 0);
+            written += strlen(hello);
+        }
+
+        ASSERT_EQ(dir.find("data.txt", open_file_config{ }), 1);
+        file_reader reader{ memory.pc(), &dir, dir.open() };
+
+        uint8_t buffer[512];
+        ASSERT_EQ(reader.read(buffer, sizeof(buffer)), (int32_t)written);
+    });
+}
+
 TYPED_TEST(WriteFixture, WriteToDataChainAndIncrementAttributeThreeTimes) {
     using layout_type = typename TypeParam::first_type;
     using dir_type = typename TypeParam::second_type;
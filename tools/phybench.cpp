@@ -0,0 +1,62 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <blake2b.h>
+
+using namespace phylum;
+
+/**
+ * Measures BLAKE2b throughput for each compression backend available
+ * on this machine, hashing the same buffer the way blake2b_writer does.
+ */
+
+static constexpr size_t BufferSize = 1024 * 1024;
+static constexpr size_t WriteSize = 4096;
+
+static const char *backend_names[] = { "portable", "sse4.1", "avx2", "neon" };
+
+int main(int argc, const char **argv) {
+    auto megabytes = argc > 1 ? (size_t)atoi(argv[1]) : 256u;
+    if (megabytes == 0) {
+        fprintf(stderr, "usage: %s [megabytes]\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<uint8_t> data(BufferSize);
+    for (auto i = 0u; i < data.size(); ++i) {
+        data[i] = (uint8_t)(i * 7919 + (i >> 3));
+    }
+
+    printf("selected=%s megabytes=%zu\n\n", backend_names[(size_t)blake2b_selected()], megabytes);
+    printf("%-10s %10s %10s %18s\n", "backend", "seconds", "MB/s", "hash");
+
+    for (auto i = 0u; i < sizeof(backend_names) / sizeof(backend_names[0]); ++i) {
+        auto backend = (blake2b_backend)i;
+        if (!blake2b_supported(backend)) {
+            continue;
+        }
+
+        BLAKE2b b2b;
+        b2b.backend(backend);
+        b2b.reset(32);
+
+        auto started = std::chrono::steady_clock::now();
+        for (auto mb = 0u; mb < megabytes; ++mb) {
+            for (auto offset = 0u; offset < BufferSize; offset += WriteSize) {
+                b2b.update(data.data() + offset, WriteSize);
+            }
+        }
+
+        uint8_t hash[32];
+        b2b.finalize(hash, sizeof(hash));
+
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+        printf("%-10s %10.3f %10.1f   %02x%02x%02x%02x%02x%02x%02x%02x\n", backend_names[i], elapsed, megabytes / elapsed,
+               hash[0], hash[1], hash[2], hash[3], hash[4], hash[5], hash[6], hash[7]);
+    }
+
+    return 0;
+}
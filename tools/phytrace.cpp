@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <trace.h>
+
+using namespace phylum;
+
+/**
+ * Decodes a dump written by trace_write, printing how many flash
+ * operations each kind of filesystem operation did and how long they
+ * took. Flash operations count towards every operation open when they
+ * happened, so nested ones are included in their callers.
+ */
+
+static constexpr size_t NumberOfOperations = (size_t)trace_operation::Index + 1;
+static constexpr size_t NumberOfKinds = (size_t)trace_kind::TreeDescend + 1;
+static constexpr size_t NumberOfBuckets = 32;
+
+static const char *operation_names[NumberOfOperations] = {
+    "none", "touch", "find", "unlink", "mkdir", "write", "flush", "close", "read", "seek-position", "seek-record", "index",
+};
+
+struct operation_stats_t {
+    uint32_t count{ 0 };
+    uint64_t ticks{ 0 };
+    uint32_t maximum{ 0 };
+    uint64_t kinds[NumberOfKinds] = { };
+    uint64_t page_hits{ 0 };
+    uint64_t sector_reads_cached{ 0 };
+    uint64_t descents_same_sector{ 0 };
+    uint32_t histogram[NumberOfBuckets] = { };
+};
+
+struct open_operation_t {
+    trace_operation operation{ trace_operation::None };
+    uint32_t began{ 0 };
+    uint64_t kinds[NumberOfKinds] = { };
+    uint64_t page_hits{ 0 };
+    uint64_t sector_reads_cached{ 0 };
+    uint64_t descents_same_sector{ 0 };
+};
+
+static size_t bucket_for(uint32_t ticks) {
+    auto bucket = 0u;
+    while (ticks > 1 && bucket < NumberOfBuckets - 1) {
+        ticks >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static void count(open_operation_t &open, trace_event_t const &event) {
+    auto kind = (size_t)event.kind;
+    auto hit = (event.flags & (uint8_t)trace_flags::Hit) != 0;
+
+    open.kinds[kind]++;
+
+    switch (event.kind) {
+    case trace_kind::PageOpen:
+        open.page_hits += hit ? 1 : 0;
+        break;
+    case trace_kind::SectorRead:
+        open.sector_reads_cached += hit ? 1 : 0;
+        break;
+    case trace_kind::TreeDescend:
+        open.descents_same_sector += hit ? 1 : 0;
+        break;
+    default:
+        break;
+    }
+}
+
+static void close(operation_stats_t &stats, open_operation_t const &open, uint32_t ended) {
+    auto elapsed = ended - open.began;
+
+    stats.count++;
+    stats.ticks += elapsed;
+    if (elapsed > stats.maximum) {
+        stats.maximum = elapsed;
+    }
+    for (auto i = 0u; i < NumberOfKinds; ++i) {
+        stats.kinds[i] += open.kinds[i];
+    }
+    stats.page_hits += open.page_hits;
+    stats.sector_reads_cached += open.sector_reads_cached;
+    stats.descents_same_sector += open.descents_same_sector;
+    stats.histogram[bucket_for(elapsed)]++;
+}
+
+// Totals for rows without a count, like flash operations outside of
+// any operation.
+static double per(uint64_t value, uint32_t count) {
+    return count == 0 ? (double)value : (double)value / count;
+}
+
+int main(int argc, const char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <trace-file>\n", argv[0]);
+        return 2;
+    }
+
+    auto fp = fopen(argv[1], "rb");
+    if (fp == nullptr) {
+        fprintf(stderr, "unable to open %s\n", argv[1]);
+        return 1;
+    }
+
+    trace_header_t header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 || header.magic != trace_header_t::Magic) {
+        fprintf(stderr, "%s isn't a trace\n", argv[1]);
+        fclose(fp);
+        return 1;
+    }
+
+    if (header.version != trace_header_t::Version || header.event_size != sizeof(trace_event_t)) {
+        fprintf(stderr, "unsupported trace version=%d event-size=%d\n", header.version, header.event_size);
+        fclose(fp);
+        return 1;
+    }
+
+    std::vector<trace_event_t> events(header.number_events);
+    auto read = fread(events.data(), sizeof(trace_event_t), events.size(), fp);
+    fclose(fp);
+
+    if (read != events.size()) {
+        fprintf(stderr, "truncated trace, %zu of %zu events\n", read, events.size());
+        events.resize(read);
+    }
+
+    printf("events=%zu dropped=%u\n\n", events.size(), header.dropped);
+
+    operation_stats_t stats[NumberOfOperations];
+    std::vector<open_operation_t> stack;
+    open_operation_t outside;
+    auto unmatched = 0u;
+
+    for (auto const &event : events) {
+        switch (event.kind) {
+        case trace_kind::Begin: {
+            open_operation_t open;
+            open.operation = event.operation;
+            open.began = event.time;
+            stack.push_back(open);
+            break;
+        }
+        case trace_kind::End: {
+            // Ends whose beginning was overwritten in the ring.
+            if (stack.empty() || stack.back().operation != event.operation) {
+                unmatched++;
+                break;
+            }
+            auto open = stack.back();
+            stack.pop_back();
+            close(stats[(size_t)open.operation], open, event.time);
+            break;
+        }
+        default: {
+            if ((size_t)event.kind >= NumberOfKinds) {
+                break;
+            }
+            if (stack.empty()) {
+                count(outside, event);
+            }
+            for (auto &open : stack) {
+                count(open, event);
+            }
+            break;
+        }
+        }
+    }
+
+    // Flash operations outside of any operation, like mounting.
+    auto &none = stats[(size_t)trace_operation::None];
+    for (auto i = 0u; i < NumberOfKinds; ++i) {
+        none.kinds[i] += outside.kinds[i];
+    }
+    none.page_hits += outside.page_hits;
+    none.sector_reads_cached += outside.sector_reads_cached;
+    none.descents_same_sector += outside.descents_same_sector;
+
+    if (unmatched > 0 || !stack.empty()) {
+        printf("unmatched=%u unfinished=%zu\n\n", unmatched, stack.size());
+    }
+
+    printf("%-14s %7s %10s %10s %9s %9s %8s %8s %8s %8s %9s\n", "operation", "count", "mean", "max", "pages", "hit%",
+           "flushes", "reads", "writes", "trims", "descents");
+
+    for (auto i = 0u; i < NumberOfOperations; ++i) {
+        auto &s = stats[i];
+        auto pages = s.kinds[(size_t)trace_kind::PageOpen];
+        if (s.count == 0 && pages == 0 && s.kinds[(size_t)trace_kind::SectorRead] == 0 &&
+            s.kinds[(size_t)trace_kind::SectorWrite] == 0) {
+            continue;
+        }
+
+        printf("%-14s %7u %10.1f %10u %9.1f %8.1f%% %8.1f %8.1f %8.1f %8.1f %9.1f\n", operation_names[i], s.count,
+               per(s.ticks, s.count), s.maximum, per(pages, s.count), pages == 0 ? 0.0 : 100.0 * s.page_hits / pages,
+               per(s.kinds[(size_t)trace_kind::PageFlush], s.count), per(s.kinds[(size_t)trace_kind::SectorRead], s.count),
+               per(s.kinds[(size_t)trace_kind::SectorWrite], s.count), per(s.kinds[(size_t)trace_kind::SectorTrim], s.count),
+               per(s.kinds[(size_t)trace_kind::TreeDescend], s.count));
+    }
+
+    for (auto i = 0u; i < NumberOfOperations; ++i) {
+        auto &s = stats[i];
+        if (s.count == 0) {
+            continue;
+        }
+
+        printf("\n%s latency (ticks)\n", operation_names[i]);
+
+        auto largest = 0u;
+        for (auto b = 0u; b < NumberOfBuckets; ++b) {
+            largest = std::max(largest, s.histogram[b]);
+        }
+
+        for (auto b = 0u; b < NumberOfBuckets; ++b) {
+            if (s.histogram[b] == 0) {
+                continue;
+            }
+            char bar[41];
+            auto width = (size_t)((uint64_t)s.histogram[b] * (sizeof(bar) - 1) / largest);
+            memset(bar, '#', width);
+            bar[width] = 0;
+            printf("  < %10u %7u %s\n", b == NumberOfBuckets - 1 ? UINT32_MAX : (2u << b), s.histogram[b], bar);
+        }
+    }
+
+    return 0;
+}